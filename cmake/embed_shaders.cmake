@@ -0,0 +1,16 @@
+# Turn GLSL sources into C string literals, like xxd -i does for
+# checkerboard.h, but at build time so edits to src/*.glsl are picked up:
+#
+#   cmake -DOUTPUT=shaders.h -DINPUTS=src/vs.glsl,src/fs.glsl -P embed_shaders.cmake
+#
+# src/vs.glsl becomes `static const char vs_glsl[]`. INPUTS is comma separated
+# because a ; would split the add_custom_command argument.
+string(REPLACE "," ";" inputs "${INPUTS}")
+set(content "// generated by cmake/embed_shaders.cmake, do not edit\n")
+foreach(input ${inputs})
+    get_filename_component(name ${input} NAME)
+    string(MAKE_C_IDENTIFIER ${name} id)
+    file(READ ${input} text)
+    string(APPEND content "static const char ${id}[] = R\"glsl(${text})glsl\";\n")
+endforeach()
+file(WRITE ${OUTPUT} "${content}")
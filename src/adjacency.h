@@ -0,0 +1,143 @@
+#ifndef ADJACENCY_ONCE
+#include "arena.h"
+#include "main.h"
+#include <algorithm>
+
+// Triangle adjacency for the unindexed STL soup: adj[3 * t + e] is the
+// triangle sharing edge e (vertex e to vertex e + 1) of triangle t, or -1 on
+// a boundary / non-manifold edge. Vertices are welded by exact position, which
+// is what binary STL exporters produce for shared corners. The result comes
+// from arena when given, malloc otherwise.
+inline int *BuildTriangleAdjacency(const Mesh &mesh,
+                                   ModelArena *arena = NULL) {
+  int nv = mesh.triangleCount * 3;
+  const float *v = mesh.vertices;
+  int *adj = (int *)ModelAlloc(arena, nv * sizeof(int));
+  ArenaMark mark = arena ? ArenaGetMark(arena) : (ArenaMark){0};
+
+  // weld: sort vertex indices by position, equal runs get the same id
+  int *order = (int *)ModelAlloc(arena, nv * sizeof(int));
+  int *weld = (int *)ModelAlloc(arena, nv * sizeof(int));
+  for (int i = 0; i < nv; i++)
+    order[i] = i;
+  std::sort(order, order + nv, [v](int a, int b) {
+    if (v[3 * a] != v[3 * b])
+      return v[3 * a] < v[3 * b];
+    if (v[3 * a + 1] != v[3 * b + 1])
+      return v[3 * a + 1] < v[3 * b + 1];
+    return v[3 * a + 2] < v[3 * b + 2];
+  });
+  int id = -1;
+  for (int i = 0; i < nv; i++) {
+    int a = order[i];
+    if (i == 0 || memcmp(&v[3 * a], &v[3 * order[i - 1]], 3 * sizeof(float)))
+      id++;
+    weld[a] = id;
+  }
+
+  // edges keyed by their (smaller, larger) welded vertex ids
+  struct Edge {
+    int a, b, half; // half = 3 * t + e
+  };
+  Edge *edges = (Edge *)ModelAlloc(arena, nv * sizeof(Edge));
+  for (int t = 0; t < mesh.triangleCount; t++)
+    for (int e = 0; e < 3; e++) {
+      int a = weld[3 * t + e], b = weld[3 * t + (e + 1) % 3];
+      edges[3 * t + e] = {std::min(a, b), std::max(a, b), 3 * t + e};
+    }
+  std::sort(edges, edges + nv, [](const Edge &x, const Edge &y) {
+    return x.a != y.a ? x.a < y.a : x.b < y.b;
+  });
+
+  for (int i = 0; i < nv; i++)
+    adj[i] = -1;
+  for (int i = 0; i < nv;) {
+    int j = i + 1;
+    while (j < nv && edges[j].a == edges[i].a && edges[j].b == edges[i].b)
+      j++;
+    if (j - i == 2) {
+      adj[edges[i].half] = edges[i + 1].half / 3;
+      adj[edges[i + 1].half] = edges[i].half / 3;
+    }
+    i = j;
+  }
+  ScratchFree(arena, order);
+  ScratchFree(arena, weld);
+  ScratchFree(arena, edges);
+  if (arena)
+    ArenaRewind(arena, mark);
+  return adj;
+}
+
+inline void MeshTriangle(const Mesh &mesh, int t, Vector3 p[3]) {
+  const float *v = mesh.vertices + 9 * t;
+  for (int j = 0; j < 3; j++)
+    p[j] = (Vector3){v[3 * j], v[3 * j + 1], v[3 * j + 2]};
+}
+
+// GetRayCollisionMesh that also reports which triangle was hit. The model
+// transform is the identity for STLs loaded by LoadSTLFromDB.
+inline RayCollision GetRayCollisionMeshIndex(Ray ray, const Mesh &mesh,
+                                             int *tri) {
+  RayCollision best = {0};
+  *tri = -1;
+  Vector3 p[3];
+  for (int t = 0; t < mesh.triangleCount; t++) {
+    MeshTriangle(mesh, t, p);
+    RayCollision hit = GetRayCollisionTriangle(ray, p[0], p[1], p[2]);
+    if (hit.hit && (!best.hit || hit.distance < best.distance)) {
+      best = hit;
+      *tri = t;
+    }
+  }
+  return best;
+}
+
+// Walk from triangle *tri towards the triangle the ray passes through: where
+// the ray meets the current triangle's plane, the most negative barycentric
+// coordinate names the edge to step across. Returns hit = false when the walk
+// leaves the surface, turns parallel to it or takes more than maxsteps, so the
+// caller can fall back to GetRayCollisionMeshIndex. The hit is the one
+// connected to the start triangle, not necessarily the nearest: a nearer,
+// disconnected part is only caught by RayOccludedBvh over [0, distance), as
+// HoverRayCollision does.
+inline RayCollision WalkRayCollision(Ray ray, const Mesh &mesh, const int *adj,
+                                     int *tri, int maxsteps, int *steps) {
+  RayCollision miss = {0};
+  int t = *tri;
+  Vector3 p[3];
+  for (*steps = 0; t >= 0 && *steps < maxsteps; ++*steps) {
+    MeshTriangle(mesh, t, p);
+    RayCollision hit = GetRayCollisionTriangle(ray, p[0], p[1], p[2]);
+    if (hit.hit) {
+      *tri = t;
+      return hit;
+    }
+
+    Vector3 e1 = p[1] - p[0], e2 = p[2] - p[0];
+    Vector3 n = Vector3CrossProduct(e1, e2);
+    float den = Vector3DotProduct(n, ray.direction);
+    if (den == 0)
+      return miss;
+    float s = Vector3DotProduct(n, p[0] - ray.position) / den;
+    if (s < 0)
+      return miss;
+    Vector3 x = ray.position + ray.direction * s;
+
+    // barycentric coordinates of x, scaled by |n|^2
+    float b[3];
+    b[0] = Vector3DotProduct(n, Vector3CrossProduct(p[2] - p[1], x - p[1]));
+    b[1] = Vector3DotProduct(n, Vector3CrossProduct(p[0] - p[2], x - p[2]));
+    b[2] = Vector3DotProduct(n, Vector3CrossProduct(p[1] - p[0], x - p[0]));
+    int k = 0;
+    for (int j = 1; j < 3; j++)
+      if (b[j] < b[k])
+        k = j;
+
+    // the edge opposite vertex k runs from k + 1 to k + 2
+    t = adj[3 * t + (k + 1) % 3];
+  }
+  return miss;
+}
+#define ADJACENCY_ONCE
+#endif
@@ -0,0 +1,130 @@
+#ifndef ARENA_ONCE
+#include "main.h"
+#include <algorithm>
+
+// Bump allocator that owns all CPU-side data of one loaded model: the parsed
+// vertices and normals, the Morton permutation and the picking structures.
+// Releasing the model is one ArenaRelease instead of a free per array.
+// ArenaReset keeps the memory, so loading a part of about the same size
+// again never reaches malloc. The arena grows by chaining blocks, and
+// a reset merges them so the next load fits in a single block.
+
+#define ARENA_ALIGN 16
+
+typedef struct ArenaBlock {
+  struct ArenaBlock *prev;
+  size_t cap, used;
+} ArenaBlock; // cap bytes of data follow, ARENA_ALIGN aligned
+
+typedef struct ModelArena {
+  ArenaBlock *head;
+  size_t total; // capacity of all blocks
+} ModelArena;
+
+// scratch allocations between ArenaGetMark and ArenaRewind are handed back
+typedef struct ArenaMark {
+  ArenaBlock *block;
+  size_t used;
+} ArenaMark;
+
+#define ARENA_HEADER                                                           \
+  ((sizeof(ArenaBlock) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+inline unsigned char *ArenaData(ArenaBlock *b) {
+  return (unsigned char *)b + ARENA_HEADER;
+}
+
+inline ArenaBlock *NewArenaBlock(size_t cap, ArenaBlock *prev) {
+  ArenaBlock *b = (ArenaBlock *)aligned_alloc(ARENA_ALIGN, ARENA_HEADER + cap);
+  if (!b)
+    return NULL;
+  b->prev = prev;
+  b->cap = cap;
+  b->used = 0;
+  return b;
+}
+
+// make sure the next bytes can be served by the current block, so a caller
+// that knows its total size up front gets one contiguous block
+inline bool ArenaReserve(ModelArena *a, size_t bytes) {
+  bytes = (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  if (a->head && a->head->cap - a->head->used >= bytes)
+    return true;
+  // double, so a model built piecewise chains O(log n) blocks
+  size_t cap = std::max(bytes, a->total);
+  ArenaBlock *b = NewArenaBlock(cap, a->head);
+  if (!b) {
+    printf("Out of memory: arena block of %zu bytes\n", cap);
+    return false;
+  }
+  a->head = b;
+  a->total += cap;
+  return true;
+}
+
+inline void *ArenaAlloc(ModelArena *a, size_t bytes) {
+  bytes = (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  if (!ArenaReserve(a, bytes))
+    return NULL;
+  void *p = ArenaData(a->head) + a->head->used;
+  a->head->used += bytes;
+  return p;
+}
+
+inline ArenaMark ArenaGetMark(const ModelArena *a) {
+  return (ArenaMark){a->head, a->head ? a->head->used : 0};
+}
+
+// blocks chained since the mark held only scratch; they stay, empty, for
+// the next reset to merge
+inline void ArenaRewind(ModelArena *a, ArenaMark m) {
+  for (ArenaBlock *b = a->head; b; b = b->prev) {
+    if (b == m.block) {
+      b->used = m.used;
+      break;
+    }
+    b->used = 0;
+  }
+}
+
+inline void ArenaRelease(ModelArena *a) {
+  while (a->head) {
+    ArenaBlock *prev = a->head->prev;
+    free(a->head);
+    a->head = prev;
+  }
+  a->total = 0;
+}
+
+// forget every allocation but keep the memory: O(1) with a single block
+inline void ArenaReset(ModelArena *a) {
+  if (a->head && a->head->prev) {
+    size_t total = a->total;
+    ArenaRelease(a);
+    ArenaReserve(a, total);
+  } else if (a->head) {
+    a->head->used = 0;
+  }
+}
+
+// where the model builders get memory that outlives them: the arena when
+// the caller has one, malloc otherwise (the batch paths, which free per array)
+inline void *ModelAlloc(ModelArena *arena, size_t bytes) {
+  return arena ? ArenaAlloc(arena, bytes) : malloc(bytes);
+}
+
+inline void *ModelCalloc(ModelArena *arena, size_t bytes) {
+  if (!arena)
+    return calloc(bytes, 1);
+  void *p = ArenaAlloc(arena, bytes);
+  return p ? memset(p, 0, bytes) : NULL;
+}
+
+// a builder's temporaries come from ModelAlloc too; with an arena they are
+// handed back by one ArenaRewind to the mark taken before them
+inline void ScratchFree(ModelArena *arena, void *p) {
+  if (!arena)
+    free(p);
+}
+#define ARENA_ONCE
+#endif
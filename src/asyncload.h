@@ -0,0 +1,158 @@
+#ifndef ASYNCLOAD_ONCE
+#include "compact.h"
+#include "context.h"
+#include "initdb.h"
+#include "main.h"
+#include "startup.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+// Startup without a black window. A worker reads the STL, the picks and the
+// camera, then builds the picking structures. Meanwhile the render thread
+// uploads at most ASYNC_UPLOAD_BYTES of vertices per frame and draws what
+// has arrived. The triangles are in Morton order, so the part fills in region
+// by region.
+//
+// The worker owns ctx until LOAD_STRUCTURES, and ctx->arena with the picking
+// structures until LOAD_READY. In between the viewer only orbits the camera
+// and draws the picks. Picking, and with it the hover state, starts with
+// PollAsyncLoad's handover at LOAD_READY.
+
+#define ASYNC_UPLOAD_BYTES (4 << 20)
+// whole triangles, so the preview never draws a partial one
+#define ASYNC_UPLOAD_VERTICES                                                  \
+  ((int)(ASYNC_UPLOAD_BYTES / sizeof(CompactVertex)) / 3 * 3)
+
+enum {
+  LOAD_DATABASE,   // reading the STL, picks and camera
+  LOAD_STRUCTURES, // mesh, picks and camera ready, building picking structures
+  LOAD_READY,      // worker done
+  LOAD_FAILED
+};
+
+typedef struct AsyncLoad {
+  std::thread worker;
+  std::atomic<int> stage{LOAD_DATABASE};
+  Mesh mesh = {0}; // in ctx->arena, complete from LOAD_STRUCTURES
+  BoundingBox bounds = {0};
+
+  // render thread only
+  bool picking = false; // worker joined, ctx->stl_model is the mesh
+  int uploaded = -1;    // vertices on the GPU, -1 before BeginCompactUpload
+  double upload_start = 0;
+  CompactVertex *scratch = NULL;
+  Mesh preview = {0}; // the mesh with vertexCount = uploaded
+  int preview_material = 0;
+  Model preview_model = {0};
+} AsyncLoad;
+
+inline void StartAsyncLoad(AsyncLoad *l, PickerContext *ctx) {
+  l->worker = std::thread([l, ctx] {
+    if (!InitializeReadModel(ctx, &l->mesh)) {
+      l->stage = LOAD_FAILED;
+      return;
+    }
+    l->bounds = GetMeshBoundingBox(l->mesh);
+    l->stage = LOAD_STRUCTURES;
+    InitializePicking(ctx, l->mesh);
+    l->stage = LOAD_READY;
+  });
+}
+
+// the camera, picks and (part of) the mesh can be drawn
+inline bool LoadShowsModel(const AsyncLoad *l) {
+  int stage = l->stage;
+  return stage == LOAD_STRUCTURES || stage == LOAD_READY;
+}
+
+// nothing left to do: the model is on the GPU and ctx belongs to the viewer
+inline bool LoadFinished(const AsyncLoad *l) {
+  return l->picking && l->uploaded == l->mesh.vertexCount;
+}
+
+// once per frame on the render thread: upload the next chunk, and take ctx
+// over when the worker is done. False if the load failed.
+inline bool PollAsyncLoad(AsyncLoad *l, PickerContext *ctx) {
+  int stage = l->stage;
+  if (stage == LOAD_FAILED) {
+    if (l->worker.joinable())
+      l->worker.join();
+    return false;
+  }
+  if (stage == LOAD_DATABASE || LoadFinished(l))
+    return true;
+
+  if (l->uploaded < 0) {
+    l->upload_start = StartupClock();
+    l->preview = l->mesh;
+    ctx->gpu = BeginCompactUpload(&l->preview, NULL);
+    SetShaderBounds(shader, l->bounds);
+    l->scratch = (CompactVertex *)malloc(
+        std::min(ASYNC_UPLOAD_VERTICES, l->mesh.vertexCount) *
+        sizeof(CompactVertex));
+    l->uploaded = 0;
+  }
+  if (l->uploaded < l->mesh.vertexCount) {
+    int n = std::min(ASYNC_UPLOAD_VERTICES, l->mesh.vertexCount - l->uploaded);
+    UploadCompactVertices(l->mesh, l->bounds, ctx->gpu, l->uploaded, n,
+                          l->scratch);
+    l->uploaded += n;
+    if (l->uploaded == l->mesh.vertexCount) {
+      free(l->scratch);
+      l->scratch = NULL;
+      StartupPhase("main", "upload mesh", l->upload_start);
+    }
+  }
+  l->preview.vertexCount = l->uploaded;
+
+  if (stage == LOAD_READY && !l->picking) {
+    l->worker.join();
+    Mesh mesh = l->mesh;
+    mesh.vaoId = l->preview.vaoId;
+    mesh.vboId = l->preview.vboId;
+    SetModelMesh(ctx, mesh);
+    ctx->hover_tri = -1;
+    l->picking = true;
+  }
+  return true;
+}
+
+// what to draw this frame: ctx->stl_model once it is all uploaded, until then
+// the uploaded prefix with the same material
+inline const Model &LoadedModel(AsyncLoad *l, const PickerContext *ctx) {
+  if (LoadFinished(l))
+    return ctx->stl_model;
+  l->preview_model = (Model){.transform = MatrixIdentity(),
+                             .meshCount = l->uploaded > 0,
+                             .materialCount = 1,
+                             .meshes = &l->preview,
+                             .materials = ctx->stl_model.materials,
+                             .meshMaterial = &l->preview_material};
+  return l->preview_model;
+}
+
+inline void DrawLoadProgress(const AsyncLoad *l) {
+  int stage = l->stage;
+  const char *what = stage == LOAD_DATABASE ? "reading STL, picks and camera"
+                     : !l->picking          ? "building picking structures"
+                                            : "uploading";
+  float done = l->mesh.vertexCount > 0 && l->uploaded > 0
+                   ? (float)l->uploaded / l->mesh.vertexCount
+                   : 0;
+  int x = 10, y = SCREEN_HEIGHT - 40, w = 300;
+  DrawText(TextFormat("loading: %s, %d%% on the GPU", what, (int)(done * 100)),
+           x, y - 20, 16, DARKGRAY);
+  DrawRectangleLines(x, y, w, 12, DARKGRAY);
+  DrawRectangle(x, y, (int)(done * w), 12, DARKGRAY);
+}
+
+// stop waiting: on exit, whatever stage the load is in
+inline void StopAsyncLoad(AsyncLoad *l) {
+  if (l->worker.joinable())
+    l->worker.join();
+  free(l->scratch);
+  l->scratch = NULL;
+}
+#define ASYNCLOAD_ONCE
+#endif
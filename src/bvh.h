@@ -0,0 +1,345 @@
+#ifndef BVH_ONCE
+#include "adjacency.h"
+#include "arena.h"
+#include "geometry.h"
+#include "main.h"
+#include <algorithm>
+
+#define BVH_LEAF_SIZE 4
+
+// Bounding volume hierarchy over the triangles of a Mesh, so ray queries visit
+// O(log n) boxes instead of every triangle. Children of an inner node are
+// stored next to each other.
+typedef struct BvhNode {
+  BoundingBox box;
+  int first; // leaf: offset into Bvh.tris, inner: index of the left child
+  int count; // triangles in a leaf, 0 for inner nodes
+} BvhNode;
+
+typedef struct Bvh {
+  BvhNode *nodes;
+  int nnodes;
+  int *tris; // triangle indices, leaves own contiguous ranges
+  int ntris;
+} Bvh;
+
+inline BoundingBox EmptyBox() {
+  return (BoundingBox){{INFINITY, INFINITY, INFINITY},
+                       {-INFINITY, -INFINITY, -INFINITY}};
+}
+
+inline void GrowBox(BoundingBox *b, Vector3 p) {
+  b->min = Vector3Min(b->min, p);
+  b->max = Vector3Max(b->max, p);
+}
+
+// median split on the longest axis of the triangle centroids. With an arena
+// the nodes and triangle indices live in it and UnloadBvh is not called.
+inline Bvh BuildBvh(const Mesh &mesh, ModelArena *arena = NULL) {
+  Bvh bvh = {0};
+  int n = mesh.triangleCount;
+  bvh.ntris = n;
+  bvh.tris = (int *)ModelAlloc(arena, n * sizeof(int));
+  bvh.nodes = (BvhNode *)ModelAlloc(arena, (2 * n + 1) * sizeof(BvhNode));
+  ArenaMark mark = arena ? ArenaGetMark(arena) : (ArenaMark){0};
+  Vector3 *centroid = (Vector3 *)ModelAlloc(arena, n * sizeof(Vector3));
+
+  Vector3 p[3];
+  for (int t = 0; t < n; t++) {
+    MeshTriangle(mesh, t, p);
+    centroid[t] = (p[0] + p[1] + p[2]) * (1.f / 3.f);
+    bvh.tris[t] = t;
+  }
+
+  bvh.nodes[0] = (BvhNode){.box = EmptyBox(), .first = 0, .count = n};
+  bvh.nnodes = 1;
+  int stack[64], sp = 0;
+  stack[sp++] = 0;
+  while (sp > 0) {
+    BvhNode *node = &bvh.nodes[stack[--sp]];
+    BoundingBox cbox = EmptyBox();
+    for (int i = node->first; i < node->first + node->count; i++) {
+      MeshTriangle(mesh, bvh.tris[i], p);
+      for (int j = 0; j < 3; j++)
+        GrowBox(&node->box, p[j]);
+      GrowBox(&cbox, centroid[bvh.tris[i]]);
+    }
+    if (node->count <= BVH_LEAF_SIZE)
+      continue;
+
+    Vector3 extent = cbox.max - cbox.min;
+    int axis = extent.x > extent.y ? 0 : 1;
+    if (extent.z > (axis ? extent.y : extent.x))
+      axis = 2;
+    if ((&extent.x)[axis] <= 0)
+      continue; // all centroids coincide
+
+    int *first = bvh.tris + node->first, half = node->count / 2;
+    std::nth_element(first, first + half, first + node->count,
+                     [centroid, axis](int a, int b) {
+                       return (&centroid[a].x)[axis] < (&centroid[b].x)[axis];
+                     });
+    int left = bvh.nnodes;
+    bvh.nnodes += 2;
+    bvh.nodes[left] =
+        (BvhNode){.box = EmptyBox(), .first = node->first, .count = half};
+    bvh.nodes[left + 1] = (BvhNode){.box = EmptyBox(),
+                                    .first = node->first + half,
+                                    .count = node->count - half};
+    node->first = left;
+    node->count = 0;
+    stack[sp++] = left;
+    stack[sp++] = left + 1;
+  }
+  ScratchFree(arena, centroid);
+  if (arena)
+    ArenaRewind(arena, mark);
+  return bvh;
+}
+
+inline void UnloadBvh(Bvh bvh) {
+  free(bvh.nodes);
+  free(bvh.tris);
+}
+
+// slab test, *tmin is where the ray enters the box
+inline bool RayBoxDistance(Ray ray, Vector3 inv, BoundingBox b, float tmax,
+                           float *tmin) {
+  float tx1 = (b.min.x - ray.position.x) * inv.x;
+  float tx2 = (b.max.x - ray.position.x) * inv.x;
+  float t0 = fminf(tx1, tx2), t1 = fmaxf(tx1, tx2);
+  float ty1 = (b.min.y - ray.position.y) * inv.y;
+  float ty2 = (b.max.y - ray.position.y) * inv.y;
+  t0 = fmaxf(t0, fminf(ty1, ty2));
+  t1 = fminf(t1, fmaxf(ty1, ty2));
+  float tz1 = (b.min.z - ray.position.z) * inv.z;
+  float tz2 = (b.max.z - ray.position.z) * inv.z;
+  t0 = fmaxf(t0, fminf(tz1, tz2));
+  t1 = fminf(t1, fmaxf(tz1, tz2));
+  *tmin = t0;
+  return t1 >= fmaxf(t0, 0.f) && t0 < tmax;
+}
+
+// GetRayCollisionMeshIndex through the BVH: nearest hit and its triangle
+inline RayCollision GetRayCollisionBvh(Ray ray, const Mesh &mesh,
+                                       const Bvh &bvh, int *tri) {
+  RayCollision best = {0};
+  *tri = -1;
+  if (bvh.nnodes == 0)
+    return best;
+
+  Vector3 inv = {1.f / ray.direction.x, 1.f / ray.direction.y,
+                 1.f / ray.direction.z};
+  Vector3 p[3];
+  int stack[64], sp = 0;
+  stack[sp++] = 0;
+  while (sp > 0) {
+    const BvhNode &node = bvh.nodes[stack[--sp]];
+    float t;
+    if (!RayBoxDistance(ray, inv, node.box, best.hit ? best.distance : INFINITY,
+                        &t))
+      continue;
+    if (node.count > 0) {
+      for (int i = node.first; i < node.first + node.count; i++) {
+        MeshTriangle(mesh, bvh.tris[i], p);
+        RayCollision hit = GetRayCollisionTriangle(ray, p[0], p[1], p[2]);
+        if (hit.hit && (!best.hit || hit.distance < best.distance)) {
+          best = hit;
+          *tri = bvh.tris[i];
+        }
+      }
+      continue;
+    }
+    // visit the nearer child first so the farther one is usually culled
+    float tl, tr;
+    bool hl = RayBoxDistance(ray, inv, bvh.nodes[node.first].box, INFINITY, &tl);
+    bool hr =
+        RayBoxDistance(ray, inv, bvh.nodes[node.first + 1].box, INFINITY, &tr);
+    if (hl && hr) {
+      stack[sp++] = tl < tr ? node.first + 1 : node.first;
+      stack[sp++] = tl < tr ? node.first : node.first + 1;
+    } else if (hl) {
+      stack[sp++] = node.first;
+    } else if (hr) {
+      stack[sp++] = node.first + 1;
+    }
+  }
+  return best;
+}
+
+// whether a triangle other than skip crosses the ray before tmax. It returns
+// on the first hit found in no particular order; when nothing is in the way
+// it visits every node the segment passes, about what GetRayCollisionBvh
+// visits for the whole ray.
+inline bool RayOccludedBvh(Ray ray, const Mesh &mesh, const Bvh &bvh,
+                           float tmax, int skip) {
+  if (bvh.nnodes == 0)
+    return false;
+
+  Vector3 inv = {1.f / ray.direction.x, 1.f / ray.direction.y,
+                 1.f / ray.direction.z};
+  Vector3 p[3];
+  int stack[64], sp = 0;
+  stack[sp++] = 0;
+  while (sp > 0) {
+    const BvhNode &node = bvh.nodes[stack[--sp]];
+    float t;
+    if (!RayBoxDistance(ray, inv, node.box, tmax, &t))
+      continue;
+    if (node.count > 0) {
+      for (int i = node.first; i < node.first + node.count; i++) {
+        if (bvh.tris[i] == skip)
+          continue;
+        MeshTriangle(mesh, bvh.tris[i], p);
+        RayCollision hit = GetRayCollisionTriangle(ray, p[0], p[1], p[2]);
+        if (hit.hit && hit.distance < tmax)
+          return true;
+      }
+      continue;
+    }
+    stack[sp++] = node.first;
+    stack[sp++] = node.first + 1;
+  }
+  return false;
+}
+
+// the hover preview's query: walk the adjacency from *tri, last frame's
+// triangle, and fall back to GetRayCollisionBvh when the walk fails or a
+// nearer part covers its hit. Only a walk that left *tri or a recheck (the
+// camera moved) pays for RayOccludedBvh; a hit on *tri itself is kept, as
+// that triangle was in front last frame. *steps is -1 after the fallback.
+inline RayCollision HoverRayCollision(Ray ray, const Mesh &mesh,
+                                      const int *adj, const Bvh &bvh,
+                                      bool recheck, int *tri, int *steps) {
+  RayCollision hit = {0};
+  int start = *tri;
+  *steps = 0;
+  if (start >= 0)
+    hit = WalkRayCollision(ray, mesh, adj, tri, 64, steps);
+  if (hit.hit && (recheck || *tri != start) &&
+      RayOccludedBvh(ray, mesh, bvh, hit.distance, *tri))
+    hit.hit = false;
+  if (!hit.hit) {
+    hit = GetRayCollisionBvh(ray, mesh, bvh, tri);
+    *steps = -1;
+  }
+  return hit;
+}
+
+#define BVH_PACKET 64
+
+// GetRayCollisionBvh for n <= BVH_PACKET coherent rays, such as a screen tile
+// from one camera: one traversal for the whole packet, so every node box and
+// leaf triangle is fetched once. A stack entry keeps the range of rays that
+// hit its parent; rays outside it missed already and are not tested again.
+// Children are visited nearer first along the packet's mean direction.
+inline void GetRayCollisionBvhPacket(const Ray *rays, int n, const Mesh &mesh,
+                                     const Bvh &bvh, RayCollision *hits,
+                                     int *tris) {
+  Vector3 inv[BVH_PACKET], dir = Vector3Zero();
+  float best[BVH_PACKET];
+  for (int k = 0; k < n; k++) {
+    hits[k] = (RayCollision){0};
+    tris[k] = -1;
+    best[k] = INFINITY;
+    inv[k] = (Vector3){1.f / rays[k].direction.x, 1.f / rays[k].direction.y,
+                       1.f / rays[k].direction.z};
+    dir += rays[k].direction;
+  }
+  if (bvh.nnodes == 0 || n == 0)
+    return;
+
+  Vector3 p[3];
+  bool active[BVH_PACKET];
+  struct Entry {
+    int node, first, last; // rays [first, last) may hit node
+  } stack[64];
+  int sp = 0;
+  stack[sp++] = (Entry){0, 0, n};
+  while (sp > 0) {
+    Entry e = stack[--sp];
+    const BvhNode &node = bvh.nodes[e.node];
+    int first = e.last, last = e.first;
+    float t;
+    for (int k = e.first; k < e.last; k++) {
+      active[k] = RayBoxDistance(rays[k], inv[k], node.box, best[k], &t);
+      if (active[k]) {
+        first = std::min(first, k);
+        last = k + 1;
+      }
+    }
+    if (first >= last)
+      continue;
+
+    if (node.count > 0) {
+      for (int i = node.first; i < node.first + node.count; i++) {
+        MeshTriangle(mesh, bvh.tris[i], p);
+        for (int k = first; k < last; k++) {
+          if (!active[k])
+            continue;
+          RayCollision hit = GetRayCollisionTriangle(rays[k], p[0], p[1], p[2]);
+          if (hit.hit && hit.distance < best[k]) {
+            hits[k] = hit;
+            best[k] = hit.distance;
+            tris[k] = bvh.tris[i];
+          }
+        }
+      }
+      continue;
+    }
+    Vector3 cl = bvh.nodes[node.first].box.min + bvh.nodes[node.first].box.max;
+    Vector3 cr =
+        bvh.nodes[node.first + 1].box.min + bvh.nodes[node.first + 1].box.max;
+    bool left_first = Vector3DotProduct(cl - cr, dir) < 0;
+    stack[sp++] =
+        (Entry){left_first ? node.first + 1 : node.first, first, last};
+    stack[sp++] =
+        (Entry){left_first ? node.first : node.first + 1, first, last};
+  }
+}
+
+// squared distance from p to the box, 0 inside
+inline float BoxDistanceSqr(BoundingBox b, Vector3 p) {
+  Vector3 d = Vector3Max(Vector3Max(b.min - p, p - b.max), Vector3Zero());
+  return Vector3LengthSqr(d);
+}
+
+// closest point on the mesh to x: branch and bound, nearer child first, boxes
+// farther than the best point so far are skipped
+inline Vector3 ClosestPointBvh(Vector3 x, const Mesh &mesh, const Bvh &bvh,
+                               int *tri) {
+  float best = INFINITY;
+  Vector3 closest = x;
+  *tri = -1;
+  if (bvh.nnodes == 0)
+    return closest;
+
+  Vector3 p[3];
+  int stack[64], sp = 0;
+  stack[sp++] = 0;
+  while (sp > 0) {
+    const BvhNode &node = bvh.nodes[stack[--sp]];
+    if (BoxDistanceSqr(node.box, x) >= best)
+      continue;
+    if (node.count > 0) {
+      for (int i = node.first; i < node.first + node.count; i++) {
+        MeshTriangle(mesh, bvh.tris[i], p);
+        Vector3 q = ClosestPointTriangle(x, p[0], p[1], p[2]);
+        float d = Vector3DistanceSqr(q, x);
+        if (d < best) {
+          best = d;
+          closest = q;
+          *tri = bvh.tris[i];
+        }
+      }
+      continue;
+    }
+    float dl = BoxDistanceSqr(bvh.nodes[node.first].box, x);
+    float dr = BoxDistanceSqr(bvh.nodes[node.first + 1].box, x);
+    stack[sp++] = dl < dr ? node.first + 1 : node.first;
+    stack[sp++] = dl < dr ? node.first : node.first + 1;
+  }
+  return closest;
+}
+#define BVH_ONCE
+#endif
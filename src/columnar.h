@@ -0,0 +1,326 @@
+#ifndef COLUMNAR_ONCE
+#include "main.h"
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+// Picks and cameras as a columnar file that a consumer can mmap and read
+// without parsing, one file per STL or for the whole database:
+//
+//   offset 0    ColumnarHeader
+//   32          ColumnarColumn[ncolumns]
+//   ...         the column arrays, each starting at a multiple of 16
+//
+// Columns are named after the table column they hold ("cams.rowid",
+// "cams.posx", ..., "picks.cam", "picks.x"). The cams.* arrays have ncams
+// elements and the picks.* arrays npicks, in cams.rowid and then picks.rowid
+// order. picks.cam refers to the exporting database's cams.rowid, so readers
+// join through "cams.rowid". INT columns are int32 and REAL columns float64,
+// all in host (little endian) byte order, so REAL values round-trip exactly.
+
+#define COLUMNAR_MAGIC "WFPICKS"
+#define COLUMNAR_VERSION 1
+#define COLUMNAR_ALIGN 16
+
+enum { COLUMN_I32 = 1, COLUMN_F64 = 2 };
+
+typedef struct ColumnarHeader {
+  char magic[8]; // COLUMNAR_MAGIC, NUL padded
+  uint32_t version;
+  uint32_t ncolumns;
+  uint32_t ncams;
+  uint32_t npicks;
+  int32_t stl; // exported stls.rowid, 0 for the whole database
+  uint32_t reserved;
+} ColumnarHeader;
+
+typedef struct ColumnarColumn {
+  char name[16]; // NUL padded
+  uint32_t type; // COLUMN_I32 or COLUMN_F64
+  uint32_t count;
+  uint64_t offset; // from the start of the file
+} ColumnarColumn;
+
+static_assert(sizeof(ColumnarHeader) == 32, "documented layout");
+static_assert(sizeof(ColumnarColumn) == 32, "documented layout");
+
+typedef struct ColumnarSpec {
+  const char *name;
+  uint32_t type;
+} ColumnarSpec;
+
+// in file order, and in the order of the SELECTs below
+static const ColumnarSpec columnar_cams[] = {
+    {"cams.rowid", COLUMN_I32}, {"cams.stl", COLUMN_I32},
+    {"cams.posx", COLUMN_F64},  {"cams.posy", COLUMN_F64},
+    {"cams.posz", COLUMN_F64},  {"cams.tx", COLUMN_F64},
+    {"cams.ty", COLUMN_F64},    {"cams.tz", COLUMN_F64},
+    {"cams.upx", COLUMN_F64},   {"cams.upy", COLUMN_F64},
+    {"cams.upz", COLUMN_F64},   {"cams.fovy", COLUMN_F64},
+    {"cams.proj", COLUMN_I32},  {"cams.attachment", COLUMN_I32}};
+static const ColumnarSpec columnar_picks[] = {
+    {"picks.cam", COLUMN_I32}, {"picks.mx", COLUMN_F64},
+    {"picks.my", COLUMN_F64},  {"picks.x", COLUMN_F64},
+    {"picks.y", COLUMN_F64},   {"picks.z", COLUMN_F64}};
+#define COLUMNAR_NCAMS (int)(sizeof columnar_cams / sizeof *columnar_cams)
+#define COLUMNAR_NPICKS (int)(sizeof columnar_picks / sizeof *columnar_picks)
+
+inline size_t ColumnTypeSize(uint32_t type) {
+  return type == COLUMN_I32 ? 4 : type == COLUMN_F64 ? 8 : 0;
+}
+
+// run a SELECT whose result columns are spec, appending each to its array
+inline int ReadColumns(sqlite3 *db, const char *sql, int stl,
+                       const ColumnarSpec *spec, int ncolumns,
+                       std::string *arrays) {
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    return -1;
+  }
+  sqlite3_bind_int(stmt, 1, stl);
+  int rows = 0;
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    for (int c = 0; c < ncolumns; c++) {
+      if (spec[c].type == COLUMN_I32) {
+        int32_t v = sqlite3_column_int(stmt, c);
+        arrays[c].append((const char *)&v, sizeof v);
+      } else {
+        double v = sqlite3_column_double(stmt, c);
+        arrays[c].append((const char *)&v, sizeof v);
+      }
+    }
+    rows++;
+  }
+  sqlite3_finalize(stmt);
+  return rows;
+}
+
+// the cameras of stl_id (all cameras for 0) and their picks into path,
+// written next to it first and renamed, so readers never map a partial file
+inline bool ExportColumnar(sqlite3 *db, int stl_id, const char *path) {
+  const char *cams_sql =
+      "SELECT rowid, stl, posx, posy, posz, tx, ty, tz, upx, upy, upz, fovy, "
+      "proj, attachment FROM cams WHERE ?1 = 0 OR stl = ?1 ORDER BY rowid;";
+  const char *picks_sql =
+      "SELECT picks.cam, picks.mx, picks.my, picks.x, picks.y, picks.z "
+      "FROM picks JOIN cams ON picks.cam = cams.rowid "
+      "WHERE ?1 = 0 OR cams.stl = ?1 ORDER BY picks.cam, picks.rowid;";
+  std::vector<std::string> cams(COLUMNAR_NCAMS), picks(COLUMNAR_NPICKS);
+  // one read transaction, so cameras and picks are from the same snapshot
+  sqlite3_exec(db, "BEGIN;", NULL, NULL, NULL);
+  int ncams = ReadColumns(db, cams_sql, stl_id, columnar_cams, COLUMNAR_NCAMS,
+                          cams.data());
+  int npicks = ReadColumns(db, picks_sql, stl_id, columnar_picks,
+                           COLUMNAR_NPICKS, picks.data());
+  sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
+  if (ncams < 0 || npicks < 0)
+    return false;
+
+  ColumnarHeader h = {COLUMNAR_MAGIC, COLUMNAR_VERSION,
+                      COLUMNAR_NCAMS + COLUMNAR_NPICKS,
+                      (uint32_t)ncams,
+                      (uint32_t)npicks,
+                      stl_id,
+                      0};
+  std::vector<ColumnarColumn> dir(h.ncolumns);
+  uint64_t offset = sizeof h + h.ncolumns * sizeof(ColumnarColumn);
+  for (uint32_t c = 0; c < h.ncolumns; c++) {
+    bool cam = c < COLUMNAR_NCAMS;
+    const ColumnarSpec &s =
+        cam ? columnar_cams[c] : columnar_picks[c - COLUMNAR_NCAMS];
+    dir[c] = (ColumnarColumn){{0}, s.type, cam ? h.ncams : h.npicks, 0};
+    strncpy(dir[c].name, s.name, sizeof dir[c].name - 1);
+    offset = (offset + COLUMNAR_ALIGN - 1) & ~(uint64_t)(COLUMNAR_ALIGN - 1);
+    dir[c].offset = offset;
+    offset += dir[c].count * ColumnTypeSize(s.type);
+  }
+
+  std::string tmp = std::string(path) + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "wb");
+  if (!f) {
+    printf("Cannot write %s\n", tmp.c_str());
+    return false;
+  }
+  bool ok = fwrite(&h, sizeof h, 1, f) == 1 &&
+            fwrite(dir.data(), sizeof(ColumnarColumn), h.ncolumns, f) ==
+                h.ncolumns;
+  static const char zeros[COLUMNAR_ALIGN] = {0};
+  for (uint32_t c = 0; ok && c < h.ncolumns; c++) {
+    const std::string &a =
+        c < COLUMNAR_NCAMS ? cams[c] : picks[c - COLUMNAR_NCAMS];
+    long pad = (long)dir[c].offset - ftell(f);
+    ok = pad >= 0 && fwrite(zeros, 1, pad, f) == (size_t)pad &&
+         fwrite(a.data(), 1, a.size(), f) == a.size();
+  }
+  ok = fclose(f) == 0 && ok;
+  if (ok && rename(tmp.c_str(), path) != 0) {
+    printf("Cannot rename %s to %s\n", tmp.c_str(), path);
+    ok = false;
+  }
+  if (!ok)
+    unlink(tmp.c_str());
+  else
+    printf("Exported %d cams and %d picks to %s\n", ncams, npicks, path);
+  return ok;
+}
+
+// a read-only mapping of a columnar file, checked against its directory
+typedef struct ColumnarFile {
+  const unsigned char *data;
+  size_t size;
+  const ColumnarHeader *header;
+  const ColumnarColumn *columns;
+} ColumnarFile;
+
+inline bool OpenColumnar(const char *path, ColumnarFile *cf) {
+  *cf = (ColumnarFile){0};
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    printf("Cannot open %s\n", path);
+    return false;
+  }
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(ColumnarHeader);
+  void *p = ok ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)
+               : MAP_FAILED;
+  close(fd);
+  if (p == MAP_FAILED) {
+    printf("Cannot map %s\n", path);
+    return false;
+  }
+  cf->data = (const unsigned char *)p;
+  cf->size = st.st_size;
+  cf->header = (const ColumnarHeader *)p;
+  cf->columns = (const ColumnarColumn *)(cf->data + sizeof(ColumnarHeader));
+
+  const ColumnarHeader &h = *cf->header;
+  ok = memcmp(h.magic, COLUMNAR_MAGIC, sizeof COLUMNAR_MAGIC) == 0 &&
+       h.version == COLUMNAR_VERSION &&
+       sizeof h + (uint64_t)h.ncolumns * sizeof(ColumnarColumn) <= cf->size;
+  for (uint32_t c = 0; ok && c < h.ncolumns; c++) {
+    const ColumnarColumn &col = cf->columns[c];
+    size_t size = ColumnTypeSize(col.type);
+    ok = size > 0 && col.offset % COLUMNAR_ALIGN == 0 &&
+         col.offset <= cf->size && col.count <= (cf->size - col.offset) / size;
+  }
+  if (!ok) {
+    printf("%s is not a columnar picks file (version %d)\n", path,
+           COLUMNAR_VERSION);
+    munmap(p, cf->size);
+    *cf = (ColumnarFile){0};
+  }
+  return ok;
+}
+
+inline void CloseColumnar(ColumnarFile *cf) {
+  if (cf->data)
+    munmap((void *)cf->data, cf->size);
+  *cf = (ColumnarFile){0};
+}
+
+// the array of the named column, or NULL when it is missing or of another
+// type or length
+inline const void *ColumnarArray(const ColumnarFile &cf, const char *name,
+                                 uint32_t type, uint32_t count) {
+  for (uint32_t c = 0; c < cf.header->ncolumns; c++) {
+    const ColumnarColumn &col = cf.columns[c];
+    if (strncmp(col.name, name, sizeof col.name) == 0)
+      return col.type == type && col.count == count ? cf.data + col.offset
+                                                    : NULL;
+  }
+  return NULL;
+}
+
+// insert every camera of path, on stl_id when it is not 0 and on its
+// exported stl otherwise, and their picks, in one transaction. New cams get
+// new rowids; picks follow their camera.
+inline bool ImportColumnar(sqlite3 *db, const char *path, int stl_id) {
+  ColumnarFile cf;
+  if (!OpenColumnar(path, &cf))
+    return false;
+  uint32_t ncams = cf.header->ncams, npicks = cf.header->npicks;
+  const void *cams[COLUMNAR_NCAMS], *picks[COLUMNAR_NPICKS];
+  bool ok = true;
+  for (int c = 0; c < COLUMNAR_NCAMS; c++)
+    ok = ok && (cams[c] = ColumnarArray(cf, columnar_cams[c].name,
+                                        columnar_cams[c].type, ncams));
+  for (int c = 0; c < COLUMNAR_NPICKS; c++)
+    ok = ok && (picks[c] = ColumnarArray(cf, columnar_picks[c].name,
+                                         columnar_picks[c].type, npicks));
+  if (!ok) {
+    printf("%s lacks a column\n", path);
+    CloseColumnar(&cf);
+    return false;
+  }
+
+  sqlite3_stmt *cam_stmt, *pick_stmt;
+  const char *cam_sql =
+      "INSERT INTO cams (stl, posx, posy, posz, tx, ty, tz, upx, upy, upz, "
+      "fovy, proj, attachment) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
+  const char *pick_sql =
+      "INSERT INTO picks (cam, mx, my, x, y, z) VALUES (?, ?, ?, ?, ?, ?);";
+  if (sqlite3_prepare_v2(db, cam_sql, -1, &cam_stmt, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    CloseColumnar(&cf);
+    return false;
+  }
+  if (sqlite3_prepare_v2(db, pick_sql, -1, &pick_stmt, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    sqlite3_finalize(cam_stmt);
+    CloseColumnar(&cf);
+    return false;
+  }
+
+  // bind column c of row i of a table's arrays to parameter param
+  auto bind = [](sqlite3_stmt *stmt, const ColumnarSpec *spec,
+                 const void *const *arrays, int c, int param, uint32_t i) {
+    if (spec[c].type == COLUMN_I32)
+      sqlite3_bind_int(stmt, param, ((const int32_t *)arrays[c])[i]);
+    else
+      sqlite3_bind_double(stmt, param, ((const double *)arrays[c])[i]);
+  };
+
+  ok = sqlite3_exec(db, "BEGIN;", NULL, NULL, NULL) == SQLITE_OK;
+  std::unordered_map<int32_t, sqlite3_int64> cam_ids;
+  const int32_t *cam_rowid = (const int32_t *)cams[0];
+  for (uint32_t i = 0; ok && i < ncams; i++) {
+    sqlite3_reset(cam_stmt);
+    for (int c = 1; c < COLUMNAR_NCAMS; c++)
+      bind(cam_stmt, columnar_cams, cams, c, c, i);
+    if (stl_id)
+      sqlite3_bind_int(cam_stmt, 1, stl_id);
+    ok = sqlite3_step(cam_stmt) == SQLITE_DONE;
+    cam_ids[cam_rowid[i]] = sqlite3_last_insert_rowid(db);
+  }
+  const int32_t *pick_cam = (const int32_t *)picks[0];
+  for (uint32_t i = 0; ok && i < npicks; i++) {
+    auto cam = cam_ids.find(pick_cam[i]);
+    if (cam == cam_ids.end()) {
+      printf("pick %u refers to cam %d, which is not in %s\n", i, pick_cam[i],
+             path);
+      ok = false;
+      break;
+    }
+    sqlite3_reset(pick_stmt);
+    sqlite3_bind_int64(pick_stmt, 1, cam->second);
+    for (int c = 1; c < COLUMNAR_NPICKS; c++)
+      bind(pick_stmt, columnar_picks, picks, c, c + 1, i);
+    ok = sqlite3_step(pick_stmt) == SQLITE_DONE;
+  }
+  if (!ok)
+    printf("Import failed: %s\n", sqlite3_errmsg(db));
+  sqlite3_exec(db, ok ? "COMMIT;" : "ROLLBACK;", NULL, NULL, NULL);
+  sqlite3_finalize(cam_stmt);
+  sqlite3_finalize(pick_stmt);
+  CloseColumnar(&cf);
+  if (ok)
+    printf("Imported %u cams and %u picks from %s\n", ncams, npicks, path);
+  return ok;
+}
+#define COLUMNAR_ONCE
+#endif
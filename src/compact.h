@@ -0,0 +1,150 @@
+#ifndef COMPACT_ONCE
+#include "main.h"
+#include "rlgl.h"
+#include <stddef.h>
+
+// GPU copy of an STL mesh in 10 bytes per vertex instead of UploadMesh's 24:
+// the position as unorm16x3 inside the model bounds and the (face) normal as
+// octahedral snorm16x2. vs.glsl decodes both. The CPU-side mesh.vertices keep
+// full precision, so picking and the stored picks.x/y/z are unaffected.
+
+#define COMPACT_GL_SHORT 0x1402
+#define COMPACT_GL_UNSIGNED_SHORT 0x1403
+// UnloadMesh walks this many vboId slots (raylib's MAX_MESH_VERTEX_BUFFERS)
+#define COMPACT_VBO_SLOTS 9
+
+// the GL objects behind one uploaded model: releasing it is UnloadModelGpu,
+// whatever holds the CPU side
+typedef struct ModelGpu {
+  unsigned int vao;
+  unsigned int vbo;
+  unsigned int *slots; // the Mesh.vboId array DrawMesh indexes
+} ModelGpu;
+
+typedef struct CompactVertex {
+  uint16_t pos[3]; // (p - bounds.min) / (bounds.max - bounds.min) * 65535
+  int16_t oct[2];  // OctEncode(normal)
+} CompactVertex;
+
+inline float SignNotZero(float x) { return x >= 0 ? 1.f : -1.f; }
+
+// project the unit sphere onto the octahedron |x|+|y|+|z| = 1 and unfold the
+// lower half over the corners of the square
+inline void OctEncode(Vector3 n, int16_t out[2]) {
+  float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+  float x = 0, y = 0;
+  if (l1 > 0) {
+    x = n.x / l1;
+    y = n.y / l1;
+    if (n.z < 0) {
+      float ox = x;
+      x = (1 - fabsf(y)) * SignNotZero(ox);
+      y = (1 - fabsf(ox)) * SignNotZero(y);
+    }
+  }
+  out[0] = (int16_t)roundf(Clamp(x, -1, 1) * 32767);
+  out[1] = (int16_t)roundf(Clamp(y, -1, 1) * 32767);
+}
+
+// the CPU twin of octDecode in vs.glsl
+inline Vector3 OctDecode(const int16_t in[2]) {
+  Vector3 n = {in[0] / 32767.f, in[1] / 32767.f, 0};
+  n.z = 1 - fabsf(n.x) - fabsf(n.y);
+  float t = fmaxf(-n.z, 0);
+  n.x += n.x >= 0 ? -t : t;
+  n.y += n.y >= 0 ? -t : t;
+  return Vector3Normalize(n);
+}
+
+inline uint16_t QuantizeUnit(float x) {
+  return (uint16_t)roundf(Clamp(x, 0, 1) * 65535);
+}
+
+// vertices [first, first + count) of mesh into out
+inline void EncodeCompactRange(const Mesh &mesh, BoundingBox bounds, int first,
+                               int count, CompactVertex *out) {
+  Vector3 size = bounds.max - bounds.min;
+  Vector3 inv = {size.x > 0 ? 1 / size.x : 0, size.y > 0 ? 1 / size.y : 0,
+                 size.z > 0 ? 1 / size.z : 0};
+  for (int i = 0; i < count; i++) {
+    const float *p = mesh.vertices + 3 * (first + i);
+    const float *n = mesh.normals + 3 * (first + i);
+    out[i].pos[0] = QuantizeUnit((p[0] - bounds.min.x) * inv.x);
+    out[i].pos[1] = QuantizeUnit((p[1] - bounds.min.y) * inv.y);
+    out[i].pos[2] = QuantizeUnit((p[2] - bounds.min.z) * inv.z);
+    OctEncode((Vector3){n[0], n[1], n[2]}, out[i].oct);
+  }
+}
+
+inline CompactVertex *EncodeCompactVertices(const Mesh &mesh,
+                                            BoundingBox bounds) {
+  CompactVertex *v =
+      (CompactVertex *)malloc(mesh.vertexCount * sizeof(CompactVertex));
+  EncodeCompactRange(mesh, bounds, 0, mesh.vertexCount, v);
+  return v;
+}
+
+// the VAO and a VBO sized for all of mesh, filled from v, or left undefined
+// for UploadCompactVertices when v is NULL. The VAO is what DrawMesh binds,
+// so DrawModel works unchanged.
+inline ModelGpu BeginCompactUpload(Mesh *mesh, const CompactVertex *v) {
+  mesh->vboId =
+      (unsigned int *)RL_CALLOC(COMPACT_VBO_SLOTS, sizeof(unsigned int));
+  mesh->vaoId = rlLoadVertexArray();
+  rlEnableVertexArray(mesh->vaoId);
+  mesh->vboId[0] = rlLoadVertexBuffer(
+      v, mesh->vertexCount * (int)sizeof(CompactVertex), false);
+  rlSetVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_POSITION, 3,
+                       COMPACT_GL_UNSIGNED_SHORT, true, sizeof(CompactVertex),
+                       offsetof(CompactVertex, pos));
+  rlEnableVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_POSITION);
+  rlSetVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_NORMAL, 2,
+                       COMPACT_GL_SHORT, true, sizeof(CompactVertex),
+                       offsetof(CompactVertex, oct));
+  rlEnableVertexAttribute(RL_DEFAULT_SHADER_ATTRIB_LOCATION_NORMAL);
+
+  // as UploadMesh does for meshes without colors
+  float white[4] = {1.f, 1.f, 1.f, 1.f};
+  rlSetVertexAttributeDefault(RL_DEFAULT_SHADER_ATTRIB_LOCATION_COLOR, white,
+                              SHADER_ATTRIB_VEC4, 4);
+  rlDisableVertexArray();
+  return (ModelGpu){mesh->vaoId, mesh->vboId[0], mesh->vboId};
+}
+
+// encode and upload vertices [first, first + count) into a VBO from
+// BeginCompactUpload; scratch is room for count vertices
+inline void UploadCompactVertices(const Mesh &mesh, BoundingBox bounds,
+                                  const ModelGpu &gpu, int first, int count,
+                                  CompactVertex *scratch) {
+  EncodeCompactRange(mesh, bounds, first, count, scratch);
+  rlUpdateVertexBuffer(gpu.vbo, scratch, count * (int)sizeof(CompactVertex),
+                       first * (int)sizeof(CompactVertex));
+}
+
+// UploadMesh replacement for the compact layout, in one go
+inline ModelGpu UploadCompactMesh(Mesh *mesh, BoundingBox bounds) {
+  CompactVertex *v = EncodeCompactVertices(*mesh, bounds);
+  ModelGpu gpu = BeginCompactUpload(mesh, v);
+  free(v);
+  return gpu;
+}
+
+inline void UnloadModelGpu(ModelGpu *gpu) {
+  if (gpu->vao)
+    rlUnloadVertexArray(gpu->vao);
+  if (gpu->vbo)
+    rlUnloadVertexBuffer(gpu->vbo);
+  RL_FREE(gpu->slots);
+  *gpu = (ModelGpu){0};
+}
+
+// the bounds vs.glsl needs to undo the position quantization
+inline void SetShaderBounds(Shader shader, BoundingBox bounds) {
+  Vector3 size = bounds.max - bounds.min;
+  SetShaderValue(shader, GetShaderLocation(shader, "boundsMin"), &bounds.min,
+                 SHADER_UNIFORM_VEC3);
+  SetShaderValue(shader, GetShaderLocation(shader, "boundsSize"), &size,
+                 SHADER_UNIFORM_VEC3);
+}
+#define COMPACT_ONCE
+#endif
@@ -0,0 +1,84 @@
+#ifndef CONTEXT_ONCE
+#include "arena.h"
+#include "bvh.h"
+#include "compact.h"
+#include "main.h"
+#include "raygen.h"
+#include "snap.h"
+#include <string>
+#include <vector>
+
+// Everything one picking session owns: its database handle, the loaded
+// model with its picking structures, the current camera and the picks seen
+// through it. Load, pick, attach and write functions take the context they
+// work on, so independent contexts can run side by side on different threads.
+// The viewer in main.cpp is one client; the GL fields stay unused in batch
+// contexts that never call LoadSTLFromDB or UploadModel.
+typedef struct PickerContext {
+  const char *db_path = DEFAULT_DB_PATH;
+  sqlite3 *db = NULL;
+  int selected_stl_id = 1;
+  std::string stl_hash; // stls.hash of the loaded model
+  int writes = 0;       // times this context wrote to the database
+
+  Camera3D camera = {0};
+  int cameraattachment = 0;
+  int cameraid = 1;
+  bool camdirty = false; // camera moved since it was loaded or inserted
+  std::vector<int> new_cams; // cams rows InsertCam added
+  RayGen raygen = {0};   // for camera, rebuilt by ViewRays when it moves
+
+  // the model: every CPU-side array below, the mesh included, lives in arena
+  // and the GL buffers are gpu, so dropping a model is one release of each
+  ModelArena arena = {0};
+  ModelArena spare = {0}; // the previous model's memory, for LoadSTLFromDB
+  ModelGpu gpu = {0};
+  Model stl_model = {0};
+  Bvh bvh = {0};         // of stl_model.meshes[0]
+  int *tri_adj = NULL;   // triangle adjacency of stl_model.meshes[0]
+  int *tri_order = NULL; // triangle t is triangle tri_order[t] of stls.data
+  SnapIndex snap = {0};  // vertices and feature edges of stl_model.meshes[0]
+
+  int picksid[MAX_PTS];
+  int picks2cam[MAX_PTS];
+  Vector2 picks2[MAX_PTS];
+  Vector3 picks[MAX_PTS];
+  int npicks = 0;
+
+  // hover preview: last frame's hit
+  int hover_tri = -1;
+  Camera3D hover_camera = {0}; // camera of that hit
+  RayCollision hover_hit = {0};
+  int hover_steps = 0;
+  double hover_seconds = 0;
+  int snap_kind = SNAP_NONE; // where the hover snaps to while snapping
+  Vector3 snap_point = {0};
+} PickerContext;
+
+// forget the model's CPU side, keeping the arena's memory for the next one.
+// The shared material stays with stl_model.
+inline void ResetModel(PickerContext *ctx) {
+  ArenaReset(&ctx->arena);
+  ctx->stl_model.meshCount = 0;
+  ctx->stl_model.meshes = NULL;
+  ctx->stl_model.meshMaterial = NULL;
+  ctx->bvh = (Bvh){0};
+  ctx->tri_adj = NULL;
+  ctx->tri_order = NULL;
+  ctx->snap = (SnapIndex){0};
+  ctx->hover_tri = -1;
+}
+
+// free the CPU side of the model and picking structures and close the
+// database. GL buffers belong to the window: UnloadModelGpu(&ctx->gpu)
+// before closing it.
+inline void UnloadPickerContext(PickerContext *ctx) {
+  sqlite3_close(ctx->db);
+  ctx->db = NULL;
+  ResetModel(ctx);
+  ArenaRelease(&ctx->arena);
+  ArenaRelease(&ctx->spare);
+  ctx->stl_model = (Model){0};
+}
+#define CONTEXT_ONCE
+#endif
@@ -0,0 +1,154 @@
+#ifndef DRIFT_ONCE
+#include "bvh.h"
+#include "geometry.h"
+#include "initdb.h"
+#include "main.h"
+#include "replay.h"
+#include <thread>
+#include <vector>
+
+// `waterfall-picker drift <database_path> <from_stl> <to_stl>` replays the
+// picks of one revision onto another and reports which of them moved
+// suspiciously, so only those cameras need a second look.
+
+typedef struct DriftPick {
+  ReplayPick r;      // r.point is the replayed pick on the new mesh
+  float replay_dist; // |replayed - old|, INFINITY when the ray missed
+  float surface_dist; // old point to the closest point on the new mesh
+  float normal_angle; // degrees between old and new face normals
+  bool flagged;
+} DriftPick;
+
+typedef struct DriftOptions {
+  float max_dist;  // flag picks that moved further than this
+  float max_angle; // or whose surface turned by more degrees than this
+} DriftOptions;
+
+inline Vector3 TriangleNormal(const Mesh &mesh, int t) {
+  Vector3 p[3];
+  MeshTriangle(mesh, t, p);
+  return Vector3Normalize(Vector3CrossProduct(p[1] - p[0], p[2] - p[0]));
+}
+
+inline void MeasureDrift(const Camera3D &cam, const Mesh &from_mesh,
+                         const Bvh &from_bvh, const Mesh &to_mesh,
+                         const Bvh &to_bvh, DriftOptions opt, DriftPick *d) {
+  Ray ray = GetScreenToWorldRayEx(d->r.m, cam, SCREEN_WIDTH, SCREEN_HEIGHT);
+  RayCollision hit = GetRayCollisionBvh(ray, to_mesh, to_bvh, &d->r.tri);
+  d->r.hit = hit.hit;
+  d->r.point = hit.point;
+
+  int near_tri, old_tri;
+  Vector3 near = ClosestPointBvh(d->r.old, to_mesh, to_bvh, &near_tri);
+  ClosestPointBvh(d->r.old, from_mesh, from_bvh, &old_tri);
+  d->surface_dist = Vector3Distance(near, d->r.old);
+
+  if (hit.hit) {
+    d->replay_dist = Vector3Distance(hit.point, d->r.old);
+    d->normal_angle =
+        old_tri < 0 ? 0
+                    : RAD2DEG * Vector3Angle(TriangleNormal(from_mesh, old_tri),
+                                             TriangleNormal(to_mesh, d->r.tri));
+  } else {
+    d->replay_dist = INFINITY;
+    d->normal_angle = 0;
+  }
+  d->flagged = !hit.hit || d->replay_dist > opt.max_dist ||
+               d->normal_angle > opt.max_angle;
+}
+
+inline bool ReportDrift(sqlite3 *db, int from_stl, int to_stl,
+                        DriftOptions opt) {
+  Mesh from_mesh, to_mesh;
+  if (!ReadSTLFromDB(db, from_stl, &from_mesh))
+    return false;
+  if (!ReadSTLFromDB(db, to_stl, &to_mesh)) {
+    free(from_mesh.vertices);
+    free(from_mesh.normals);
+    return false;
+  }
+  Bvh from_bvh = BuildBvh(from_mesh), to_bvh = BuildBvh(to_mesh);
+
+  ReplayPick *r = NULL;
+  int n = LoadReplayPicks(db, from_stl, &r);
+  std::vector<DriftPick> picks(n > 0 ? n : 0);
+  std::vector<int> cam_ids;
+  std::vector<Camera3D> cams;
+  bool ok = n >= 0;
+  for (int i = 0; ok && i < n; i++) {
+    picks[i] = (DriftPick){.r = r[i]};
+    if (cam_ids.empty() || cam_ids.back() != r[i].cam) {
+      Camera3D cam;
+      ok = ReadCamera(db, r[i].cam, &cam, NULL, NULL);
+      cam_ids.push_back(r[i].cam);
+      cams.push_back(cam);
+    }
+  }
+  free(r);
+
+  if (ok) {
+    // picks are ordered by camera, so each worker takes a contiguous slice
+    // and finds its camera by walking cam_ids alongside
+    int nthreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> workers;
+    for (int w = 0; w < nthreads; w++)
+      workers.emplace_back([&, w] {
+        int begin = n * w / nthreads, end = n * (w + 1) / nthreads, c = 0;
+        for (int i = begin; i < end; i++) {
+          while (cam_ids[c] != picks[i].r.cam)
+            c++;
+          MeasureDrift(cams[c], from_mesh, from_bvh, to_mesh, to_bvh, opt,
+                       &picks[i]);
+        }
+      });
+    for (auto &t : workers)
+      t.join();
+
+    printf("drift of stl %d picks replayed onto stl %d (flag > %g mm or > %g "
+           "deg)\n",
+           from_stl, to_stl, opt.max_dist, opt.max_angle);
+    printf("%6s %6s %6s %8s %10s %10s %10s %9s\n", "cam", "picks", "hits",
+           "flagged", "mean mm", "max mm", "surf mm", "max deg");
+    for (size_t c = 0, i = 0; c < cam_ids.size(); c++) {
+      int np = 0, nhit = 0, nflag = 0;
+      double sum = 0, max = 0, surf = 0, angle = 0;
+      for (; i < picks.size() && picks[i].r.cam == cam_ids[c]; i++, np++) {
+        const DriftPick &d = picks[i];
+        nflag += d.flagged;
+        surf = fmax(surf, d.surface_dist);
+        if (!d.r.hit)
+          continue;
+        nhit++;
+        sum += d.replay_dist;
+        max = fmax(max, d.replay_dist);
+        angle = fmax(angle, d.normal_angle);
+      }
+      printf("%6d %6d %6d %8d %10.3f %10.3f %10.3f %9.2f\n", cam_ids[c], np,
+             nhit, nflag, nhit ? sum / nhit : 0.0, max, surf, angle);
+    }
+
+    printf("flagged picks:\n");
+    for (const DriftPick &d : picks) {
+      if (!d.flagged)
+        continue;
+      if (d.r.hit)
+        printf("  pick %d cam %d at (%g, %g): moved %.3f mm, surface %.3f mm, "
+               "normal %.2f deg\n",
+               d.r.pick, d.r.cam, d.r.m.x, d.r.m.y, d.replay_dist,
+               d.surface_dist, d.normal_angle);
+      else
+        printf("  pick %d cam %d at (%g, %g): ray misses, surface %.3f mm\n",
+               d.r.pick, d.r.cam, d.r.m.x, d.r.m.y, d.surface_dist);
+    }
+  }
+
+  UnloadBvh(from_bvh);
+  UnloadBvh(to_bvh);
+  free(from_mesh.vertices);
+  free(from_mesh.normals);
+  free(to_mesh.vertices);
+  free(to_mesh.normals);
+  return ok;
+}
+#define DRIFT_ONCE
+#endif
@@ -0,0 +1,312 @@
+// waterfall-picker-gendb: synthetic databases of configurable scale, in the
+// schema the quasiquoter writes, for benchmarks and scaling tests.
+//
+//   waterfall-picker-gendb out.sqlite3 [--models 3] [--triangles 100000]
+//       [--cams 20] [--picks 10] [--revisions 2] [--seed 1]
+//
+// Models cycle through a sphere, a gear and a noisy height field scan. Each
+// gets --revisions smoothly perturbed copies (welded vertices stay welded),
+// recorded in stldescs as module "<shape><i>" with desc "rev <k>", and
+// --cams cameras looking at revision 0 with up to --picks picks each, placed
+// by casting random screen points onto the mesh.
+#include "bvh.h"
+#include "main.h"
+#include <random>
+#include <vector>
+
+typedef struct GenOptions {
+  int models, triangles, cams, picks, revisions, seed;
+} GenOptions;
+
+static void AddTriangle(std::vector<Vector3> &tris, Vector3 a, Vector3 b,
+                        Vector3 c) {
+  tris.push_back(a);
+  tris.push_back(b);
+  tris.push_back(c);
+}
+
+static void GenSphere(std::vector<Vector3> &tris, int triangles) {
+  int stacks = std::max(3, (int)sqrtf(triangles / 4.f));
+  int slices = 2 * stacks;
+  float r = 20;
+  auto at = [&](int i, int j) {
+    float th = PI * i / stacks, ph = 2 * PI * (j % slices) / slices;
+    return (Vector3){r * sinf(th) * cosf(ph), r * sinf(th) * sinf(ph),
+                     r * cosf(th)};
+  };
+  for (int i = 0; i < stacks; i++)
+    for (int j = 0; j < slices; j++) {
+      if (i > 0)
+        AddTriangle(tris, at(i, j), at(i + 1, j), at(i, j + 1));
+      if (i < stacks - 1)
+        AddTriangle(tris, at(i, j + 1), at(i + 1, j), at(i + 1, j + 1));
+    }
+}
+
+// extruded 24 tooth profile, side walls split into layers to reach the size
+static void GenGear(std::vector<Vector3> &tris, int triangles) {
+  const int teeth = 24, per_tooth = 8, n = teeth * per_tooth;
+  int layers = std::max(1, (triangles - 2 * n) / (2 * n));
+  float height = 10;
+  std::vector<Vector2> profile(n);
+  for (int k = 0; k < n; k++) {
+    int phase = k % per_tooth;
+    float r = phase >= 2 && phase < 6 ? 30 : 26;
+    float a = 2 * PI * k / n;
+    profile[k] = (Vector2){r * cosf(a), r * sinf(a)};
+  }
+  auto at = [&](int k, int layer) {
+    Vector2 p = profile[k % n];
+    return (Vector3){p.x, p.y, height * layer / layers};
+  };
+  Vector3 bottom = {0, 0, 0}, top = {0, 0, height};
+  for (int k = 0; k < n; k++) {
+    AddTriangle(tris, bottom, at(k + 1, 0), at(k, 0));
+    AddTriangle(tris, top, at(k, layers), at(k + 1, layers));
+    for (int l = 0; l < layers; l++) {
+      AddTriangle(tris, at(k, l), at(k + 1, l), at(k + 1, l + 1));
+      AddTriangle(tris, at(k, l), at(k + 1, l + 1), at(k, l + 1));
+    }
+  }
+}
+
+// open height field with a few octaves of sine noise, like a surface scan
+static void GenScan(std::vector<Vector3> &tris, int triangles,
+                    std::mt19937 &rng) {
+  int n = std::max(2, (int)sqrtf(triangles / 2.f));
+  float size = 60, ph[6];
+  std::uniform_real_distribution<float> phase(0, 2 * PI);
+  for (float &p : ph)
+    p = phase(rng);
+  auto at = [&](int i, int j) {
+    float x = size * i / n - size / 2, y = size * j / n - size / 2;
+    float z = 3 * sinf(0.15f * x + ph[0]) * cosf(0.12f * y + ph[1]) +
+              0.8f * sinf(0.7f * x + ph[2]) * sinf(0.9f * y + ph[3]) +
+              0.15f * sinf(4.1f * x + ph[4]) * cosf(3.7f * y + ph[5]);
+    return (Vector3){x, y, z};
+  };
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++) {
+      AddTriangle(tris, at(i, j), at(i + 1, j), at(i + 1, j + 1));
+      AddTriangle(tris, at(i, j), at(i + 1, j + 1), at(i, j + 1));
+    }
+}
+
+// a function of position only, so vertices shared by triangles move together
+static void Perturb(std::vector<Vector3> &tris, int rev) {
+  float amp = 0.05f * rev, f = 0.3f + 0.1f * rev;
+  for (Vector3 &p : tris)
+    p = p + (Vector3){amp * sinf(f * p.y + rev), amp * sinf(f * p.z + 2 * rev),
+                      amp * sinf(f * p.x + 3 * rev)};
+}
+
+static std::vector<char> EncodeSTL(const std::vector<Vector3> &tris) {
+  uint32_t count = tris.size() / 3;
+  std::vector<char> blob(84 + 50 * (size_t)count, 0);
+  memcpy(blob.data() + 80, &count, 4);
+  for (uint32_t t = 0; t < count; t++) {
+    char *rec = blob.data() + 84 + 50 * (size_t)t;
+    const Vector3 *p = &tris[3 * t];
+    Vector3 n = Vector3Normalize(Vector3CrossProduct(p[1] - p[0], p[2] - p[0]));
+    memcpy(rec, &n, 12);
+    memcpy(rec + 12, p, 36);
+  }
+  return blob;
+}
+
+static uint64_t Fnv1a(const std::vector<char> &data) {
+  uint64_t h = 1469598103934665603ull;
+  for (char c : data)
+    h = (h ^ (unsigned char)c) * 1099511628211ull;
+  return h;
+}
+
+static bool Exec(sqlite3 *db, const char *sql) {
+  char *err = NULL;
+  if (sqlite3_exec(db, sql, NULL, NULL, &err) != SQLITE_OK) {
+    printf("SQL error: %s\n", err);
+    sqlite3_free(err);
+    return false;
+  }
+  return true;
+}
+
+static int InsertSTL(sqlite3 *db, const std::vector<Vector3> &tris,
+                     const char *module, int rev) {
+  std::vector<char> blob = EncodeSTL(tris);
+  char hash[17];
+  snprintf(hash, sizeof hash, "%016llx", (unsigned long long)Fnv1a(blob));
+
+  sqlite3_stmt *stmt;
+  sqlite3_prepare_v2(db, "INSERT INTO stls (data, hash) VALUES (?, ?);", -1,
+                     &stmt, NULL);
+  sqlite3_bind_blob(stmt, 1, blob.data(), blob.size(), SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 2, hash, -1, SQLITE_STATIC);
+  bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+  sqlite3_finalize(stmt);
+  if (!ok)
+    return -1;
+  int stl = (int)sqlite3_last_insert_rowid(db);
+
+  char desc[32];
+  snprintf(desc, sizeof desc, "rev %d", rev);
+  sqlite3_prepare_v2(
+      db, "INSERT INTO stldescs (stl, module, desc) VALUES (?, ?, ?);", -1,
+      &stmt, NULL);
+  sqlite3_bind_int(stmt, 1, stl);
+  sqlite3_bind_text(stmt, 2, module, -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 3, desc, -1, SQLITE_STATIC);
+  ok = sqlite3_step(stmt) == SQLITE_DONE;
+  sqlite3_finalize(stmt);
+  return ok ? stl : -1;
+}
+
+static bool InsertCamsAndPicks(sqlite3 *db, int stl,
+                               const std::vector<Vector3> &tris,
+                               GenOptions opt, std::mt19937 &rng) {
+  Mesh mesh = {0};
+  mesh.triangleCount = tris.size() / 3;
+  mesh.vertexCount = tris.size();
+  mesh.vertices = (float *)tris.data();
+  Bvh bvh = BuildBvh(mesh);
+  BoundingBox box = bvh.nodes[0].box;
+  Vector3 center = (box.min + box.max) * 0.5f;
+  float radius = Vector3Distance(box.max, box.min) / 2;
+
+  sqlite3_stmt *cam_stmt, *pick_stmt;
+  sqlite3_prepare_v2(
+      db,
+      "INSERT INTO cams (stl, posx, posy, posz, tx, ty, tz, upx, upy, upz, "
+      "fovy, proj, attachment) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, 45, 0, 0);",
+      -1, &cam_stmt, NULL);
+  sqlite3_prepare_v2(
+      db, "INSERT INTO picks (cam, mx, my, x, y, z) VALUES (?, ?, ?, ?, ?, ?);",
+      -1, &pick_stmt, NULL);
+
+  std::normal_distribution<float> gauss;
+  std::uniform_real_distribution<float> sx(0.3f * SCREEN_WIDTH,
+                                           0.7f * SCREEN_WIDTH),
+      sy(0.3f * SCREEN_HEIGHT, 0.7f * SCREEN_HEIGHT);
+  bool ok = true;
+  for (int c = 0; ok && c < opt.cams; c++) {
+    Vector3 dir = Vector3Normalize((Vector3){gauss(rng), gauss(rng), gauss(rng)});
+    Camera3D cam = {.position = center + dir * (2.5f * radius),
+                    .target = center,
+                    .up = fabsf(dir.z) > 0.9f ? (Vector3){0, 1, 0}
+                                              : (Vector3){0, 0, 1},
+                    .fovy = 45,
+                    .projection = CAMERA_PERSPECTIVE};
+    sqlite3_reset(cam_stmt);
+    sqlite3_bind_int(cam_stmt, 1, stl);
+    for (int k = 0; k < 3; k++) {
+      sqlite3_bind_double(cam_stmt, 2 + k, (&cam.position.x)[k]);
+      sqlite3_bind_double(cam_stmt, 5 + k, (&cam.target.x)[k]);
+      sqlite3_bind_double(cam_stmt, 8 + k, (&cam.up.x)[k]);
+    }
+    ok = sqlite3_step(cam_stmt) == SQLITE_DONE;
+    int cam_id = (int)sqlite3_last_insert_rowid(db);
+
+    for (int p = 0, tries = 0; ok && p < opt.picks && tries < 4 * opt.picks;
+         tries++) {
+      Vector2 m = {roundf(sx(rng)), roundf(sy(rng))};
+      Ray ray = GetScreenToWorldRayEx(m, cam, SCREEN_WIDTH, SCREEN_HEIGHT);
+      int tri;
+      RayCollision hit = GetRayCollisionBvh(ray, mesh, bvh, &tri);
+      if (!hit.hit)
+        continue;
+      sqlite3_reset(pick_stmt);
+      sqlite3_bind_int(pick_stmt, 1, cam_id);
+      sqlite3_bind_double(pick_stmt, 2, m.x);
+      sqlite3_bind_double(pick_stmt, 3, m.y);
+      sqlite3_bind_double(pick_stmt, 4, hit.point.x);
+      sqlite3_bind_double(pick_stmt, 5, hit.point.y);
+      sqlite3_bind_double(pick_stmt, 6, hit.point.z);
+      ok = sqlite3_step(pick_stmt) == SQLITE_DONE;
+      p++;
+    }
+  }
+  sqlite3_finalize(cam_stmt);
+  sqlite3_finalize(pick_stmt);
+  UnloadBvh(bvh);
+  return ok;
+}
+
+int main(int argc, char *argv[]) {
+  GenOptions opt = {.models = 3,
+                    .triangles = 100000,
+                    .cams = 20,
+                    .picks = 10,
+                    .revisions = 2,
+                    .seed = 1};
+  if (argc < 2) {
+    printf("Usage: %s <out.sqlite3> [--models N] [--triangles N] [--cams N] "
+           "[--picks N] [--revisions N] [--seed N]\n",
+           argv[0]);
+    return 1;
+  }
+  for (int i = 2; i + 1 < argc; i += 2) {
+    int v = atoi(argv[i + 1]);
+    if (strcmp(argv[i], "--models") == 0)
+      opt.models = v;
+    else if (strcmp(argv[i], "--triangles") == 0)
+      opt.triangles = v;
+    else if (strcmp(argv[i], "--cams") == 0)
+      opt.cams = v;
+    else if (strcmp(argv[i], "--picks") == 0)
+      opt.picks = v;
+    else if (strcmp(argv[i], "--revisions") == 0)
+      opt.revisions = v;
+    else if (strcmp(argv[i], "--seed") == 0)
+      opt.seed = v;
+    else {
+      printf("Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  unlink(argv[1]);
+  sqlite3 *db;
+  if (sqlite3_open(argv[1], &db) != SQLITE_OK) {
+    printf("Cannot open database: %s\n", sqlite3_errmsg(db));
+    return 1;
+  }
+  bool ok =
+      Exec(db, "CREATE TABLE stldescs (stl INT NOT NULL REFERENCES "
+               "stls(rowid), module TEXT NOT NULL, desc TEXT NOT NULL);"
+               "CREATE TABLE stls (data BLOB NOT NULL, hash TEXT NOT NULL);"
+               "CREATE TABLE cams (stl INT NOT NULL REFERENCES stls(rowid) , "
+               "posx REAL, posy REAL, posz REAL, tx REAL, ty REAL, tz REAL, "
+               "upx REAL, upy REAL, upz REAL, fovy REAL, proj INT, attachment "
+               "INT);"
+               "CREATE TABLE picks (cam INT NOT NULL REFERENCES cams(rowid), "
+               "mx REAL, my REAL, x REAL, y REAL, z REAL);"
+               "CREATE INDEX picks_cam ON picks(cam);") &&
+      Exec(db, "BEGIN;");
+
+  std::mt19937 rng(opt.seed);
+  const char *shapes[] = {"sphere", "gear", "scan"};
+  for (int m = 0; ok && m < opt.models; m++) {
+    std::vector<Vector3> base;
+    if (m % 3 == 0)
+      GenSphere(base, opt.triangles);
+    else if (m % 3 == 1)
+      GenGear(base, opt.triangles);
+    else
+      GenScan(base, opt.triangles, rng);
+
+    char module[32];
+    snprintf(module, sizeof module, "%s%d", shapes[m % 3], m);
+    int stl = InsertSTL(db, base, module, 0);
+    ok = stl > 0 && InsertCamsAndPicks(db, stl, base, opt, rng);
+    for (int r = 1; ok && r <= opt.revisions; r++) {
+      std::vector<Vector3> rev = base;
+      Perturb(rev, r);
+      ok = InsertSTL(db, rev, module, r) > 0;
+    }
+    printf("%s: %zu triangles, %d revisions\n", module, base.size() / 3,
+           opt.revisions);
+  }
+  ok = ok && Exec(db, "COMMIT;");
+  sqlite3_close(db);
+  return ok ? 0 : 1;
+}
@@ -1,4 +1,8 @@
+#ifndef GEOMETRY_ONCE
 #include "main.h"
+#include <algorithm>
+#include <random>
+#include <vector>
 
 // Plucker coordinate
 inline float RayVector3Distance(Ray r, Vector3 x) {
@@ -16,9 +20,7 @@ inline RayCollision GetRayCollisionPlane(Ray ray, Vector3 *p, int np) {
     Vector3 n = Vector3CrossProduct(p[2] - p[0], p[1] - p[0]);
 
     float den = Vector3DotProduct(n, ray.direction);
-    float t = (Vector3DotProduct(ray.direction, p[0]) -
-               Vector3DotProduct(n, ray.position)) /
-              den;
+    float t = Vector3DotProduct(n, p[0] - ray.position) / den;
 
     return (RayCollision){.hit = den != 0,
                           .distance = t,
@@ -96,3 +98,206 @@ inline void AdvanceSeg(Vector3 eye, Vector3 ab[2], Vector3 x) {
     ab[1] = x;
   }
 }
+
+// a.w >= b for the plane LP below
+typedef struct LpRow {
+  double a[3];
+  double b;
+} LpRow;
+
+#define LP_EPS 1e-9
+
+// minimize c.u over u in R^2 subject to rows[i].a.u >= rows[i].b (a[2]
+// unused), starting from the corner of the box |u_j| <= bound. Seidel's
+// incremental algorithm: a violated row moves the optimum onto its line,
+// where the earlier rows cut an interval.
+inline bool SolveLp2(const LpRow *rows, int n, const double c[2], double bound,
+                     double u[2]) {
+  u[0] = c[0] > 0 ? -bound : bound;
+  u[1] = c[1] > 0 ? -bound : bound;
+  for (int i = 0; i < n; i++) {
+    const double *a = rows[i].a;
+    if (a[0] * u[0] + a[1] * u[1] >= rows[i].b - LP_EPS)
+      continue;
+    double aa = a[0] * a[0] + a[1] * a[1];
+    if (aa == 0)
+      return false; // 0 >= b > 0
+    double p[2] = {a[0] * rows[i].b / aa, a[1] * rows[i].b / aa};
+    double d[2] = {-a[1], a[0]};
+    double lo = -INFINITY, hi = INFINITY;
+    for (int j = 0; j < 2; j++) // the box
+      if (d[j] != 0) {
+        double t0 = (-bound - p[j]) / d[j], t1 = (bound - p[j]) / d[j];
+        lo = fmax(lo, fmin(t0, t1));
+        hi = fmin(hi, fmax(t0, t1));
+      }
+    for (int k = 0; k < i; k++) {
+      double alpha = rows[k].a[0] * d[0] + rows[k].a[1] * d[1];
+      double beta = rows[k].b - rows[k].a[0] * p[0] - rows[k].a[1] * p[1];
+      if (fabs(alpha) < LP_EPS) {
+        if (beta > LP_EPS)
+          return false;
+      } else if (alpha > 0) {
+        lo = fmax(lo, beta / alpha);
+      } else {
+        hi = fmin(hi, beta / alpha);
+      }
+    }
+    if (lo > hi + LP_EPS)
+      return false;
+    double t = c[0] * d[0] + c[1] * d[1] > 0 ? lo : hi;
+    u[0] = p[0] + t * d[0];
+    u[1] = p[1] + t * d[1];
+  }
+  return true;
+}
+
+// the same in R^3: a violated row restricts the problem to its plane, a 2D LP
+// over the earlier rows and the box. Rows are shuffled, so expected O(n).
+inline bool SolveLp3(std::vector<LpRow> rows, const double c[3], double bound,
+                     double w[3]) {
+  std::minstd_rand rng(rows.size());
+  std::shuffle(rows.begin(), rows.end(), rng);
+  for (int j = 0; j < 3; j++)
+    w[j] = c[j] > 0 ? -bound : bound;
+
+  std::vector<LpRow> rows2;
+  for (size_t i = 0; i < rows.size(); i++) {
+    const double *a = rows[i].a;
+    if (a[0] * w[0] + a[1] * w[1] + a[2] * w[2] >= rows[i].b - LP_EPS)
+      continue;
+    double aa = a[0] * a[0] + a[1] * a[1] + a[2] * a[2];
+    if (aa == 0)
+      return false;
+    // the plane a.w = b as p + u e1 + v e2
+    double p[3], e1[3], e2[3];
+    for (int j = 0; j < 3; j++)
+      p[j] = a[j] * rows[i].b / aa;
+    int m = fabs(a[0]) < fabs(a[1]) ? (fabs(a[0]) < fabs(a[2]) ? 0 : 2)
+                                    : (fabs(a[1]) < fabs(a[2]) ? 1 : 2);
+    double axis[3] = {0, 0, 0};
+    axis[m] = 1;
+    e1[0] = a[1] * axis[2] - a[2] * axis[1];
+    e1[1] = a[2] * axis[0] - a[0] * axis[2];
+    e1[2] = a[0] * axis[1] - a[1] * axis[0];
+    double l1 = sqrt(e1[0] * e1[0] + e1[1] * e1[1] + e1[2] * e1[2]);
+    for (int j = 0; j < 3; j++)
+      e1[j] /= l1;
+    e2[0] = (a[1] * e1[2] - a[2] * e1[1]) / sqrt(aa);
+    e2[1] = (a[2] * e1[0] - a[0] * e1[2]) / sqrt(aa);
+    e2[2] = (a[0] * e1[1] - a[1] * e1[0]) / sqrt(aa);
+
+    auto project = [&](const double *ak, double bk) {
+      LpRow r = {{ak[0] * e1[0] + ak[1] * e1[1] + ak[2] * e1[2],
+                  ak[0] * e2[0] + ak[1] * e2[1] + ak[2] * e2[2], 0},
+                 bk - (ak[0] * p[0] + ak[1] * p[1] + ak[2] * p[2])};
+      rows2.push_back(r);
+    };
+    rows2.clear();
+    for (int j = 0; j < 3; j++)
+      for (double s : {1.0, -1.0}) {
+        double unit[3] = {0, 0, 0};
+        unit[j] = s;
+        project(unit, -bound); // s w_j >= -bound
+      }
+    for (size_t k = 0; k < i; k++)
+      project(rows[k].a, rows[k].b);
+
+    double c2[2] = {c[0] * e1[0] + c[1] * e1[1] + c[2] * e1[2],
+                    c[0] * e2[0] + c[1] * e2[1] + c[2] * e2[2]};
+    double plen = sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+    double u[2];
+    if (!SolveLp2(rows2.data(), (int)rows2.size(), c2,
+                  2 * bound + plen, u))
+      return false;
+    for (int j = 0; j < 3; j++)
+      w[j] = p[j] + u[0] * e1[j] + u[1] * e2[j];
+  }
+  return true;
+}
+
+// Closed form alternative to feeding hits to AdvancePlane one at a time: the
+// plane that faces eye and touches, but is not penetrated by, the hits x. It
+// is the support plane of their convex hull where the mean viewing direction
+// c leaves it, found as the LP
+//
+//   minimize c.w  subject to  w.(x_i - eye) >= 1
+//
+// with the plane w.(x - eye) = 1. Returned as three points like the boundary
+// AdvancePlane works on; false for fewer than 3 hits or a degenerate set.
+inline bool SupportPlane(Vector3 eye, const Vector3 *x, int n, Vector3 p[3]) {
+  if (n < 3)
+    return false;
+  double scale = 0, c[3] = {0, 0, 0};
+  for (int i = 0; i < n; i++) {
+    float len = Vector3Distance(x[i], eye);
+    if (len == 0)
+      return false;
+    Vector3 d = (x[i] - eye) / len;
+    c[0] += d.x;
+    c[1] += d.y;
+    c[2] += d.z;
+    scale = fmax(scale, len);
+  }
+  // rows in units of the farthest hit, so |w| is near 1
+  std::vector<LpRow> rows(n);
+  for (int i = 0; i < n; i++)
+    rows[i] = (LpRow){{(x[i].x - eye.x) / scale, (x[i].y - eye.y) / scale,
+                       (x[i].z - eye.z) / scale},
+                      1};
+  double w[3];
+  if (!SolveLp3(rows, c, 1e6, w))
+    return false;
+
+  Vector3 normal = {(float)(w[0] / scale), (float)(w[1] / scale),
+                    (float)(w[2] / scale)};
+  float nn = Vector3LengthSqr(normal);
+  if (!(nn > 0))
+    return false;
+  Vector3 foot = eye + normal / nn; // closest point of the plane to eye
+  Vector3 axis = fabsf(normal.x) < fabsf(normal.y) ? (Vector3){1, 0, 0}
+                                                   : (Vector3){0, 1, 0};
+  Vector3 u1 = Vector3Normalize(Vector3CrossProduct(normal, axis));
+  Vector3 u2 = Vector3Normalize(Vector3CrossProduct(normal, u1));
+  float len = 1 / sqrtf(nn);
+  p[0] = foot;
+  p[1] = foot + u1 * len;
+  p[2] = foot + u2 * len;
+  return true;
+}
+
+// closest point to p on triangle abc, by Voronoi region of the vertices and
+// edges (Ericson, Real-Time Collision Detection, 5.1.5)
+inline Vector3 ClosestPointTriangle(Vector3 p, Vector3 a, Vector3 b, Vector3 c) {
+  Vector3 ab = b - a, ac = c - a, ap = p - a;
+  float d1 = Vector3DotProduct(ab, ap), d2 = Vector3DotProduct(ac, ap);
+  if (d1 <= 0 && d2 <= 0)
+    return a;
+
+  Vector3 bp = p - b;
+  float d3 = Vector3DotProduct(ab, bp), d4 = Vector3DotProduct(ac, bp);
+  if (d3 >= 0 && d4 <= d3)
+    return b;
+
+  float vc = d1 * d4 - d3 * d2;
+  if (vc <= 0 && d1 >= 0 && d3 <= 0)
+    return a + ab * (d1 / (d1 - d3));
+
+  Vector3 cp = p - c;
+  float d5 = Vector3DotProduct(ab, cp), d6 = Vector3DotProduct(ac, cp);
+  if (d6 >= 0 && d5 <= d6)
+    return c;
+
+  float vb = d5 * d2 - d1 * d6;
+  if (vb <= 0 && d2 >= 0 && d6 <= 0)
+    return a + ac * (d2 / (d2 - d6));
+
+  float va = d3 * d6 - d5 * d4;
+  if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0)
+    return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+  float denom = 1 / (va + vb + vc);
+  return a + ab * (vb * denom) + ac * (vc * denom);
+}
+#define GEOMETRY_ONCE
+#endif
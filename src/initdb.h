@@ -1,15 +1,88 @@
+#ifndef INITDB_ONCE
+#include "adjacency.h"
+#include "arena.h"
+#include "bvh.h"
+#include "compact.h"
+#include "context.h"
 #include "main.h"
+#include "reorder.h"
+#include "startup.h"
+#include <string>
 
-inline bool InitDatabase(const char *db_path) {
-  int rc = sqlite3_open(db_path, &db);
+inline bool InitDatabase(const char *db_path, sqlite3 **db) {
+  int rc = sqlite3_open(db_path, db);
   if (rc != SQLITE_OK) {
-    printf("Cannot open database: %s\n", sqlite3_errmsg(db));
+    printf("Cannot open database: %s\n", sqlite3_errmsg(*db));
     return false;
   }
   return true;
 }
 
-inline bool LoadSTLFromDB(int stl_id) {
+// Parse a binary STL into a CPU-side mesh: vertices and the face normal
+// repeated per vertex. No GL calls, so the daemon can use it without a window.
+// The arrays come from arena when given, malloc otherwise.
+inline bool ParseSTL(const void *data, int data_size, Mesh *mesh,
+                     ModelArena *arena = NULL) {
+  // STL header is 80 bytes
+  if (data_size <= 84)
+    return false;
+
+  const char *stl_data = (const char *)data;
+  uint32_t triangle_count = *(uint32_t *)(stl_data + 80);
+
+  if (triangle_count > MAX_TRIANGLES)
+    triangle_count = MAX_TRIANGLES;
+  if (triangle_count > (uint32_t)(data_size - 84) / 50)
+    triangle_count = (data_size - 84) / 50;
+
+  *mesh = (Mesh){0};
+  mesh->triangleCount = triangle_count;
+  mesh->vertexCount = triangle_count * 3;
+  mesh->vertices =
+      (float *)ModelAlloc(arena, mesh->vertexCount * 3 * sizeof(float));
+  mesh->normals =
+      (float *)ModelAlloc(arena, mesh->vertexCount * 3 * sizeof(float));
+
+  const char *triangle_data = stl_data + 84;
+  for (int i = 0; i < (int)triangle_count; i++) {
+    // Normal vector (12 bytes)
+    float nx = *(float *)(triangle_data + i * 50);
+    float ny = *(float *)(triangle_data + i * 50 + 4);
+    float nz = *(float *)(triangle_data + i * 50 + 8);
+
+    // Vertices (36 bytes)
+    for (int j = 0; j < 3; j++) {
+      int vertex_idx = i * 3 + j;
+      mesh->vertices[vertex_idx * 3] =
+          *(float *)(triangle_data + i * 50 + 12 + j * 12);
+      mesh->vertices[vertex_idx * 3 + 1] =
+          *(float *)(triangle_data + i * 50 + 16 + j * 12);
+      mesh->vertices[vertex_idx * 3 + 2] =
+          *(float *)(triangle_data + i * 50 + 20 + j * 12);
+
+      mesh->normals[vertex_idx * 3] = nx;
+      mesh->normals[vertex_idx * 3 + 1] = ny;
+      mesh->normals[vertex_idx * 3 + 2] = nz;
+    }
+  }
+  return true;
+}
+
+// what a model of n triangles takes in its arena: mesh, permutation,
+// adjacency, BVH and a typical snap index. The builders' scratch is rewound
+// before the next array, so it fits in the room the later arrays take. A part
+// that needs more chains a block, and ArenaReset merges it.
+inline size_t ModelArenaBytes(size_t n) {
+  return n * (18 * sizeof(float) + 5 * sizeof(int) + 2 * sizeof(BvhNode) +
+              48) +
+         (1 << 16);
+}
+
+// the parsed STL with its triangles in Morton order (see reorder.h). When
+// tri_order is given it receives the permutation back to stls.data order.
+// With an arena everything is allocated from it, reserved up front.
+inline bool ReadSTLFromDB(sqlite3 *db, int stl_id, Mesh *mesh,
+                          int **tri_order = NULL, ModelArena *arena = NULL) {
   sqlite3_stmt *stmt;
   const char *sql = "SELECT data FROM stls WHERE rowid = ?;";
 
@@ -21,106 +94,164 @@ inline bool LoadSTLFromDB(int stl_id) {
 
   sqlite3_bind_int(stmt, 1, stl_id);
 
+  bool ok = false;
   if (sqlite3_step(stmt) == SQLITE_ROW) {
-    const void *data = sqlite3_column_blob(stmt, 0);
-    int data_size = sqlite3_column_bytes(stmt, 0);
-
-    // Parse STL data (simplified binary STL parsing)
-    if (data_size > 80) { // STL header is 80 bytes
-      const char *stl_data = (const char *)data;
-      uint32_t triangle_count = *(uint32_t *)(stl_data + 80);
-
-      if (triangle_count > MAX_TRIANGLES)
-        triangle_count = MAX_TRIANGLES;
-
-      // Create mesh from STL data
-      Mesh mesh = {0};
-      mesh.triangleCount = triangle_count;
-      mesh.vertexCount = triangle_count * 3;
-      mesh.vertices = (float *)malloc(mesh.vertexCount * 3 * sizeof(float));
-      mesh.normals = (float *)malloc(mesh.vertexCount * 3 * sizeof(float));
-
-      const char *triangle_data = stl_data + 84;
-      for (int i = 0; i < triangle_count; i++) {
-        // Normal vector (12 bytes)
-        float nx = *(float *)(triangle_data + i * 50);
-        float ny = *(float *)(triangle_data + i * 50 + 4);
-        float nz = *(float *)(triangle_data + i * 50 + 8);
-
-        // Vertices (36 bytes)
-        for (int j = 0; j < 3; j++) {
-          int vertex_idx = i * 3 + j;
-          mesh.vertices[vertex_idx * 3] =
-              *(float *)(triangle_data + i * 50 + 12 + j * 12);
-          mesh.vertices[vertex_idx * 3 + 1] =
-              *(float *)(triangle_data + i * 50 + 16 + j * 12);
-          mesh.vertices[vertex_idx * 3 + 2] =
-              *(float *)(triangle_data + i * 50 + 20 + j * 12);
-
-          mesh.normals[vertex_idx * 3] = nx;
-          mesh.normals[vertex_idx * 3 + 1] = ny;
-          mesh.normals[vertex_idx * 3 + 2] = nz;
-        }
-      }
-
-      UploadMesh(&mesh, false);
-      stl_model = LoadModelFromMesh(mesh);
-      sqlite3_finalize(stmt);
-      return true;
-    }
+    int bytes = sqlite3_column_bytes(stmt, 0);
+    if (arena)
+      ArenaReserve(arena, ModelArenaBytes(std::max(bytes - 84, 0) / 50));
+    ok = ParseSTL(sqlite3_column_blob(stmt, 0), bytes, mesh, arena);
   }
   sqlite3_finalize(stmt);
-  return false;
+  if (ok) {
+    int *order = SortTrianglesMorton(mesh, arena);
+    if (tri_order)
+      *tri_order = order;
+    else
+      ScratchFree(arena, order);
+  }
+  return ok;
 }
 
-inline bool LoadPicksFromDB(int stl_id) {
+// stls.hash of stl_id, which changes whenever the STL data is rewritten
+inline bool ReadSTLHash(sqlite3 *db, int stl_id, std::string *hash) {
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(db, "SELECT hash FROM stls WHERE rowid = ?;", -1,
+                         &stmt, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    return false;
+  }
+  sqlite3_bind_int(stmt, 1, stl_id);
+  bool ok = sqlite3_step(stmt) == SQLITE_ROW;
+  if (ok)
+    hash->assign((const char *)sqlite3_column_blob(stmt, 0),
+                 sqlite3_column_bytes(stmt, 0));
+  sqlite3_finalize(stmt);
+  return ok;
+}
+
+// adjacency for the hover walk, the BVH for clicks and the snap targets, in
+// ctx->arena next to the mesh read by ReadSTLFromDB. Runs on loader threads,
+// so it leaves the hover state, which the render thread draws, alone.
+inline void BuildPickingStructures(PickerContext *ctx, const Mesh &mesh) {
+  ctx->tri_adj = BuildTriangleAdjacency(mesh, &ctx->arena);
+  ctx->bvh = BuildBvh(mesh, &ctx->arena);
+  ctx->snap =
+      BuildSnapIndex(mesh, ctx->tri_adj, SNAP_FEATURE_ANGLE, &ctx->arena);
+}
+
+// make mesh, whose arrays live in ctx->arena and which is on the GPU as
+// ctx->gpu, ctx->stl_model. Its Mesh and material index are in the arena too
+// and it draws with the shared material, so nothing else needs freeing on a
+// swap.
+inline void SetModelMesh(PickerContext *ctx, Mesh mesh) {
+  ctx->stl_model.transform = MatrixIdentity();
+  ctx->stl_model.meshCount = 1;
+  ctx->stl_model.meshes = (Mesh *)ArenaAlloc(&ctx->arena, sizeof(Mesh));
+  ctx->stl_model.meshes[0] = mesh;
+  ctx->stl_model.materialCount = 1;
+  ctx->stl_model.meshMaterial = (int *)ModelCalloc(&ctx->arena, sizeof(int));
+}
+
+// The GL half: upload mesh in one go and make it ctx->stl_model
+inline void UploadModel(PickerContext *ctx, Mesh mesh) {
+  BoundingBox bounds = GetMeshBoundingBox(mesh);
+  ctx->gpu = UploadCompactMesh(&mesh, bounds);
+  SetShaderBounds(shader, bounds);
+  SetModelMesh(ctx, mesh);
+}
+
+// read stl_id and build its picking structures into staging, whose arena
+// receives the mesh; whatever model another context has is left alone
+inline bool StageModel(sqlite3 *db, int stl_id, PickerContext *staging,
+                       Mesh *mesh) {
+  if (!ReadSTLHash(db, stl_id, &staging->stl_hash) ||
+      !ReadSTLFromDB(db, stl_id, mesh, &staging->tri_order, &staging->arena))
+    return false;
+  BuildPickingStructures(staging, *mesh);
+  return true;
+}
+
+// hand the CPU side of the model staged in staging to ctx. ctx's old model
+// goes back with staging's arena; stl_model still points into it until the
+// caller uploads the new mesh.
+inline void SwapModel(PickerContext *ctx, PickerContext *staging) {
+  std::swap(ctx->arena, staging->arena);
+  std::swap(ctx->tri_adj, staging->tri_adj);
+  std::swap(ctx->bvh, staging->bvh);
+  std::swap(ctx->snap, staging->snap);
+  std::swap(ctx->tri_order, staging->tri_order);
+  ctx->stl_hash = staging->stl_hash;
+  ctx->hover_tri = -1;
+}
+
+// replace the loaded model. It is staged in the previous model's memory and
+// swapped in only once read, so a failed read keeps the old model on screen.
+inline bool LoadSTLFromDB(PickerContext *ctx, int stl_id) {
+  PickerContext *s = new PickerContext();
+  std::swap(s->arena, ctx->spare);
+  Mesh mesh;
+  bool ok = StageModel(ctx->db, stl_id, s, &mesh);
+  if (ok) {
+    SwapModel(ctx, s);
+    UnloadModelGpu(&ctx->gpu);
+    UploadModel(ctx, mesh);
+  }
+  ArenaReset(&s->arena);
+  std::swap(ctx->spare, s->arena);
+  UnloadPickerContext(s);
+  delete s;
+  return ok;
+}
+
+inline bool LoadPicksFromDB(PickerContext *ctx, int stl_id) {
   sqlite3_stmt *stmt;
   const char *sql = "SELECT picks.cam, picks.mx, picks.my, picks.x, picks.y, "
                     "picks.z, picks.rowid "
                     "FROM picks "
                     "INNER JOIN cams ON picks.cam = cams.rowid "
                     "WHERE cams.stl = ?;";
-  int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+  int rc = sqlite3_prepare_v2(ctx->db, sql, -1, &stmt, NULL);
   if (rc != SQLITE_OK) {
-    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    printf("SQL error: %s\n", sqlite3_errmsg(ctx->db));
     return false;
   }
 
   sqlite3_bind_int(stmt, 1, stl_id);
-  npicks = 0; // Reset the number of picks
+  ctx->npicks = 0; // Reset the number of picks
   while (sqlite3_step(stmt) == SQLITE_ROW) {
-    if (npicks >= MAX_PTS) {
+    if (ctx->npicks >= MAX_PTS) {
       printf("Error: Exceeded maximum number of picks (%d).\n", MAX_PTS);
       break;
     }
 
-    // Assign values from the database row to the static variables
-    picks2cam[npicks] = sqlite3_column_int(stmt, 0); // cam
+    // Assign values from the database row to the context
+    ctx->picks2cam[ctx->npicks] = sqlite3_column_int(stmt, 0); // cam
 
-    picks2[npicks] = (Vector2){
+    ctx->picks2[ctx->npicks] = (Vector2){
         .x = (float)sqlite3_column_double(stmt, 1), // mx
         .y = (float)sqlite3_column_double(stmt, 2)  // my
     };
 
-    picks[npicks] = (Vector3){
+    ctx->picks[ctx->npicks] = (Vector3){
         .x = (float)sqlite3_column_double(stmt, 3), // x
         .y = (float)sqlite3_column_double(stmt, 4), // y
         .z = (float)sqlite3_column_double(stmt, 5)  // z
     };
 
-    picksid[npicks] = sqlite3_column_int(stmt, 6); // rowid
+    ctx->picksid[ctx->npicks] = sqlite3_column_int(stmt, 6); // rowid
 
-    npicks++; // Increment the number of picks
+    ctx->npicks++; // Increment the number of picks
   }
 
   sqlite3_finalize(stmt);
   return true;
 }
 
-inline bool LoadCameraID(int cam_id) {
+inline bool ReadCamera(sqlite3 *db, int cam_id, Camera3D *cam, int *attachment,
+                       int *stl) {
   sqlite3_stmt *stmt;
   const char *sql = "SELECT posx, posy, posz, tx, ty, tz, upx, upy, upz, fovy, "
-                    "proj, attachment "
+                    "proj, attachment, stl "
                     "FROM cams WHERE rowid = ?;";
   int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
   if (rc != SQLITE_OK) {
@@ -132,7 +263,7 @@ inline bool LoadCameraID(int cam_id) {
 
   if (sqlite3_step(stmt) == SQLITE_ROW) {
     // Assign values from the database row to the camera structure
-    camera = (Camera3D){
+    *cam = (Camera3D){
         .position =
             {
                 .x = (float)sqlite3_column_double(stmt, 0), // posx
@@ -154,8 +285,10 @@ inline bool LoadCameraID(int cam_id) {
         .fovy = (float)sqlite3_column_double(stmt, 9), // fovy
         .projection = sqlite3_column_int(stmt, 10)     // proj
     };
-    cameraattachment = sqlite3_column_int(stmt, 11);
-    camdirty = false;
+    if (attachment)
+      *attachment = sqlite3_column_int(stmt, 11);
+    if (stl)
+      *stl = sqlite3_column_int(stmt, 12);
 
     sqlite3_finalize(stmt);
     return true;
@@ -166,24 +299,31 @@ inline bool LoadCameraID(int cam_id) {
   }
 }
 
-inline bool LoadCameraIDWithDirection(bool asc) {
+inline bool LoadCameraID(PickerContext *ctx, int cam_id) {
+  if (!ReadCamera(ctx->db, cam_id, &ctx->camera, &ctx->cameraattachment, NULL))
+    return false;
+  ctx->camdirty = false;
+  return true;
+}
+
+inline bool LoadCameraIDWithDirection(PickerContext *ctx, bool asc) {
   sqlite3_stmt *stmt;
   const char *sql =
       asc ? "SELECT rowid FROM cams WHERE rowid > ? ORDER BY rowid ASC LIMIT 1;"
           : "SELECT rowid FROM cams WHERE rowid < ? ORDER BY rowid DESC LIMIT "
             "1;";
-  int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+  int rc = sqlite3_prepare_v2(ctx->db, sql, -1, &stmt, NULL);
   if (rc != SQLITE_OK) {
-    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    printf("SQL error: %s\n", sqlite3_errmsg(ctx->db));
     return false;
   }
 
-  sqlite3_bind_int(stmt, 1, cameraid);
+  sqlite3_bind_int(stmt, 1, ctx->cameraid);
 
   if (sqlite3_step(stmt) == SQLITE_ROW) {
-    cameraid = sqlite3_column_int(stmt, 0);
+    ctx->cameraid = sqlite3_column_int(stmt, 0);
     sqlite3_finalize(stmt);
-    return LoadCameraID(cameraid);
+    return LoadCameraID(ctx, ctx->cameraid);
   }
 
   sqlite3_finalize(stmt);
@@ -191,16 +331,16 @@ inline bool LoadCameraIDWithDirection(bool asc) {
   // Wrap to the first or last camera if no next/previous camera is found
   sql = asc ? "SELECT rowid FROM cams ORDER BY rowid ASC LIMIT 1;"
             : "SELECT rowid FROM cams ORDER BY rowid DESC LIMIT 1;";
-  rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+  rc = sqlite3_prepare_v2(ctx->db, sql, -1, &stmt, NULL);
   if (rc != SQLITE_OK) {
-    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    printf("SQL error: %s\n", sqlite3_errmsg(ctx->db));
     return false;
   }
 
   if (sqlite3_step(stmt) == SQLITE_ROW) {
-    cameraid = sqlite3_column_int(stmt, 0);
+    ctx->cameraid = sqlite3_column_int(stmt, 0);
     sqlite3_finalize(stmt);
-    return LoadCameraID(cameraid);
+    return LoadCameraID(ctx, ctx->cameraid);
   }
 
   sqlite3_finalize(stmt);
@@ -208,12 +348,12 @@ inline bool LoadCameraIDWithDirection(bool asc) {
   return false;
 }
 
-inline bool LoadCameraFromDB(int stl_id) {
+inline bool LoadCameraFromDB(PickerContext *ctx, int stl_id) {
   sqlite3_stmt *stmt;
   const char *sql = "SELECT rowid FROM cams WHERE stl = ?;";
-  int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+  int rc = sqlite3_prepare_v2(ctx->db, sql, -1, &stmt, NULL);
   if (rc != SQLITE_OK) {
-    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    printf("SQL error: %s\n", sqlite3_errmsg(ctx->db));
     return false;
   }
 
@@ -222,7 +362,7 @@ inline bool LoadCameraFromDB(int stl_id) {
   if (sqlite3_step(stmt) == SQLITE_ROW) {
     int cam_id = sqlite3_column_int(stmt, 0); // Retrieve the camera ID
     sqlite3_finalize(stmt);
-    return LoadCameraID(cam_id); // Use LoadCameraID to load the camera data
+    return LoadCameraID(ctx, cam_id); // Use LoadCameraID to load the camera
   }
 
   sqlite3_finalize(stmt);
@@ -230,56 +370,78 @@ inline bool LoadCameraFromDB(int stl_id) {
   return false;
 }
 
-inline bool InitializeLoadDB() {
+// The database half of startup: everything up to a CPU-side mesh, its picks
+// and camera. No GL calls, so main() runs it on a worker thread while the
+// window and GL context come up.
+inline bool InitializeReadModel(PickerContext *ctx, Mesh *mesh) {
   // Initialize database
-  if (!InitDatabase(db_path)) {
+  double t = StartupClock();
+  if (!InitDatabase(ctx->db_path, &ctx->db)) {
     printf("Failed to initialize database\n");
-    CloseWindow();
-    return 1;
+    return false;
   }
+  StartupPhase("load", "open database", t);
 
   // Load STL model
-  if (!LoadSTLFromDB(selected_stl_id)) {
+  t = StartupClock();
+  if (!ReadSTLHash(ctx->db, ctx->selected_stl_id, &ctx->stl_hash) ||
+      !ReadSTLFromDB(ctx->db, ctx->selected_stl_id, mesh, &ctx->tri_order,
+                     &ctx->arena)) {
     printf("Failed to load STL model from DB\n");
-    sqlite3_close(db);
-    CloseWindow();
-    return 1;
+    return false;
   }
+  StartupPhase("load", "parse stl", t);
 
   // Load picks
-  if (!LoadPicksFromDB(selected_stl_id)) {
+  t = StartupClock();
+  if (!LoadPicksFromDB(ctx, ctx->selected_stl_id)) {
     printf("Failed to load picks from DB\n");
-    sqlite3_close(db);
-    CloseWindow();
-    return 1;
+    return false;
   }
+  StartupPhase("load", "picks", t);
 
   // Load camera settings
-  if (!LoadCameraFromDB(selected_stl_id)) {
+  t = StartupClock();
+  if (!LoadCameraFromDB(ctx, ctx->selected_stl_id)) {
     printf("Failed to load camera from DB\n");
-    sqlite3_close(db);
-    CloseWindow();
-    return 1;
+    return false;
   }
-  return 0;
+  StartupPhase("load", "camera", t);
+  return true;
+}
+
+// the rest of the load: picking structures for the mesh read above
+inline void InitializePicking(PickerContext *ctx, const Mesh &mesh) {
+  double t = StartupClock();
+  BuildPickingStructures(ctx, mesh);
+  StartupPhase("load", "picking structs", t);
+}
+
+// both halves, for contexts that need not show anything in between
+inline bool InitializeReadDB(PickerContext *ctx, Mesh *mesh) {
+  if (!InitializeReadModel(ctx, mesh))
+    return false;
+  InitializePicking(ctx, *mesh);
+  return true;
 }
 
-inline bool DeletePick(int i) {
+inline bool DeletePick(PickerContext *ctx, int i) {
+  ctx->writes++;
   // delete it from the arrays
-  int delid = picksid[i];
-  picks[i] = picks[npicks - 1];
-  picks2cam[i] = picks2cam[npicks - 1];
-  picksid[i] = picksid[npicks - 1];
-  picks2[i] = picks2[--npicks];
+  int delid = ctx->picksid[i];
+  ctx->picks[i] = ctx->picks[ctx->npicks - 1];
+  ctx->picks2cam[i] = ctx->picks2cam[ctx->npicks - 1];
+  ctx->picksid[i] = ctx->picksid[ctx->npicks - 1];
+  ctx->picks2[i] = ctx->picks2[--ctx->npicks];
 
   // delete it from the database
   const char *sql = "DELETE FROM picks WHERE rowid = ?;";
   sqlite3_stmt *stmt;
 
   // Prepare the SQL statement
-  int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+  int rc = sqlite3_prepare_v2(ctx->db, sql, -1, &stmt, NULL);
   if (rc != SQLITE_OK) {
-    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    printf("SQL error: %s\n", sqlite3_errmsg(ctx->db));
     return false;
   }
 
@@ -289,7 +451,7 @@ inline bool DeletePick(int i) {
   // Execute the SQL statement
   rc = sqlite3_step(stmt);
   if (rc != SQLITE_DONE) {
-    printf("Failed to delete row: %s\n", sqlite3_errmsg(db));
+    printf("Failed to delete row: %s\n", sqlite3_errmsg(ctx->db));
   } else {
     printf("Row with rowid = %d deleted successfully.\n", i);
   }
@@ -299,9 +461,11 @@ inline bool DeletePick(int i) {
   return true;
 }
 
-inline bool InsertPick(Vector2 mouse_pos, Vector3 world_pos, int cam_id) {
+inline bool InsertPick(PickerContext *ctx, Vector2 mouse_pos,
+                       Vector3 world_pos, int cam_id) {
+  ctx->writes++;
   // Ensure we don't exceed the maximum number of picks
-  if (npicks >= MAX_PTS) {
+  if (ctx->npicks >= MAX_PTS) {
     printf("Error: Exceeded maximum number of picks (%d).\n", MAX_PTS);
     return false;
   }
@@ -310,9 +474,9 @@ inline bool InsertPick(Vector2 mouse_pos, Vector3 world_pos, int cam_id) {
   const char *sql =
       "INSERT INTO picks (cam, mx, my, x, y, z) VALUES (?, ?, ?, ?, ?, ?);";
   sqlite3_stmt *stmt;
-  int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+  int rc = sqlite3_prepare_v2(ctx->db, sql, -1, &stmt, NULL);
   if (rc != SQLITE_OK) {
-    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    printf("SQL error: %s\n", sqlite3_errmsg(ctx->db));
     return false;
   }
 
@@ -327,20 +491,20 @@ inline bool InsertPick(Vector2 mouse_pos, Vector3 world_pos, int cam_id) {
   // Execute the SQL statement
   rc = sqlite3_step(stmt);
   if (rc != SQLITE_DONE) {
-    printf("Failed to insert pick: %s\n", sqlite3_errmsg(db));
+    printf("Failed to insert pick: %s\n", sqlite3_errmsg(ctx->db));
     sqlite3_finalize(stmt);
     return false;
   }
 
   // Get the rowid of the inserted pick
-  int rowid = (int)sqlite3_last_insert_rowid(db);
+  int rowid = (int)sqlite3_last_insert_rowid(ctx->db);
 
-  // Update the static arrays
-  picks2[npicks] = mouse_pos;
-  picks[npicks] = world_pos;
-  picks2cam[npicks] = cam_id;
-  picksid[npicks] = rowid;
-  npicks++; // Increment the number of picks
+  // Update the context's arrays
+  ctx->picks2[ctx->npicks] = mouse_pos;
+  ctx->picks[ctx->npicks] = world_pos;
+  ctx->picks2cam[ctx->npicks] = cam_id;
+  ctx->picksid[ctx->npicks] = rowid;
+  ctx->npicks++; // Increment the number of picks
 
   // Finalize the statement
   sqlite3_finalize(stmt);
@@ -349,15 +513,47 @@ inline bool InsertPick(Vector2 mouse_pos, Vector3 world_pos, int cam_id) {
   return true;
 }
 
-inline bool InsertCam(Camera3D camera, int stl_id, int *cam_id) {
+// write ctx->picks[idx[k]] back to their rows in one transaction; the rowid,
+// screen position and camera of each pick stay as they are
+inline bool UpdatePickPoints(PickerContext *ctx, const int *idx, int n) {
+  ctx->writes++;
+  const char *sql = "UPDATE picks SET x = ?, y = ?, z = ? WHERE rowid = ?;";
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(ctx->db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(ctx->db));
+    return false;
+  }
+
+  bool ok = sqlite3_exec(ctx->db, "BEGIN;", NULL, NULL, NULL) == SQLITE_OK;
+  for (int k = 0; ok && k < n; k++) {
+    int i = idx[k];
+    sqlite3_reset(stmt);
+    sqlite3_bind_double(stmt, 1, ctx->picks[i].x);
+    sqlite3_bind_double(stmt, 2, ctx->picks[i].y);
+    sqlite3_bind_double(stmt, 3, ctx->picks[i].z);
+    sqlite3_bind_int(stmt, 4, ctx->picksid[i]);
+    ok = sqlite3_step(stmt) == SQLITE_DONE;
+  }
+  if (!ok)
+    printf("Failed to update picks: %s\n", sqlite3_errmsg(ctx->db));
+  sqlite3_finalize(stmt);
+  ok = sqlite3_exec(ctx->db, ok ? "COMMIT;" : "ROLLBACK;", NULL, NULL,
+                    NULL) == SQLITE_OK &&
+       ok;
+  return ok;
+}
+
+inline bool InsertCam(PickerContext *ctx, Camera3D camera, int stl_id,
+                      int *cam_id) {
+  ctx->writes++;
   // Prepare the SQL statement for insertion
   const char *sql = "INSERT INTO cams (posx, posy, posz, tx, ty, tz, upx, upy, "
                     "upz, fovy, proj, stl, attachment) "
                     "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
   sqlite3_stmt *stmt;
-  int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+  int rc = sqlite3_prepare_v2(ctx->db, sql, -1, &stmt, NULL);
   if (rc != SQLITE_OK) {
-    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    printf("SQL error: %s\n", sqlite3_errmsg(ctx->db));
     return false;
   }
 
@@ -374,17 +570,18 @@ inline bool InsertCam(Camera3D camera, int stl_id, int *cam_id) {
   sqlite3_bind_double(stmt, 10, camera.fovy);      // fovy
   sqlite3_bind_int(stmt, 11, camera.projection);   // proj
   sqlite3_bind_int(stmt, 12, stl_id);              // stl
-  sqlite3_bind_int(stmt, 13, cameraattachment);    // attachment
+  sqlite3_bind_int(stmt, 13, ctx->cameraattachment); // attachment
 
   // Execute the SQL statement
   rc = sqlite3_step(stmt);
   if (rc != SQLITE_DONE) {
-    printf("Failed to insert camera: %s\n", sqlite3_errmsg(db));
+    printf("Failed to insert camera: %s\n", sqlite3_errmsg(ctx->db));
     sqlite3_finalize(stmt);
     return false;
   }
 
-  *cam_id = (int)sqlite3_last_insert_rowid(db);
+  *cam_id = (int)sqlite3_last_insert_rowid(ctx->db);
+  ctx->new_cams.push_back(*cam_id);
 
   // Finalize the statement
   sqlite3_finalize(stmt);
@@ -393,20 +590,21 @@ inline bool InsertCam(Camera3D camera, int stl_id, int *cam_id) {
   return true;
 }
 
-inline bool RemoveCameraFromDB(int cam_id) {
+inline bool RemoveCameraFromDB(PickerContext *ctx, int cam_id) {
+  ctx->writes++;
   // Check the number of rows in the cams table
   const char *count_sql = "SELECT COUNT(*) FROM cams;";
   sqlite3_stmt *count_stmt;
 
-  int rc = sqlite3_prepare_v2(db, count_sql, -1, &count_stmt, NULL);
+  int rc = sqlite3_prepare_v2(ctx->db, count_sql, -1, &count_stmt, NULL);
   if (rc != SQLITE_OK) {
-    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    printf("SQL error: %s\n", sqlite3_errmsg(ctx->db));
     return false;
   }
 
   rc = sqlite3_step(count_stmt);
   if (rc != SQLITE_ROW) {
-    printf("Failed to count rows: %s\n", sqlite3_errmsg(db));
+    printf("Failed to count rows: %s\n", sqlite3_errmsg(ctx->db));
     sqlite3_finalize(count_stmt);
     return false;
   }
@@ -423,9 +621,9 @@ inline bool RemoveCameraFromDB(int cam_id) {
   const char *sql = "DELETE FROM cams WHERE rowid = ?;";
   sqlite3_stmt *stmt;
 
-  rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+  rc = sqlite3_prepare_v2(ctx->db, sql, -1, &stmt, NULL);
   if (rc != SQLITE_OK) {
-    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    printf("SQL error: %s\n", sqlite3_errmsg(ctx->db));
     return false;
   }
 
@@ -433,7 +631,7 @@ inline bool RemoveCameraFromDB(int cam_id) {
 
   rc = sqlite3_step(stmt);
   if (rc != SQLITE_DONE) {
-    printf("Failed to delete camera: %s\n", sqlite3_errmsg(db));
+    printf("Failed to delete camera: %s\n", sqlite3_errmsg(ctx->db));
     sqlite3_finalize(stmt);
     return false;
   }
@@ -443,3 +641,5 @@ inline bool RemoveCameraFromDB(int cam_id) {
   printf("Camera with ID %d deleted successfully.\n", cam_id);
   return true;
 }
+#define INITDB_ONCE
+#endif
@@ -1,4 +1,5 @@
 #include "main.h"
+#include "shaders.h"
 
 inline void SetLightPosition(Vector3 lightPosition) {
   int shaderLightPositionLoc = GetShaderLocation(shader, "lightPosition");
@@ -7,15 +8,16 @@ inline void SetLightPosition(Vector3 lightPosition) {
 }
 
 inline bool InitializeShader() {
-  shader = LoadShader("src/vs.glsl", "src/fs.glsl");
+  // src/vs.glsl and src/fs.glsl, embedded by cmake/embed_shaders.cmake
+  shader = LoadShaderFromMemory(vs_glsl, fs_glsl);
   if (shader.id == 0) {
     printf("Failed to load shader\n");
     return 1;
   }
-  Vector3 ambientColor = {0.5f, 0.5f, 0.4f}; // Example ambient color
+  Vector3 ambientColor = SHADER_AMBIENT_COLOR;
   int shaderAmbientLoc = GetShaderLocation(shader, "ambientColor");
   SetShaderValue(shader, shaderAmbientLoc, &ambientColor, SHADER_UNIFORM_VEC3);
 
-  SetLightPosition((Vector3){0.0, -10.0, 10.0});
+  SetLightPosition(SHADER_LIGHT_POSITION);
   return 0;
 }
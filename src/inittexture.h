@@ -1,4 +1,5 @@
 #include "checkerboard.h"
+#include "context.h"
 #include "main.h"
 
 static Image checkerboard_img;
@@ -6,7 +7,7 @@ static Texture2D checkerboard;
 static Material materials;
 static MaterialMap materialmap;
 
-inline bool InitializeTexture() {
+inline bool InitializeTexture(PickerContext *ctx) {
   // Load texture and assign it to the model
   // convert -size 800x800 pattern:checkerboard -colors 2 checkerboard.png
   // xxd -i checkerboard.png > checkerboard.h
@@ -20,12 +21,12 @@ inline bool InitializeTexture() {
   materialmap = {.texture = checkerboard, .color = GRAY, .value = 50.f};
   materials = (Material){
       .shader = shader, .maps = &materialmap, .params = {1.f, 1.f, 1.f, 1.f}};
-  stl_model.materials = &materials;
+  ctx->stl_model.materials = &materials;
   return 0;
 }
 
-inline void UninitializeTexture() {
-  stl_model.materials = NULL;
+inline void UninitializeTexture(PickerContext *ctx) {
+  ctx->stl_model.materials = NULL;
   UnloadImage(checkerboard_img);
   UnloadTexture(checkerboard);
 }
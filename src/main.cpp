@@ -1,62 +1,215 @@
 #include "main.h"
+#include "asyncload.h"
+#include "columnar.h"
+#include "context.h"
+#include "drift.h"
 #include "geometry.h"
 #include "initdb.h"
 #include "initshader.h"
 #include "inittexture.h"
+#include "maintain.h"
+#include "raygen.h"
+#include "reload.h"
+#include "review.h"
+#include "rtree.h"
+#include "serve.h"
+#include "snap.h"
+#include "startup.h"
+#include "thumbs.h"
+#include <thread>
+
+// viewer UI state; everything about the model and picks is in the context
+static int deletionmode = 0;
+
+// rays through the window for the current camera, what GetScreenToWorldRay
+// gives without rebuilding the matrices per ray
+static const RayGen &ViewRays(PickerContext *ctx) {
+  return CachedRayGen(&ctx->raygen, ctx->camera, GetScreenWidth(),
+                      GetScreenHeight());
+}
 
 int main(int argc, char *argv[]) {
   // if (argc < 2) {
   //   printf("Usage: %s <database_path> [stl_id]\n", argv[0]);
   //   return 1;
   // }
-  selected_stl_id = 1;
 
+  if (argc > 1 && strcmp(argv[1], "serve") == 0) {
+    if (argc < 3) {
+      printf("Usage: %s serve <socket> [database_path]\n", argv[0]);
+      return 1;
+    }
+    return ServeUnixSocket(argv[2], argc > 3 ? argv[3] : DEFAULT_DB_PATH) ? 0
+                                                                          : 1;
+  }
+
+  if (argc > 1 && strcmp(argv[1], "drift") == 0) {
+    if (argc < 5) {
+      printf("Usage: %s drift <database_path> <from_stl> <to_stl> "
+             "[max_mm] [max_deg]\n",
+             argv[0]);
+      return 1;
+    }
+    DriftOptions opt = {.max_dist = argc > 5 ? (float)atof(argv[5]) : 0.5f,
+                        .max_angle = argc > 6 ? (float)atof(argv[6]) : 15.f};
+    sqlite3 *db;
+    if (!InitDatabase(argv[2], &db))
+      return 1;
+    bool ok = ReportDrift(db, atoi(argv[3]), atoi(argv[4]), opt);
+    sqlite3_close(db);
+    return ok ? 0 : 1;
+  }
+
+  if (argc > 1 && (strcmp(argv[1], "export") == 0 ||
+                   strcmp(argv[1], "import") == 0)) {
+    if (argc < 4) {
+      printf("Usage: %s export|import <database_path> <file> [stl_id]\n",
+             argv[0]);
+      return 1;
+    }
+    sqlite3 *db;
+    if (!InitDatabase(argv[2], &db))
+      return 1;
+    int stl_id = argc > 4 ? atoi(argv[4]) : 0;
+    bool ok = argv[1][0] == 'e' ? ExportColumnar(db, stl_id, argv[3])
+                                : ImportColumnar(db, argv[3], stl_id);
+    sqlite3_close(db);
+    return ok ? 0 : 1;
+  }
+
+  if (argc > 1 && strcmp(argv[1], "rtree") == 0) {
+    if (argc < 3) {
+      printf("Usage: %s rtree <database_path>\n", argv[0]);
+      return 1;
+    }
+    sqlite3 *db;
+    if (!InitDatabase(argv[2], &db))
+      return 1;
+    bool ok = BuildRtree(db);
+    sqlite3_close(db);
+    return ok ? 0 : 1;
+  }
+
+  if (argc > 1 && strcmp(argv[1], "review") == 0) {
+    if (argc < 5) {
+      printf("Usage: %s review <database_path> <stl_id> <out_dir>\n", argv[0]);
+      return 1;
+    }
+    sqlite3 *db;
+    if (!InitDatabase(argv[2], &db))
+      return 1;
+    SetTraceLogLevel(LOG_WARNING); // not a line per exported image
+    bool ok = ReviewStl(db, atoi(argv[3]), argv[4]);
+    sqlite3_close(db);
+    return ok ? 0 : 1;
+  }
+
+  if (argc > 1 && strcmp(argv[1], "compact") == 0) {
+    if (argc < 3) {
+      printf("Usage: %s compact <database_path>\n", argv[0]);
+      return 1;
+    }
+    sqlite3 *db;
+    if (!InitDatabase(argv[2], &db))
+      return 1;
+    MaintainStats st;
+    bool ok = CompactDatabase(&db, argv[2], 0, &st);
+    if (ok)
+      PrintMaintainStats("compact", st);
+    sqlite3_close(db);
+    return ok ? 0 : 1;
+  }
+
+  PickerContext ctx;
   if (argc > 1) {
-    const char *db_path = argv[1];
+    ctx.db_path = argv[1];
   }
   if (argc > 2) {
-    selected_stl_id = atoi(argv[2]);
+    ctx.selected_stl_id = atoi(argv[2]);
   }
 
+  // The database, STL parse and picking structures load on a worker thread
+  // while the window comes up and the first frames draw; see asyncload.h
+  AsyncLoad load;
+  StartAsyncLoad(&load, &ctx);
+
   // Initialize Raylib
-  const int screenWidth = 1200;
-  const int screenHeight = 800;
-  InitWindow(screenWidth, screenHeight, "STL Viewer with Point Editor");
+  double t = StartupClock();
+  InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "STL Viewer with Point Editor");
   SetTargetFPS(30);
+  StartupPhase("main", "window", t);
 
-  InitializeLoadDB();
+  t = StartupClock();
   InitializeShader();
-  InitializeTexture();
+  StartupPhase("main", "shader", t);
+
+  t = StartupClock();
+  InitializeTexture(&ctx);
+  StartupPhase("main", "texture", t);
 
   // Main game loop
+  HotReload reload;
+  ThumbStrip thumbs;
+  Maintenance maintenance;
+  bool first_frame = true, failed = false, printed = false;
   while (!WindowShouldClose()) {
-    ProcessInput();
+    t = StartupClock();
+    if (!PollAsyncLoad(&load, &ctx)) {
+      failed = true;
+      break;
+    }
+    // a reload replaces the model, so it waits for this one to be complete
+    if (LoadFinished(&load)) {
+      PollReload(&reload, &ctx, GetTime());
+      UpdateThumbStrip(&thumbs, &ctx, GetTime());
+      PollMaintenance(&maintenance, &ctx, GetTime());
+    }
+    if (load.picking) {
+      if (!ClickThumbStrip(&thumbs, &ctx))
+        ProcessInput(&ctx);
+      UpdateHover(&ctx);
+    } else if (LoadShowsModel(&load)) {
+      OrbitCamera(&ctx);
+    }
 
     BeginDrawing();
     ClearBackground(RAYWHITE);
-    BeginMode3D(camera);
-    BeginShaderMode(shader);
-    DrawModel(stl_model, Vector3Zero(), 1.0f, (Color){0, 255, 255, 128});
-    EndShaderMode();
-    DrawPicks();
-    EndMode3D();
-    DrawUI();
+    if (LoadShowsModel(&load)) {
+      BeginMode3D(ctx.camera);
+      BeginShaderMode(shader);
+      DrawModel(LoadedModel(&load, &ctx), Vector3Zero(), 1.0f,
+                (Color){0, 255, 255, 128});
+      EndShaderMode();
+      DrawPicks(&ctx);
+      EndMode3D();
+      DrawUI(&ctx);
+      DrawThumbStrip(&thumbs, &ctx);
+    }
+    if (!LoadFinished(&load))
+      DrawLoadProgress(&load);
     EndDrawing();
+
+    if (first_frame) {
+      StartupPhase("main", "first frame", t);
+      first_frame = false;
+    }
+    if (!printed && LoadFinished(&load)) {
+      PrintStartupPhases();
+      printed = true;
+    }
   }
 
   // Cleanup
-  sqlite3_close(db);
-
+  StopReload(&reload);
+  StopAsyncLoad(&load);
+  UnloadThumbStrip(&thumbs);
   UnloadShader(shader);
-  UninitializeTexture();
-  for (int i = 0; i < stl_model.meshCount; i++) {
-    free(stl_model.meshes[i].vertices);
-    free(stl_model.meshes[i].normals);
-  }
-  RL_FREE(stl_model.meshes);
+  UninitializeTexture(&ctx);
+  UnloadModelGpu(&ctx.gpu);
+  UnloadPickerContext(&ctx);
   CloseWindow();
 
-  return 0;
+  return failed ? 1 : 0;
 }
 
 // interpret all points in the given camera as defining a (planar) polygonal
@@ -68,27 +221,32 @@ int main(int argc, char *argv[]) {
 //
 // consider the stl_model as a sphere, then some traversal orders will
 // be different? In all cases the polygon will be tangent to the sphere?
-void AttachPolygon1(int nx, int ny) {
+//
+// Attachment mode 2 answers that: the plane is the LP solution of
+// SupportPlane over all samples at once, independent of traversal order.
+void AttachPolygon1(PickerContext *ctx, int nx, int ny) {
+  bool tangent = ctx->cameraattachment == 2;
+  std::vector<Vector3> hits;
   // bounding box
   Vector2 upperLeft = {INFINITY, INFINITY}, lowerRight = {-INFINITY, -INFINITY};
 
   // compute the axis aligned bounding box (aabb)
   int nbb = 0;
-  for (int i = 0; i < npicks; i++) {
-    if (cameraid != picks2cam[i])
+  for (int i = 0; i < ctx->npicks; i++) {
+    if (ctx->cameraid != ctx->picks2cam[i])
       continue;
     nbb++;
-    if (picks2[i].x < upperLeft.x) {
-      upperLeft.x = picks2[i].x;
+    if (ctx->picks2[i].x < upperLeft.x) {
+      upperLeft.x = ctx->picks2[i].x;
     }
-    if (picks2[i].y < upperLeft.y) {
-      upperLeft.y = picks2[i].y;
+    if (ctx->picks2[i].y < upperLeft.y) {
+      upperLeft.y = ctx->picks2[i].y;
     }
-    if (picks2[i].x > lowerRight.x) {
-      lowerRight.x = picks2[i].x;
+    if (ctx->picks2[i].x > lowerRight.x) {
+      lowerRight.x = ctx->picks2[i].x;
     }
-    if (picks2[i].y > lowerRight.y) {
-      lowerRight.y = picks2[i].y;
+    if (ctx->picks2[i].y > lowerRight.y) {
+      lowerRight.y = ctx->picks2[i].y;
     }
   }
   float dx = (lowerRight.x - upperLeft.x) / (nx - 1);
@@ -101,28 +259,38 @@ void AttachPolygon1(int nx, int ny) {
   if (nbb < 2)
     return;
 
+  // cast every sample up front, indices 0..nx by 0..ny (0..nx along the
+  // diagonal for a segment), in packets of coherent rows
+  const RayGen &g = ViewRays(ctx);
+  int gx = nx + 1, gy = nbb == 2 ? 1 : ny + 1;
+  std::vector<Ray> rays(gx * gy);
+  std::vector<RayCollision> grid(gx * gy);
+  std::vector<int> tris(gx * gy);
+  RayGenGrid(g, upperLeft, (Vector2){dx, nbb == 2 ? dy : 0}, (Vector2){0, dy},
+             gx, gy, rays.data());
+  for (int k = 0; k < gx * gy; k += BVH_PACKET)
+    GetRayCollisionBvhPacket(&rays[k], std::min(BVH_PACKET, gx * gy - k),
+                             ctx->stl_model.meshes[0], ctx->bvh, &grid[k],
+                             &tris[k]);
+
   // line segment
   if (nbb == 2) {
     for (int i2 = nx / 2; i2 >= 0; i2--)
       for (int si = -1; si <= 1; si += 2) {
         int i = nx / 2 + si * i2;
-        Vector2 p = {upperLeft.x + i * dx, upperLeft.y + i * dy};
-        Ray ray = GetScreenToWorldRay(p, camera);
-        RayCollision hit =
-            GetRayCollisionMesh(ray, stl_model.meshes[0], stl_model.transform);
+        RayCollision hit = grid[i];
 
         if (hit.hit) {
           if (iboundary < 3) {
             boundary[iboundary++] = hit.point;
           }
-          AdvanceSeg(camera.position, boundary, hit.point);
+          AdvanceSeg(ctx->camera.position, boundary, hit.point);
         }
       }
   }
 
   // plane
   if (nbb > 2) {
-    Ray ray;
     RayCollision hit;
     // traverse from outside the aabb towards the center
     for (int i2 = nx / 2; i2 >= 0; i2--)
@@ -138,96 +306,115 @@ void AttachPolygon1(int nx, int ny) {
             // float sign = 1;
             // for (...) sign = copysign(sign, Turn( .. ))
             // if (sign < 0) goto outside;
-            for (int k = 1; k < npicks; k++) {
-              if (Turn(picks2[k - 1], picks2[k], p) < 0)
+            for (int k = 1; k < ctx->npicks; k++) {
+              if (Turn(ctx->picks2[k - 1], ctx->picks2[k], p) < 0)
                 goto outside;
             }
             // inside
-            ray = GetScreenToWorldRay(p, camera);
-            hit = GetRayCollisionMesh(ray, stl_model.meshes[0],
-                                      stl_model.transform);
+            hit = grid[j * gx + i];
 
-            if (iboundary < 3) {
+            if (tangent) {
+              if (hit.hit)
+                hits.push_back(hit.point);
+            } else if (iboundary < 3) {
               boundary[iboundary++] = hit.point;
             } else {
-              AdvancePlane(camera.position, boundary, hit.point);
+              AdvancePlane(ctx->camera.position, boundary, hit.point);
             }
           outside:
             continue;
           }
+    if (tangent) {
+      iboundary = 0;
+      if (SupportPlane(ctx->camera.position, hits.data(), (int)hits.size(),
+                       boundary))
+        iboundary = 3;
+    }
   }
 
-  for (int i = 0; i < npicks; i++) {
-    if (cameraid != picks2cam[i])
+  std::vector<int> moved;
+  for (int i = 0; i < ctx->npicks; i++) {
+    if (ctx->cameraid != ctx->picks2cam[i])
       continue;
-    Ray ray = GetScreenToWorldRay(picks2[i], camera);
+    Ray ray = RayGenRay(g, ctx->picks2[i]);
     RayCollision hit = GetRayCollisionPlane(ray, boundary, iboundary);
     if (hit.hit) {
-      picks[i] = hit.point;
-      // do it with a single transaction?
-      DeletePick(i);
-      InsertPick(picks2[i], hit.point, picks2cam[i]);
+      ctx->picks[i] = hit.point;
+      moved.push_back(i);
     }
   }
+  if (!moved.empty())
+    UpdatePickPoints(ctx, moved.data(), (int)moved.size());
 }
 
-void ProcessInput() {
+void OrbitCamera(PickerContext *ctx) {
   if (IsMouseButtonDown(MOUSE_BUTTON_RIGHT)) {
-    UpdateCamera(&camera, CAMERA_THIRD_PERSON);
-    camdirty = true;
+    UpdateCamera(&ctx->camera, CAMERA_THIRD_PERSON);
+    ctx->camdirty = true;
   }
+}
+
+void ProcessInput(PickerContext *ctx) {
+  OrbitCamera(ctx);
 
   if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
     Vector2 mouse_pos = GetMousePosition();
-    Ray ray = GetScreenToWorldRay(mouse_pos, camera);
-
-    // if there are multiple meshes, consider only the first one to be hit
-    RayCollision hit;
-    for (int i = 0; i < stl_model.meshCount; i++) {
-      hit = GetRayCollisionMesh(ray, stl_model.meshes[i], stl_model.transform);
-      if (hit.hit)
-        break;
+    Ray ray = RayGenRay(ViewRays(ctx), mouse_pos);
+
+    int tri;
+    RayCollision hit =
+        GetRayCollisionBvh(ray, ctx->stl_model.meshes[0], ctx->bvh, &tri);
+    Vector3 snapped;
+    if (hit.hit && IsKeyDown(KEY_LEFT_SHIFT) &&
+        SnapPick(ctx->snap, ray, hit.point,
+                 SnapRadius(ctx->camera, hit.distance, SNAP_RADIUS_PX),
+                 &snapped) != SNAP_NONE) {
+      hit.point = snapped;
+      // store where the snapped point is on screen, so a replay casts at the
+      // corner or edge rather than where the cursor happened to be
+      mouse_pos = GetWorldToScreen(snapped, ctx->camera);
     }
     if (hit.hit) {
-      if (camdirty) {
-        InsertCam(camera, selected_stl_id, &cameraid);
-        printf("dirty cam, camid %d\n", cameraid);
-        camdirty = false;
+      if (ctx->camdirty) {
+        InsertCam(ctx, ctx->camera, ctx->selected_stl_id, &ctx->cameraid);
+        printf("dirty cam, camid %d\n", ctx->cameraid);
+        ctx->camdirty = false;
       }
-      InsertPick(mouse_pos, hit.point, cameraid);
+      InsertPick(ctx, mouse_pos, hit.point, ctx->cameraid);
     }
-    if (cameraattachment == 1)
-      AttachPolygon1(10, 10);
+    if (ctx->cameraattachment)
+      AttachPolygon1(ctx, 10, 10);
   }
 
-  if (IsMouseButtonPressed(MOUSE_BUTTON_MIDDLE) && npicks > 0 && deletionmode) {
+  if (IsMouseButtonPressed(MOUSE_BUTTON_MIDDLE) && ctx->npicks > 0 &&
+      deletionmode) {
     Vector2 mouse_pos = GetMousePosition();
-    Ray ray = GetScreenToWorldRay(mouse_pos, camera);
+    Ray ray = RayGenRay(ViewRays(ctx), mouse_pos);
 
     // index with the minimum distance
     int min_index = 0;
-    float min_distance = RayVector3Distance(ray, picks[0]);
-    for (int i = 1; i < npicks; i++) {
-      float distance = RayVector3Distance(ray, picks[i]);
+    float min_distance = RayVector3Distance(ray, ctx->picks[0]);
+    for (int i = 1; i < ctx->npicks; i++) {
+      float distance = RayVector3Distance(ray, ctx->picks[i]);
       if (distance < min_distance) {
         min_distance = distance;
         min_index = i;
       }
     }
 
-    DeletePick(min_index);
+    DeletePick(ctx, min_index);
   }
 
-  if (IsMouseButtonPressed(MOUSE_BUTTON_MIDDLE) && npicks > 0 &&
+  if (IsMouseButtonPressed(MOUSE_BUTTON_MIDDLE) && ctx->npicks > 0 &&
       !deletionmode) {
     Vector2 mouse_pos = GetMousePosition();
-    Ray ray = GetScreenToWorldRay(mouse_pos, camera);
+    Ray ray = RayGenRay(ViewRays(ctx), mouse_pos);
 
     // index with the minimum distance
     // that also has the same camera id
     int min_index = -1;
-    for (int i = 0; i < npicks; i++) {
-      if (picks2cam[i] == cameraid) {
+    for (int i = 0; i < ctx->npicks; i++) {
+      if (ctx->picks2cam[i] == ctx->cameraid) {
         min_index = i;
         break;
       }
@@ -235,48 +422,83 @@ void ProcessInput() {
 
     if (min_index == -1) {
       // nobody uses the camera so delete it
-      RemoveCameraFromDB(cameraid);
-      LoadCameraIDWithDirection(true);
+      RemoveCameraFromDB(ctx, ctx->cameraid);
+      LoadCameraIDWithDirection(ctx, true);
     } else {
-      float min_distance = RayVector3Distance(ray, picks[min_index]);
-      for (int i = min_index + 1; i < npicks; i++) {
-        if (picks2cam[i] != cameraid)
+      float min_distance = RayVector3Distance(ray, ctx->picks[min_index]);
+      for (int i = min_index + 1; i < ctx->npicks; i++) {
+        if (ctx->picks2cam[i] != ctx->cameraid)
           continue;
-        float distance = RayVector3Distance(ray, picks[i]);
+        float distance = RayVector3Distance(ray, ctx->picks[i]);
         if (distance < min_distance) {
           min_distance = distance;
           min_index = i;
         }
       }
-      DeletePick(min_index);
+      DeletePick(ctx, min_index);
     }
   }
 
   if (IsKeyPressed(KEY_PERIOD)) {
-    LoadCameraIDWithDirection(true);
+    LoadCameraIDWithDirection(ctx, true);
   }
   if (IsKeyPressed(KEY_COMMA)) {
-    LoadCameraIDWithDirection(false);
+    LoadCameraIDWithDirection(ctx, false);
   }
 
   if (IsKeyPressed(KEY_SLASH)) {
     deletionmode = (1 + deletionmode) % 2;
   }
   if (IsKeyPressed(KEY_M)) {
-    cameraattachment = (1 + cameraattachment) % 2;
-    if (cameraattachment == 1)
-      AttachPolygon1(10, 10);
+    ctx->cameraattachment = (1 + ctx->cameraattachment) % 3;
+    if (ctx->cameraattachment)
+      AttachPolygon1(ctx, 10, 10);
   }
 }
 
-void DrawPicks() {
-  for (int i = 0; i < npicks; i++) {
-    Color col = (!camdirty && picks2cam[i] == cameraid) ? RED : BLUE;
-    DrawSphere(picks[i], 1.f, col);
+// preview the pick under the cursor while P (or the snap modifier) is held.
+// Consecutive frames hit nearby triangles, so HoverRayCollision starts from
+// last frame's triangle and walks the adjacency; it only pays for a full BVH
+// query, the one a click makes, when the walk fails or is covered. A part
+// that slides over the hovered triangle without the walk leaving it shows up
+// once the cursor crosses an edge; clicks are never affected.
+void UpdateHover(PickerContext *ctx) {
+  bool snapping = IsKeyDown(KEY_LEFT_SHIFT);
+  ctx->snap_kind = SNAP_NONE;
+  if (!IsKeyDown(KEY_P) && !snapping) {
+    ctx->hover_tri = -1;
+    return;
   }
+  double t0 = GetTime();
+  Ray ray = RayGenRay(ViewRays(ctx), GetMousePosition());
+  const Mesh &mesh = ctx->stl_model.meshes[0];
+
+  bool moved = memcmp(&ctx->hover_camera, &ctx->camera, sizeof(Camera3D));
+  ctx->hover_camera = ctx->camera;
+  ctx->hover_hit = HoverRayCollision(ray, mesh, ctx->tri_adj, ctx->bvh, moved,
+                                     &ctx->hover_tri, &ctx->hover_steps);
+  if (snapping && ctx->hover_hit.hit)
+    ctx->snap_kind = SnapPick(
+        ctx->snap, ray, ctx->hover_hit.point,
+        SnapRadius(ctx->camera, ctx->hover_hit.distance, SNAP_RADIUS_PX),
+        &ctx->snap_point);
+  ctx->hover_seconds = GetTime() - t0;
 }
 
-void DrawUI(void) {
+void DrawPicks(const PickerContext *ctx) {
+  for (int i = 0; i < ctx->npicks; i++) {
+    Color col =
+        (!ctx->camdirty && ctx->picks2cam[i] == ctx->cameraid) ? RED : BLUE;
+    DrawSphere(ctx->picks[i], 1.f, col);
+  }
+  if (ctx->snap_kind != SNAP_NONE)
+    DrawSphere(ctx->snap_point, 1.f,
+               ctx->snap_kind == SNAP_VERTEX ? DARKGREEN : LIME);
+  else if (ctx->hover_tri >= 0 && ctx->hover_hit.hit)
+    DrawSphere(ctx->hover_hit.point, 1.f, ORANGE);
+}
+
+void DrawUI(const PickerContext *ctx) {
   // instructions
   DrawText("Controls:", 10, 10, 20, BLACK);
   DrawText(", (KEY_COMMA): previous camera", 10, 40, 16,
@@ -291,17 +513,38 @@ void DrawUI(void) {
            IsMouseButtonDown(MOUSE_MIDDLE_BUTTON) ? RED : DARKGRAY);
   DrawText("Right drag: Rotate camera", 10, 140, 16,
            IsMouseButtonDown(MOUSE_RIGHT_BUTTON) ? RED : DARKGRAY);
-  DrawText(cameraattachment ? "M: camera attachment mode point"
-                            : "M: camera attachment mode envelope",
+  const char *modes[] = {"point", "envelope", "tangent plane"};
+  DrawText(TextFormat("M: camera attachment mode %s",
+                      modes[ctx->cameraattachment % 3]),
            10, 160, 16, IsKeyDown(KEY_M) ? RED : DARKGRAY);
+  DrawText("P (hold): preview pick under the cursor", 10, 180, 16,
+           IsKeyDown(KEY_P) ? RED : DARKGRAY);
+  DrawText("Left Shift (hold): snap to vertex / feature edge", 10, 200, 16,
+           IsKeyDown(KEY_LEFT_SHIFT) ? RED : DARKGRAY);
+  DrawText("B: camera browser, click a thumbnail to jump", 10, 220, 16,
+           IsKeyDown(KEY_B) ? RED : DARKGRAY);
 
   // status
-  DrawText(TextFormat("npicks: %d", npicks), 10, GetScreenHeight() - 100, 16,
-           BLACK);
-  DrawText(TextFormat("STL ID: %d", selected_stl_id), 10,
+  if (IsKeyDown(KEY_P)) {
+    // triangle index as stored in stls.data, before the load-time reordering
+    int stl_tri = ctx->hover_tri >= 0 && ctx->tri_order
+                      ? ctx->tri_order[ctx->hover_tri]
+                      : -1;
+    DrawText(ctx->hover_steps < 0
+                 ? TextFormat("preview: full query %.3f ms, triangle %d",
+                              ctx->hover_seconds * 1000, stl_tri)
+                 : TextFormat("preview: walk %d steps %.3f ms, triangle %d",
+                              ctx->hover_steps, ctx->hover_seconds * 1000,
+                              stl_tri),
+             10, GetScreenHeight() - 120, 16, BLACK);
+  }
+  DrawText(TextFormat("npicks: %d", ctx->npicks), 10, GetScreenHeight() - 100,
+           16, BLACK);
+  DrawText(TextFormat("STL ID: %d", ctx->selected_stl_id), 10,
            GetScreenHeight() - 80, 16, BLACK);
-  DrawText(camdirty ? "CAM ID: ..." : TextFormat("CAM ID: %d", cameraid), 10,
-           GetScreenHeight() - 60, 16, BLACK);
+  DrawText(ctx->camdirty ? "CAM ID: ..."
+                         : TextFormat("CAM ID: %d", ctx->cameraid),
+           10, GetScreenHeight() - 60, 16, BLACK);
   DrawText(deletionmode
                ? "Middle click deletes all"
                : "Middle click deletes only for current CAM ID (red points)",
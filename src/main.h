@@ -9,36 +9,27 @@
 #include <string.h>
 #include <unistd.h>
 
-#define MAX_TRIANGLES 80000
+#define MAX_TRIANGLES 16000000
 #define MAX_PTS 1000
 
-// Global variables
-static sqlite3 *db = NULL;
-static Camera3D camera = {0};
-static int cameraattachment = 0;
-static int cameraid = 1;
-static int selected_stl_id = 0;
-static Model stl_model = {0};
-static int editing_mode = 0;
+// window size, also the frame that picks.mx/my are measured in
+#define SCREEN_WIDTH 1200
+#define SCREEN_HEIGHT 800
 
-static int picksid[MAX_PTS];
-static int picks2cam[MAX_PTS];
-static bool camdirty = false;
-static Vector2 picks2[MAX_PTS];
-static Vector3 picks[MAX_PTS];
-static int npicks = 0;
-static int deletionmode = 0;
+#define DEFAULT_DB_PATH "stl.sqlite3"
+
+// the GL shader shared by every model drawn in the window
 static Shader shader;
-const char *db_path = "stl.sqlite3"; // Default database path
+// its lighting, also what the review renderer lights with
+#define SHADER_AMBIENT_COLOR ((Vector3){0.5f, 0.5f, 0.4f})
+#define SHADER_AMBIENT_STRENGTH 0.01f // fs.glsl's ambientStrength
+#define SHADER_LIGHT_POSITION ((Vector3){0.0f, -10.0f, 10.0f})
 
-bool InitDatabase(const char *db_path);
-bool LoadSTLFromDB(int stl_id);
-bool LoadCameraFromDB(int stl_id);
-bool LoadPicksFromDB(int stl_id);
-void ProcessInput();
-void DrawPicks();
-void DrawUI(void);
-bool DeletePick(int i);
-bool InitializeTexture();
+typedef struct PickerContext PickerContext;
+void OrbitCamera(PickerContext *ctx);
+void ProcessInput(PickerContext *ctx);
+void DrawPicks(const PickerContext *ctx);
+void UpdateHover(PickerContext *ctx);
+void DrawUI(const PickerContext *ctx);
 #define MAIN_ONCE
 #endif
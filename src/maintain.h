@@ -0,0 +1,575 @@
+#ifndef MAINTAIN_ONCE
+#include "context.h"
+#include "initdb.h"
+#include "main.h"
+#include "replay.h"
+#include <algorithm>
+#include <climits>
+#include <errno.h>
+#include <string>
+#include <vector>
+
+// Database upkeep while the viewer sits idle. Every right drag followed by a
+// click inserts a cams row, and nothing removes the rows that end up without
+// picks, so long sessions leave thousands behind. After MAINTAIN_IDLE_SECONDS
+// without input or writes, one step per frame:
+//
+//   MAINTAIN_DEDUPE  fold cameras of the same STL that agree to within
+//                    MAINTAIN_CAM_EPS into one, moving their picks along
+//   MAINTAIN_EMPTY   delete cameras without picks
+//   MAINTAIN_CACHE   drop replay_cache rows no key can reach
+//   MAINTAIN_VACUUM  return up to MAINTAIN_VACUUM_PAGES free pages to the OS
+//                    per frame, until the freelist is empty
+//
+// The first two find their cameras once per pass through the picks_cam
+// index and then work through MAINTAIN_CAM_ROWS of them a frame. Building the
+// index can take seconds, so `waterfall-picker compact db` does it, and
+// until then the viewer leaves cameras alone. It only touches cameras of its
+// own STL that were there when it started or that it inserted itself, so a
+// camera another process has just inserted is that process's; `compact`
+// covers every STL. The viewer's current camera and the first camera of
+// every STL, which LoadCameraFromDB starts from, are never deleted.
+// Incremental vacuum needs auto_vacuum = INCREMENTAL, which `compact` also
+// turns on once by rewriting the file. Until then freed pages are only
+// counted.
+
+#define MAINTAIN_IDLE_SECONDS 2.0
+#define MAINTAIN_INTERVAL_SECONDS 60.0 // between passes without writes
+#define MAINTAIN_CAM_EPS 1e-4          // mm, degrees and up components
+#define MAINTAIN_CAM_ROWS 256
+#define MAINTAIN_VACUUM_PAGES 64
+
+enum {
+  MAINTAIN_DEDUPE,
+  MAINTAIN_EMPTY,
+  MAINTAIN_CACHE,
+  MAINTAIN_VACUUM,
+  MAINTAIN_DONE
+};
+
+typedef struct MaintainStats {
+  int cams_merged = 0;  // near-duplicates folded into another camera
+  int picks_moved = 0;  // picks of those, now on the camera kept
+  int cams_removed = 0; // cameras without picks
+  int cache_pruned = 0; // replay_cache rows
+  long long bytes_reclaimed = 0;
+  int free_pages = 0; // freelist left behind, when auto_vacuum is off
+} MaintainStats;
+
+// the cams rows a pass may touch
+typedef struct MaintainScope {
+  int stl = 0;                        // 0 for every STL
+  int last_cam = INT_MAX;             // rowids up to this one
+  const std::vector<int> *own = NULL; // and these
+  int keep_cam = 0;                   // never deleted
+} MaintainScope;
+
+// what the current step found to do and how far it got
+typedef struct MaintainWork {
+  bool planned = false;
+  std::vector<std::pair<int, int>> merges; // (dup, keep)
+  std::vector<int> empty;
+  size_t next = 0;
+} MaintainWork;
+
+typedef struct Maintenance {
+  int step = MAINTAIN_DONE;
+  double idle_since = 0, next_pass = 0;
+  int last_cam = -1; // the newest camera when maintenance first ran
+  MaintainWork work;
+  // what counted as activity last frame
+  int writes = -1, cameraid = -1;
+  bool camdirty = false;
+  MaintainStats pass, total;
+} Maintenance;
+
+inline bool MaintainExec(sqlite3 *db, const char *sql, int *changes = NULL) {
+  char *err = NULL;
+  if (sqlite3_exec(db, sql, NULL, NULL, &err) != SQLITE_OK) {
+    printf("SQL error: %s\n", err);
+    sqlite3_free(err);
+    return false;
+  }
+  if (changes)
+    *changes += sqlite3_changes(db);
+  return true;
+}
+
+inline long long MaintainPragma(sqlite3 *db, const char *pragma) {
+  sqlite3_stmt *stmt;
+  long long v = -1;
+  if (sqlite3_prepare_v2(db, pragma, -1, &stmt, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    return -1;
+  }
+  if (sqlite3_step(stmt) == SQLITE_ROW)
+    v = sqlite3_column_int64(stmt, 0);
+  sqlite3_finalize(stmt);
+  return v;
+}
+
+inline bool InScope(const MaintainScope &scope, int id, int stl) {
+  if (scope.stl && stl != scope.stl)
+    return false;
+  return id <= scope.last_cam ||
+         (scope.own && std::find(scope.own->begin(), scope.own->end(), id) !=
+                           scope.own->end());
+}
+
+// whether picks_cam, which `compact` and gendb create, finds a camera's picks
+inline bool HasPicksCamIndex(sqlite3 *db) {
+  return MaintainPragma(db, "SELECT COUNT(*) FROM sqlite_master WHERE "
+                            "name = 'picks_cam';") > 0;
+}
+
+typedef struct MaintainCam {
+  int id, stl, proj, attachment;
+  double v[10]; // posx, posy, posz, tx, ty, tz, upx, upy, upz, fovy
+} MaintainCam;
+
+inline bool SameCam(const MaintainCam &a, const MaintainCam &b) {
+  if (a.stl != b.stl || a.proj != b.proj || a.attachment != b.attachment)
+    return false;
+  for (int k = 0; k < 10; k++)
+    if (fabs(a.v[k] - b.v[k]) > MAINTAIN_CAM_EPS)
+      return false;
+  return true;
+}
+
+// group the near-identical cameras in scope, each into keep_cam when it is
+// one of them and into the oldest otherwise
+inline bool PlanMerges(sqlite3 *db, const MaintainScope &scope,
+                       MaintainWork *w) {
+  sqlite3_stmt *stmt;
+  const char *sql = "SELECT rowid, stl, proj, attachment, posx, posy, posz, "
+                    "tx, ty, tz, upx, upy, upz, fovy FROM cams "
+                    "WHERE ?1 = 0 OR stl = ?1;";
+  if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    return false;
+  }
+  sqlite3_bind_int(stmt, 1, scope.stl);
+  std::vector<MaintainCam> cams;
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    MaintainCam c = {.id = sqlite3_column_int(stmt, 0),
+                     .stl = sqlite3_column_int(stmt, 1),
+                     .proj = sqlite3_column_int(stmt, 2),
+                     .attachment = sqlite3_column_int(stmt, 3)};
+    if (!InScope(scope, c.id, c.stl))
+      continue;
+    for (int k = 0; k < 10; k++)
+      c.v[k] = sqlite3_column_double(stmt, 4 + k);
+    cams.push_back(c);
+  }
+  sqlite3_finalize(stmt);
+
+  // sorted on posx, a camera's duplicates follow it within MAINTAIN_CAM_EPS
+  std::sort(cams.begin(), cams.end(),
+            [](const MaintainCam &a, const MaintainCam &b) {
+              return a.v[0] < b.v[0] || (a.v[0] == b.v[0] && a.id < b.id);
+            });
+  std::vector<bool> taken(cams.size());
+  for (size_t i = 0; i < cams.size(); i++) {
+    if (taken[i])
+      continue;
+    std::vector<int> group = {cams[i].id};
+    for (size_t j = i + 1;
+         j < cams.size() && cams[j].v[0] - cams[i].v[0] <= MAINTAIN_CAM_EPS;
+         j++)
+      if (!taken[j] && SameCam(cams[i], cams[j])) {
+        taken[j] = true;
+        group.push_back(cams[j].id);
+      }
+    if (group.size() < 2)
+      continue;
+    int keep =
+        std::find(group.begin(), group.end(), scope.keep_cam) != group.end()
+            ? scope.keep_cam
+            : *std::min_element(group.begin(), group.end());
+    for (int id : group)
+      if (id != keep)
+        w->merges.emplace_back(id, keep);
+  }
+  return true;
+}
+
+// the cameras in scope without picks, but for keep_cam and the first of
+// every STL
+inline bool PlanEmpty(sqlite3 *db, const MaintainScope &scope,
+                      MaintainWork *w) {
+  sqlite3_stmt *stmt;
+  const char *sql =
+      "SELECT rowid, stl FROM cams WHERE (?1 = 0 OR stl = ?1) AND rowid <> ?2 "
+      "AND rowid NOT IN (SELECT MIN(rowid) FROM cams GROUP BY stl) "
+      "AND NOT EXISTS (SELECT 1 FROM picks WHERE picks.cam = cams.rowid);";
+  if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    return false;
+  }
+  sqlite3_bind_int(stmt, 1, scope.stl);
+  sqlite3_bind_int(stmt, 2, scope.keep_cam);
+  while (sqlite3_step(stmt) == SQLITE_ROW)
+    if (InScope(scope, sqlite3_column_int(stmt, 0),
+                sqlite3_column_int(stmt, 1)))
+      w->empty.push_back(sqlite3_column_int(stmt, 0));
+  sqlite3_finalize(stmt);
+  return true;
+}
+
+// carry out up to rows of the planned merges in one transaction, planning
+// them first on the pass's first call. *done once none are left, or at once
+// without the picks_cam index.
+inline bool MergeDuplicateCams(sqlite3 *db, const MaintainScope &scope,
+                               MaintainWork *w, int rows, MaintainStats *st,
+                               bool *done) {
+  if (!w->planned) {
+    if (HasPicksCamIndex(db) && !PlanMerges(db, scope, w))
+      return false;
+    w->planned = true;
+  }
+  size_t end = std::min(w->merges.size(), w->next + (size_t)rows);
+  *done = end == w->merges.size();
+  if (w->next == end)
+    return true;
+
+  sqlite3_stmt *move = NULL, *del = NULL;
+  if (sqlite3_prepare_v2(db, "UPDATE picks SET cam = ? WHERE cam = ?;", -1,
+                         &move, NULL) != SQLITE_OK ||
+      sqlite3_prepare_v2(db, "DELETE FROM cams WHERE rowid = ?;", -1, &del,
+                         NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    sqlite3_finalize(move);
+    sqlite3_finalize(del);
+    return false;
+  }
+  if (!MaintainExec(db, "BEGIN;")) {
+    sqlite3_finalize(move);
+    sqlite3_finalize(del);
+    return false;
+  }
+  bool ok = true;
+  int moved = 0;
+  for (size_t i = w->next; ok && i < end; i++) {
+    sqlite3_reset(move);
+    sqlite3_reset(del);
+    sqlite3_bind_int(move, 1, w->merges[i].second);
+    sqlite3_bind_int(move, 2, w->merges[i].first);
+    sqlite3_bind_int(del, 1, w->merges[i].first);
+    ok = sqlite3_step(move) == SQLITE_DONE;
+    moved += sqlite3_changes(db);
+    ok = ok && sqlite3_step(del) == SQLITE_DONE;
+  }
+  if (!ok)
+    printf("Merging cameras failed: %s\n", sqlite3_errmsg(db));
+  ok = MaintainExec(db, ok ? "COMMIT;" : "ROLLBACK;") && ok;
+  sqlite3_finalize(move);
+  sqlite3_finalize(del);
+  if (ok) {
+    st->cams_merged += (int)(end - w->next);
+    st->picks_moved += moved;
+    w->next = end;
+  }
+  return ok;
+}
+
+// delete up to rows of the planned empty cameras, as MergeDuplicateCams. A
+// camera picked through since the plan was made stays.
+inline bool RemoveEmptyCams(sqlite3 *db, const MaintainScope &scope,
+                            MaintainWork *w, int rows, MaintainStats *st,
+                            bool *done) {
+  if (!w->planned) {
+    if (HasPicksCamIndex(db) && !PlanEmpty(db, scope, w))
+      return false;
+    w->planned = true;
+  }
+  size_t end = std::min(w->empty.size(), w->next + (size_t)rows);
+  *done = end == w->empty.size();
+  if (w->next == end)
+    return true;
+
+  sqlite3_stmt *del;
+  const char *sql = "DELETE FROM cams WHERE rowid = ?1 AND NOT EXISTS "
+                    "(SELECT 1 FROM picks WHERE picks.cam = ?1);";
+  if (sqlite3_prepare_v2(db, sql, -1, &del, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    sqlite3_finalize(del);
+    return false;
+  }
+  if (!MaintainExec(db, "BEGIN;")) {
+    sqlite3_finalize(del);
+    return false;
+  }
+  bool ok = true;
+  int removed = 0;
+  for (size_t i = w->next; ok && i < end; i++) {
+    sqlite3_reset(del);
+    sqlite3_bind_int(del, 1, w->empty[i]);
+    ok = sqlite3_step(del) == SQLITE_DONE;
+    removed += sqlite3_changes(db);
+  }
+  if (!ok)
+    printf("Removing cameras failed: %s\n", sqlite3_errmsg(db));
+  ok = MaintainExec(db, ok ? "COMMIT;" : "ROLLBACK;") && ok;
+  sqlite3_finalize(del);
+  if (ok) {
+    st->cams_removed += removed;
+    w->next = end;
+  }
+  return ok;
+}
+
+inline bool PruneCacheStep(sqlite3 *db, MaintainStats *st) {
+  // only where a replay has created it
+  if (MaintainPragma(db, "SELECT COUNT(*) FROM sqlite_master WHERE "
+                         "name = 'replay_cache';") <= 0)
+    return true;
+  if (!PruneReplayCache(db))
+    return false;
+  st->cache_pruned += sqlite3_changes(db);
+  return true;
+}
+
+// free up to pages pages; *done once the freelist is empty or cannot shrink
+inline bool VacuumStep(sqlite3 *db, int pages, MaintainStats *st, bool *done) {
+  long long size = MaintainPragma(db, "PRAGMA page_size;");
+  long long before = MaintainPragma(db, "PRAGMA page_count;");
+  long long free_pages = MaintainPragma(db, "PRAGMA freelist_count;");
+  if (size < 0 || before < 0 || free_pages < 0)
+    return false;
+  if (MaintainPragma(db, "PRAGMA auto_vacuum;") != 2) {
+    st->free_pages = (int)free_pages;
+    *done = true;
+    return true;
+  }
+  std::string sql = "PRAGMA incremental_vacuum(" + std::to_string(pages) + ");";
+  if (free_pages > 0 && !MaintainExec(db, sql.c_str()))
+    return false;
+  long long after = MaintainPragma(db, "PRAGMA page_count;");
+  st->bytes_reclaimed += (before - after) * size;
+  st->free_pages = (int)MaintainPragma(db, "PRAGMA freelist_count;");
+  *done = st->free_pages == 0 || after == before;
+  return true;
+}
+
+// run step, up to rows cameras of it; false on an SQL error. *done once the
+// step has nothing left, which also drops its work.
+inline bool MaintainStep(sqlite3 *db, int step, const MaintainScope &scope,
+                         MaintainWork *w, int rows, MaintainStats *st,
+                         bool *done) {
+  *done = true;
+  bool ok = true;
+  switch (step) {
+  case MAINTAIN_DEDUPE:
+    ok = MergeDuplicateCams(db, scope, w, rows, st, done);
+    break;
+  case MAINTAIN_EMPTY:
+    ok = RemoveEmptyCams(db, scope, w, rows, st, done);
+    break;
+  case MAINTAIN_CACHE:
+    ok = PruneCacheStep(db, st);
+    break;
+  case MAINTAIN_VACUUM:
+    ok = VacuumStep(db, MAINTAIN_VACUUM_PAGES, st, done);
+    break;
+  }
+  if (!ok || *done)
+    *w = MaintainWork{};
+  return ok;
+}
+
+inline void PrintMaintainStats(const char *what, const MaintainStats &st) {
+  printf("%s: merged %d duplicate cameras (%d picks moved), removed %d "
+         "empty cameras, pruned %d replay cache rows, reclaimed %lld bytes",
+         what, st.cams_merged, st.picks_moved, st.cams_removed,
+         st.cache_pruned, st.bytes_reclaimed);
+  if (st.free_pages)
+    printf(", %d free pages left (run `compact` for incremental vacuum)",
+           st.free_pages);
+  printf("\n");
+}
+
+// the columns of table, quoted and comma separated
+inline std::string MaintainColumns(sqlite3 *db, const char *table) {
+  sqlite3_stmt *stmt;
+  std::string cols;
+  sqlite3_prepare_v2(db, "SELECT name FROM pragma_table_info(?);", -1, &stmt,
+                     NULL);
+  sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    char *q = sqlite3_mprintf("%s\"%w\"", cols.empty() ? "" : ", ",
+                              sqlite3_column_text(stmt, 0));
+    cols += q;
+    sqlite3_free(q);
+  }
+  sqlite3_finalize(stmt);
+  return cols;
+}
+
+// copy db into a fresh file with auto_vacuum = INCREMENTAL and put it in place
+// of path. VACUUM would do that too, but it may renumber the rowids that
+// picks.cam, cams.stl and stldescs.stl refer to, so this copies them.
+// Virtual tables are copied through their module, which fills their shadow
+// tables. Nothing else may have the database open.
+inline bool EnableIncrementalVacuum(sqlite3 **db, const char *path,
+                                    MaintainStats *st) {
+  std::string tmp = std::string(path) + ".compact";
+  unlink(tmp.c_str());
+  long long size = MaintainPragma(*db, "PRAGMA page_size;");
+  long long before = MaintainPragma(*db, "PRAGMA page_count;");
+
+  // tables with their copy statements first, then indexes, triggers and
+  // views over the copied rows
+  std::vector<std::string> schema, copy;
+  sqlite3_stmt *stmt;
+  const char *sql =
+      "SELECT m.type, l.type, l.wr, m.name, m.sql FROM sqlite_master m "
+      "LEFT JOIN pragma_table_list l ON l.schema = 'main' AND l.name = m.name "
+      "WHERE m.sql IS NOT NULL AND m.name NOT LIKE 'sqlite_%' "
+      "ORDER BY m.type <> 'table';";
+  if (sqlite3_prepare_v2(*db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(*db));
+    return false;
+  }
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    const char *kind = (const char *)sqlite3_column_text(stmt, 1);
+    const char *name = (const char *)sqlite3_column_text(stmt, 3);
+    if (kind && strcmp(kind, "shadow") == 0)
+      continue;
+    schema.push_back((const char *)sqlite3_column_text(stmt, 4));
+    if (strcmp((const char *)sqlite3_column_text(stmt, 0), "table") != 0)
+      continue;
+    char *c;
+    if (kind && strcmp(kind, "table") == 0 && !sqlite3_column_int(stmt, 2)) {
+      std::string cols = MaintainColumns(*db, name);
+      c = sqlite3_mprintf("INSERT INTO main.\"%w\" (rowid, %s) SELECT rowid, "
+                          "%s FROM old.\"%w\";",
+                          name, cols.c_str(), cols.c_str(), name);
+    } else {
+      c = sqlite3_mprintf("INSERT INTO main.\"%w\" SELECT * FROM old.\"%w\";",
+                          name, name);
+    }
+    copy.push_back(c);
+    sqlite3_free(c);
+  }
+  sqlite3_finalize(stmt);
+
+  sqlite3 *fresh;
+  char *attach = sqlite3_mprintf("ATTACH %Q AS old;", path);
+  bool ok = InitDatabase(tmp.c_str(), &fresh) &&
+            MaintainExec(fresh, "PRAGMA auto_vacuum = INCREMENTAL;") &&
+            MaintainExec(fresh, attach) && MaintainExec(fresh, "BEGIN;");
+  sqlite3_free(attach);
+  for (size_t i = 0; ok && i < schema.size(); i++) {
+    ok = MaintainExec(fresh, schema[i].c_str());
+    if (ok && i < copy.size())
+      ok = MaintainExec(fresh, copy[i].c_str());
+  }
+  ok = MaintainExec(fresh, ok ? "COMMIT;" : "ROLLBACK;") && ok;
+  sqlite3_close(fresh);
+  if (!ok) {
+    unlink(tmp.c_str());
+    return false;
+  }
+
+  sqlite3_close(*db);
+  *db = NULL;
+  if (rename(tmp.c_str(), path) != 0) {
+    printf("Cannot replace %s: %s\n", path, strerror(errno));
+    InitDatabase(path, db);
+    return false;
+  }
+  if (!InitDatabase(path, db))
+    return false;
+  st->bytes_reclaimed +=
+      (before - MaintainPragma(*db, "PRAGMA page_count;")) * size;
+  return true;
+}
+
+// the `compact` subcommand: a whole pass over every STL at once, after
+// switching the database at path to incremental auto_vacuum if it is not yet
+inline bool CompactDatabase(sqlite3 **db, const char *path, int keep_cam,
+                            MaintainStats *st) {
+  MaintainScope scope = {.keep_cam = keep_cam};
+  MaintainWork w;
+  if (!MaintainExec(*db, "CREATE INDEX IF NOT EXISTS picks_cam ON "
+                         "picks(cam);"))
+    return false;
+  for (int step = MAINTAIN_DEDUPE; step < MAINTAIN_VACUUM; step++) {
+    bool done;
+    if (!MaintainStep(*db, step, scope, &w, INT_MAX, st, &done))
+      return false;
+  }
+  if (MaintainPragma(*db, "PRAGMA auto_vacuum;") != 2 &&
+      !EnableIncrementalVacuum(db, path, st))
+    return false;
+  for (bool done = false; !done;)
+    if (!VacuumStep(*db, 1 << 20, st, &done))
+      return false;
+  return true;
+}
+
+// once per frame while the model is loaded; a step only runs once the viewer
+// has been idle for MAINTAIN_IDLE_SECONDS
+inline void PollMaintenance(Maintenance *m, PickerContext *ctx, double now) {
+  Vector2 delta = GetMouseDelta();
+  bool active = delta.x != 0 || delta.y != 0 || GetMouseWheelMove() != 0 ||
+                IsMouseButtonDown(MOUSE_BUTTON_LEFT) ||
+                IsMouseButtonDown(MOUSE_BUTTON_MIDDLE) ||
+                IsMouseButtonDown(MOUSE_BUTTON_RIGHT) ||
+                m->writes != ctx->writes || m->cameraid != ctx->cameraid ||
+                m->camdirty != ctx->camdirty;
+  if (m->last_cam < 0)
+    m->last_cam = (int)MaintainPragma(ctx->db, "SELECT MAX(rowid) FROM cams;");
+  if (m->writes != ctx->writes || m->cameraid != ctx->cameraid)
+    m->work = MaintainWork{}; // its plan may be stale: the step starts over
+  if (m->writes != ctx->writes && m->step == MAINTAIN_DONE)
+    m->next_pass = 0; // new rows: worth a pass once idle
+  m->writes = ctx->writes;
+  m->cameraid = ctx->cameraid;
+  m->camdirty = ctx->camdirty;
+  if (active)
+    m->idle_since = now;
+  if (now - m->idle_since < MAINTAIN_IDLE_SECONDS)
+    return;
+  if (m->step == MAINTAIN_DONE) {
+    if (now < m->next_pass)
+      return;
+    m->step = MAINTAIN_DEDUPE;
+    m->pass = (MaintainStats){};
+  }
+
+  MaintainStats before = m->pass;
+  bool done;
+  MaintainScope scope = {.stl = ctx->selected_stl_id,
+                         .last_cam = m->last_cam,
+                         .own = &ctx->new_cams,
+                         .keep_cam = ctx->cameraid};
+  if (!MaintainStep(ctx->db, m->step, scope, &m->work, MAINTAIN_CAM_ROWS,
+                    &m->pass, &done)) {
+    m->step = MAINTAIN_DONE; // try again next interval
+    m->next_pass = now + MAINTAIN_INTERVAL_SECONDS;
+    return;
+  }
+  if (m->pass.cams_merged != before.cams_merged ||
+      m->pass.cams_removed != before.cams_removed) {
+    // picks may be on other cameras now; the thumbnails and reloads in
+    // flight see the rows changed through writes
+    LoadPicksFromDB(ctx, ctx->selected_stl_id);
+    m->writes = ++ctx->writes;
+  }
+  if (done && ++m->step == MAINTAIN_DONE) {
+    m->next_pass = now + MAINTAIN_INTERVAL_SECONDS;
+    MaintainStats &t = m->total, &p = m->pass;
+    t.cams_merged += p.cams_merged;
+    t.picks_moved += p.picks_moved;
+    t.cams_removed += p.cams_removed;
+    t.cache_pruned += p.cache_pruned;
+    t.bytes_reclaimed += p.bytes_reclaimed;
+    t.free_pages = p.free_pages;
+    if (p.cams_merged || p.cams_removed || p.cache_pruned ||
+        p.bytes_reclaimed)
+      PrintMaintainStats("maintenance", t);
+  }
+}
+#define MAINTAIN_ONCE
+#endif
@@ -0,0 +1,113 @@
+#ifndef RAYGEN_ONCE
+#include "main.h"
+#include "rlgl.h"
+
+// GetScreenToWorldRayEx rebuilds the view and projection matrices and inverts
+// their product on every call. A RayGen does that once per camera and screen
+// size. After that a ray costs two multiply-adds of 4-vectors and a
+// normalize, and a grid of rays only additions. Its rays are raylib's up to
+// float rounding.
+
+typedef struct RayGen {
+  Camera3D camera;
+  int width, height;
+  // columns of the inverse view-projection: screen (x, y, z) unprojects to
+  // col[0] x + col[1] y + col[2] z + col[3], divided by its w
+  double col[4][4];
+} RayGen;
+
+inline RayGen MakeRayGen(Camera3D cam, int width, int height) {
+  RayGen g = {.camera = cam, .width = width, .height = height};
+  Matrix view = MatrixLookAt(cam.position, cam.target, cam.up);
+  Matrix proj = MatrixIdentity();
+  double aspect = (double)width / (double)height;
+  if (cam.projection == CAMERA_PERSPECTIVE) {
+    proj = MatrixPerspective(cam.fovy * DEG2RAD, aspect, RL_CULL_DISTANCE_NEAR,
+                             RL_CULL_DISTANCE_FAR);
+  } else if (cam.projection == CAMERA_ORTHOGRAPHIC) {
+    double top = cam.fovy / 2.0, right = top * aspect;
+    proj = MatrixOrtho(-right, right, -top, top, 0.01, 1000.0);
+  }
+  // as Vector3Unproject applies it, through QuaternionTransform
+  float16 m = MatrixToFloatV(MatrixInvert(MatrixMultiply(view, proj)));
+  for (int c = 0; c < 4; c++)
+    for (int r = 0; r < 4; r++)
+      g.col[c][r] = m.v[4 * c + r];
+  return g;
+}
+
+// whether g still describes cam on a width x height screen
+inline bool RayGenMatches(const RayGen &g, const Camera3D &cam, int width,
+                          int height) {
+  return g.width == width && g.height == height &&
+         memcmp(&g.camera, &cam, sizeof cam) == 0;
+}
+
+// g, rebuilt first if the camera or the screen changed since
+inline const RayGen &CachedRayGen(RayGen *g, const Camera3D &cam, int width,
+                                  int height) {
+  if (!RayGenMatches(*g, cam, width, height))
+    *g = MakeRayGen(cam, width, height);
+  return *g;
+}
+
+// screen position to homogeneous point on the near plane (z = 0)
+inline void RayGenBase(const RayGen &g, Vector2 pixel, double h[4]) {
+  double x = 2.0 * pixel.x / g.width - 1.0;
+  double y = 1.0 - 2.0 * pixel.y / g.height;
+  for (int r = 0; r < 4; r++)
+    h[r] = g.col[0][r] * x + g.col[1][r] * y + g.col[3][r];
+}
+
+inline Ray RayGenFromBase(const RayGen &g, const double h[4]) {
+  double fw = h[3] + g.col[2][3], d[3];
+  for (int r = 0; r < 3; r++)
+    d[r] = (h[r] + g.col[2][r]) / fw - h[r] / h[3];
+  Ray ray;
+  ray.direction = Vector3Normalize((Vector3){(float)d[0], (float)d[1],
+                                             (float)d[2]});
+  if (g.camera.projection == CAMERA_ORTHOGRAPHIC) {
+    double cw = h[3] - g.col[2][3]; // z = -1, where raylib starts ortho rays
+    ray.position = (Vector3){(float)((h[0] - g.col[2][0]) / cw),
+                             (float)((h[1] - g.col[2][1]) / cw),
+                             (float)((h[2] - g.col[2][2]) / cw)};
+  } else {
+    ray.position = g.camera.position;
+  }
+  return ray;
+}
+
+// GetScreenToWorldRayEx(pixel, g.camera, g.width, g.height)
+inline Ray RayGenRay(const RayGen &g, Vector2 pixel) {
+  double h[4];
+  RayGenBase(g, pixel, h);
+  return RayGenFromBase(g, h);
+}
+
+// rays through origin + i dx + j dy for i < nx, j < ny, row by row into out.
+// Coherent tiles for GetRayCollisionBvhPacket.
+inline void RayGenGrid(const RayGen &g, Vector2 origin, Vector2 dx, Vector2 dy,
+                       int nx, int ny, Ray *out) {
+  double h[4], hx[4], hy[4];
+  RayGenBase(g, origin, h);
+  RayGenBase(g, origin + dx, hx);
+  RayGenBase(g, origin + dy, hy);
+  // the map is affine in the pixel, so a step is a constant 4-vector
+  for (int r = 0; r < 4; r++) {
+    hx[r] -= h[r];
+    hy[r] -= h[r];
+  }
+  for (int j = 0; j < ny; j++) {
+    double row[4];
+    for (int r = 0; r < 4; r++)
+      row[r] = h[r] + j * hy[r];
+    for (int i = 0; i < nx; i++) {
+      double p[4];
+      for (int r = 0; r < 4; r++)
+        p[r] = row[r] + i * hx[r];
+      out[j * nx + i] = RayGenFromBase(g, p);
+    }
+  }
+}
+#define RAYGEN_ONCE
+#endif
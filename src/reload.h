@@ -0,0 +1,194 @@
+#ifndef RELOAD_ONCE
+#include "compact.h"
+#include "context.h"
+#include "initdb.h"
+#include "main.h"
+#include <atomic>
+#include <thread>
+
+// Hot reload for rows written by other processes while the viewer is open.
+// PRAGMA data_version only moves when another connection commits, so polling
+// it costs one tiny query. On a change a worker thread reads the picks, the
+// current camera and, if stls.hash moved, the re-parsed STL with its picking
+// structures into a staging context on its own connection. The render thread
+// swaps the result in between two frames.
+
+#define RELOAD_POLL_SECONDS 0.5
+
+typedef struct HotReload {
+  std::thread worker;
+  std::atomic<bool> done{false};
+  bool busy = false;
+  double last_poll = 0;
+  long long data_version = -1;
+
+  // what the viewer looked like when the worker started
+  int stl_id, cam_id, writes;
+  std::string stl_hash;
+  int newer_stl = 0; // latest revision of the same module, as last announced
+
+  PickerContext *staging = NULL;
+  Mesh mesh = {0};           // the new STL in staging->arena, when mesh_changed
+  bool mesh_changed = false;
+  bool cam_found = false;
+  int latest_stl = 0;
+  bool ok = false;
+
+  // the replaced model's memory, handed to the next staging context so
+  // reloading a part of the same size allocates nothing
+  ModelArena spare = {0};
+} HotReload;
+
+inline bool ReadDataVersion(sqlite3 *db, long long *version) {
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(db, "PRAGMA data_version;", -1, &stmt, NULL) !=
+      SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    return false;
+  }
+  bool ok = sqlite3_step(stmt) == SQLITE_ROW;
+  if (ok)
+    *version = sqlite3_column_int64(stmt, 0);
+  sqlite3_finalize(stmt);
+  return ok;
+}
+
+// the highest stl rowid sharing stldescs.module with stl_id
+inline int ReadLatestRevision(sqlite3 *db, int stl_id) {
+  sqlite3_stmt *stmt;
+  const char *sql = "SELECT MAX(b.stl) FROM stldescs a "
+                    "JOIN stldescs b ON a.module = b.module WHERE a.stl = ?;";
+  if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    return 0;
+  }
+  sqlite3_bind_int(stmt, 1, stl_id);
+  int latest = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0)
+                                                : 0;
+  sqlite3_finalize(stmt);
+  return latest;
+}
+
+// the worker half: no GL, only the staging context and its own connection
+inline void ReadReload(HotReload *r, const char *db_path) {
+  PickerContext *s = r->staging;
+  s->db_path = db_path;
+  s->selected_stl_id = r->stl_id;
+  r->ok = sqlite3_open_v2(db_path, &s->db, SQLITE_OPEN_READONLY, NULL) ==
+          SQLITE_OK;
+  if (r->ok) {
+    sqlite3_busy_timeout(s->db, 1000);
+    r->ok = ReadSTLHash(s->db, r->stl_id, &s->stl_hash);
+  }
+  r->mesh_changed = r->ok && s->stl_hash != r->stl_hash;
+  if (r->mesh_changed) {
+    r->ok = ReadSTLFromDB(s->db, r->stl_id, &r->mesh, &s->tri_order,
+                          &s->arena);
+    if (r->ok)
+      BuildPickingStructures(s, r->mesh);
+  }
+  r->ok = r->ok && LoadPicksFromDB(s, r->stl_id);
+  r->cam_found = r->ok && ReadCamera(s->db, r->cam_id, &s->camera,
+                                     &s->cameraattachment, NULL);
+  r->latest_stl = r->ok ? ReadLatestRevision(s->db, r->stl_id) : 0;
+  sqlite3_close(s->db);
+  s->db = NULL;
+}
+
+inline void StartReload(HotReload *r, const PickerContext *ctx) {
+  r->stl_id = ctx->selected_stl_id;
+  r->cam_id = ctx->cameraid;
+  r->writes = ctx->writes;
+  r->stl_hash = ctx->stl_hash;
+  r->staging = new PickerContext();
+  std::swap(r->staging->arena, r->spare);
+  r->mesh = (Mesh){0};
+  r->done = false;
+  r->busy = true;
+  const char *db_path = ctx->db_path;
+  r->worker = std::thread([r, db_path] {
+    ReadReload(r, db_path);
+    r->done = true;
+  });
+}
+
+// the render thread half: swap the staged model, picks and camera into ctx
+inline void ApplyReload(HotReload *r, PickerContext *ctx) {
+  PickerContext *s = r->staging;
+  if (r->ok && r->mesh_changed && ctx->selected_stl_id == r->stl_id) {
+    // the whole model changes hands with its arena; the old one goes back
+    // with the staging context
+    SwapModel(ctx, s);
+    UnloadModelGpu(&ctx->gpu);
+    UploadModel(ctx, r->mesh);
+    printf("Reloaded stl %d (hash %s)\n", r->stl_id, ctx->stl_hash.c_str());
+  }
+
+  // picks or cameras the viewer wrote since the worker started would be lost
+  // by the swap, so read again instead
+  if (r->ok && ctx->writes == r->writes) {
+    memcpy(ctx->picksid, s->picksid, s->npicks * sizeof(int));
+    memcpy(ctx->picks2cam, s->picks2cam, s->npicks * sizeof(int));
+    memcpy(ctx->picks2, s->picks2, s->npicks * sizeof(Vector2));
+    memcpy(ctx->picks, s->picks, s->npicks * sizeof(Vector3));
+    ctx->npicks = s->npicks;
+    if (r->cam_found && !ctx->camdirty && ctx->cameraid == r->cam_id) {
+      ctx->camera = s->camera;
+      ctx->cameraattachment = s->cameraattachment;
+    }
+  } else {
+    r->data_version = -1;
+  }
+
+  // a new revision is a new stls row; say so once, switching is up to the user
+  if (r->ok && r->latest_stl > r->stl_id && r->latest_stl != r->newer_stl) {
+    r->newer_stl = r->latest_stl;
+    printf("stl %d is a newer revision of stl %d\n", r->newer_stl, r->stl_id);
+  }
+
+  r->mesh = (Mesh){0};
+  ArenaReset(&s->arena);
+  std::swap(r->spare, s->arena);
+  UnloadPickerContext(s);
+  delete s;
+  r->staging = NULL;
+}
+
+// once per frame: collect a finished reload, or every RELOAD_POLL_SECONDS
+// start one if another connection has committed since the last look
+inline void PollReload(HotReload *r, PickerContext *ctx, double now) {
+  if (r->busy) {
+    if (!r->done)
+      return;
+    r->worker.join();
+    r->busy = false;
+    ApplyReload(r, ctx);
+    return;
+  }
+  if (now - r->last_poll < RELOAD_POLL_SECONDS)
+    return;
+  r->last_poll = now;
+
+  // data_version starts at -1, so the first poll also catches commits made
+  // while the viewer was starting up
+  long long version;
+  if (!ReadDataVersion(ctx->db, &version) || version == r->data_version)
+    return;
+  r->data_version = version;
+  StartReload(r, ctx);
+}
+
+inline void StopReload(HotReload *r) {
+  if (r->busy) {
+    r->worker.join();
+    r->busy = false;
+  }
+  if (r->staging) {
+    UnloadPickerContext(r->staging);
+    delete r->staging;
+    r->staging = NULL;
+  }
+  ArenaRelease(&r->spare);
+}
+#define RELOAD_ONCE
+#endif
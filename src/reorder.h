@@ -0,0 +1,78 @@
+#ifndef REORDER_ONCE
+#include "arena.h"
+#include "main.h"
+#include <algorithm>
+
+// Triangles arrive in whatever order the CAD exporter wrote them. Sorting
+// them along a Z-order curve through their centroids puts triangles that are
+// close in space close in memory, so BVH leaves and adjacency walks touch
+// fewer cache lines and the GPU rasterizes in spatially coherent batches.
+
+// spread the low 10 bits of v so two zero bits follow each
+inline uint32_t ExpandBits10(uint32_t v) {
+  v = (v * 0x00010001u) & 0xFF0000FFu;
+  v = (v * 0x00000101u) & 0x0F00F00Fu;
+  v = (v * 0x00000011u) & 0xC30C30C3u;
+  v = (v * 0x00000005u) & 0x49249249u;
+  return v;
+}
+
+// 30 bit Morton code of p on a 1024^3 grid over b
+inline uint32_t MortonCode(Vector3 p, BoundingBox b) {
+  Vector3 size = b.max - b.min;
+  uint32_t q[3];
+  for (int i = 0; i < 3; i++) {
+    float s = (&size.x)[i];
+    float u = s > 0 ? ((&p.x)[i] - (&b.min.x)[i]) / s : 0;
+    q[i] = (uint32_t)Clamp(u * 1024.f, 0.f, 1023.f);
+  }
+  return ExpandBits10(q[0]) | ExpandBits10(q[1]) << 1 |
+         ExpandBits10(q[2]) << 2;
+}
+
+// reorder the triangles of a CPU-side mesh (as from ParseSTL) by the Morton
+// code of their centroids, in place. Returns the permutation, from arena when
+// given and malloc'd otherwise: triangle t of the sorted mesh was triangle
+// order[t] in stls.data.
+inline int *SortTrianglesMorton(Mesh *mesh, ModelArena *arena = NULL) {
+  int n = mesh->triangleCount;
+  const float *v = mesh->vertices;
+  int *order = (int *)ModelAlloc(arena, n * sizeof(int));
+  ArenaMark mark = arena ? ArenaGetMark(arena) : (ArenaMark){0};
+
+  Vector3 *centroid = (Vector3 *)ModelAlloc(arena, n * sizeof(Vector3));
+  BoundingBox b = {{INFINITY, INFINITY, INFINITY},
+                   {-INFINITY, -INFINITY, -INFINITY}};
+  for (int t = 0; t < n; t++) {
+    const float *p = v + 9 * t;
+    centroid[t] = (Vector3){(p[0] + p[3] + p[6]) / 3, (p[1] + p[4] + p[7]) / 3,
+                            (p[2] + p[5] + p[8]) / 3};
+    b.min = Vector3Min(b.min, centroid[t]);
+    b.max = Vector3Max(b.max, centroid[t]);
+  }
+
+  // code in the high half, original index in the low half: one sort, and
+  // ties keep their exporter order
+  uint64_t *key = (uint64_t *)ModelAlloc(arena, n * sizeof(uint64_t));
+  for (int t = 0; t < n; t++)
+    key[t] = (uint64_t)MortonCode(centroid[t], b) << 32 | (uint32_t)t;
+  std::sort(key, key + n);
+
+  // permute through a copy of the parsed arrays
+  float *copy = (float *)ModelAlloc(arena, n * 18 * sizeof(float));
+  memcpy(copy, mesh->vertices, n * 9 * sizeof(float));
+  memcpy(copy + n * 9, mesh->normals, n * 9 * sizeof(float));
+  for (int t = 0; t < n; t++) {
+    int from = order[t] = (int)(uint32_t)key[t];
+    memcpy(mesh->vertices + 9 * t, copy + 9 * from, 9 * sizeof(float));
+    memcpy(mesh->normals + 9 * t, copy + 9 * (n + from), 9 * sizeof(float));
+  }
+  ScratchFree(arena, centroid);
+  ScratchFree(arena, key);
+  ScratchFree(arena, copy);
+  if (arena)
+    ArenaRewind(arena, mark);
+  return order;
+}
+#define REORDER_ONCE
+#endif
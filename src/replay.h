@@ -0,0 +1,286 @@
+#ifndef REPLAY_ONCE
+#include "bvh.h"
+#include "initdb.h"
+#include "main.h"
+#include "raygen.h"
+#include <string>
+#include <vector>
+
+// A stored pick and where its screen position lands on another mesh when cast
+// again from the same camera
+typedef struct ReplayPick {
+  int pick; // picks.rowid
+  int cam;
+  Vector2 m;  // picks.mx, picks.my
+  Vector3 old; // picks.x, picks.y, picks.z
+  bool hit;
+  Vector3 point;
+  int tri;
+  bool cached; // hit, point and tri came from replay_cache
+} ReplayPick;
+
+// all picks of cameras on stl_id, ordered by camera. Returns the number of
+// picks (*out is malloc'd) or -1 on error
+inline int LoadReplayPicks(sqlite3 *db, int stl_id, ReplayPick **out) {
+  sqlite3_stmt *stmt;
+  const char *sql = "SELECT picks.rowid, picks.cam, picks.mx, picks.my, "
+                    "picks.x, picks.y, picks.z "
+                    "FROM picks "
+                    "INNER JOIN cams ON picks.cam = cams.rowid "
+                    "WHERE cams.stl = ? ORDER BY picks.cam, picks.rowid;";
+  int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+  if (rc != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    return -1;
+  }
+  sqlite3_bind_int(stmt, 1, stl_id);
+
+  int n = 0, cap = 64;
+  ReplayPick *p = (ReplayPick *)malloc(cap * sizeof(ReplayPick));
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    if (n == cap)
+      p = (ReplayPick *)realloc(p, (cap *= 2) * sizeof(ReplayPick));
+    p[n] = (ReplayPick){
+        .pick = sqlite3_column_int(stmt, 0),
+        .cam = sqlite3_column_int(stmt, 1),
+        .m = {(float)sqlite3_column_double(stmt, 2),
+              (float)sqlite3_column_double(stmt, 3)},
+        .old = {(float)sqlite3_column_double(stmt, 4),
+                (float)sqlite3_column_double(stmt, 5),
+                (float)sqlite3_column_double(stmt, 6)},
+        .tri = -1};
+    n++;
+  }
+  sqlite3_finalize(stmt);
+  *out = p;
+  return n;
+}
+
+// cast every pick from its own camera onto mesh: one RayGen per camera, and
+// each camera's picks in packets
+inline bool ReplayPicks(sqlite3 *db, const Mesh &mesh, const Bvh &bvh,
+                        ReplayPick *p, int n) {
+  Ray rays[BVH_PACKET];
+  RayCollision hits[BVH_PACKET];
+  int tris[BVH_PACKET];
+  for (int i = 0; i < n;) {
+    Camera3D cam;
+    if (!ReadCamera(db, p[i].cam, &cam, NULL, NULL))
+      return false;
+    RayGen g = MakeRayGen(cam, SCREEN_WIDTH, SCREEN_HEIGHT);
+    int end = i;
+    while (end < n && p[end].cam == p[i].cam)
+      end++;
+    for (; i < end; i += BVH_PACKET) {
+      int k = std::min(BVH_PACKET, end - i);
+      for (int j = 0; j < k; j++)
+        rays[j] = RayGenRay(g, p[i + j].m);
+      GetRayCollisionBvhPacket(rays, k, mesh, bvh, hits, tris);
+      for (int j = 0; j < k; j++) {
+        p[i + j].hit = hits[j].hit;
+        p[i + j].point = hits[j].point;
+        p[i + j].tri = tris[j];
+      }
+    }
+  }
+  return true;
+}
+
+// Replay results are a function of the target stls.hash, the cams row, the
+// pick's screen position and this code, so replay_cache memoizes them under
+// exactly that key. Camera values are copied from the cams row in SQL, never
+// through floats, so they match bit for bit on the next run. Rewriting an
+// STL, editing a camera or bumping REPLAY_CACHE_VERSION changes the key, and
+// stale rows are never read again; PruneReplayCache drops them during idle
+// maintenance and `compact`, not on every write. Bump the version whenever
+// casting or the Morton order of triangles changes.
+#define REPLAY_CACHE_VERSION 1
+
+#define REPLAY_CACHE_KEY                                                       \
+  "hash, version, width, height, posx, posy, posz, tx, ty, tz, upx, upy, "     \
+  "upz, fovy, proj, mx, my"
+
+inline bool CreateReplayCache(sqlite3 *db) {
+  return sqlite3_exec(db,
+                      "CREATE TABLE IF NOT EXISTS replay_cache ("
+                      "hash TEXT, version INT, width INT, height INT, "
+                      "posx REAL, posy REAL, posz REAL, tx REAL, ty REAL, "
+                      "tz REAL, upx REAL, upy REAL, upz REAL, fovy REAL, "
+                      "proj INT, mx REAL, my REAL, "
+                      "hit INT, x REAL, y REAL, z REAL, tri INT, "
+                      "PRIMARY KEY (" REPLAY_CACHE_KEY ")) WITHOUT ROWID;",
+                      NULL, NULL, NULL) == SQLITE_OK;
+}
+
+// rows no current stls.hash or cast can ask for again
+inline bool PruneReplayCache(sqlite3 *db) {
+  sqlite3_stmt *stmt;
+  const char *sql = "DELETE FROM replay_cache WHERE version <> ?1 OR "
+                    "width <> ?2 OR height <> ?3 OR "
+                    "hash NOT IN (SELECT hash FROM stls);";
+  if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    return false;
+  }
+  sqlite3_bind_int(stmt, 1, REPLAY_CACHE_VERSION);
+  sqlite3_bind_int(stmt, 2, SCREEN_WIDTH);
+  sqlite3_bind_int(stmt, 3, SCREEN_HEIGHT);
+  bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+  sqlite3_finalize(stmt);
+  return ok;
+}
+
+// fill the picks replay_cache knows for a target with stls.hash hash and
+// mark them cached. Returns the number of misses, or -1 on error.
+inline int LookupReplayCache(sqlite3 *db, const std::string &hash,
+                             ReplayPick *p, int n) {
+  sqlite3_stmt *stmt;
+  const char *sql =
+      "SELECT c.hit, c.x, c.y, c.z, c.tri FROM picks p "
+      "JOIN cams k ON k.rowid = p.cam "
+      "JOIN replay_cache c ON c.hash = ?1 AND c.version = ?2 AND "
+      "c.width = ?3 AND c.height = ?4 AND c.posx = k.posx AND "
+      "c.posy = k.posy AND c.posz = k.posz AND c.tx = k.tx AND c.ty = k.ty "
+      "AND c.tz = k.tz AND c.upx = k.upx AND c.upy = k.upy AND "
+      "c.upz = k.upz AND c.fovy = k.fovy AND c.proj = k.proj AND "
+      "c.mx = p.mx AND c.my = p.my WHERE p.rowid = ?5;";
+  if (!CreateReplayCache(db) ||
+      sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    return -1;
+  }
+  sqlite3_bind_text(stmt, 1, hash.data(), (int)hash.size(), SQLITE_STATIC);
+  sqlite3_bind_int(stmt, 2, REPLAY_CACHE_VERSION);
+  sqlite3_bind_int(stmt, 3, SCREEN_WIDTH);
+  sqlite3_bind_int(stmt, 4, SCREEN_HEIGHT);
+  int misses = 0;
+  for (int i = 0; i < n; i++) {
+    sqlite3_reset(stmt);
+    sqlite3_bind_int(stmt, 5, p[i].pick);
+    p[i].cached = sqlite3_step(stmt) == SQLITE_ROW;
+    if (p[i].cached) {
+      p[i].hit = sqlite3_column_int(stmt, 0);
+      p[i].point = (Vector3){(float)sqlite3_column_double(stmt, 1),
+                             (float)sqlite3_column_double(stmt, 2),
+                             (float)sqlite3_column_double(stmt, 3)};
+      p[i].tri = sqlite3_column_int(stmt, 4);
+    }
+    misses += !p[i].cached;
+  }
+  sqlite3_finalize(stmt);
+  return misses;
+}
+
+// remember the picks that were cast rather than looked up, keyed by their
+// cams row as it is now, and prune what no key can reach any more
+inline bool StoreReplayCache(sqlite3 *db, const std::string &hash,
+                             const ReplayPick *p, int n) {
+  sqlite3_stmt *stmt;
+  // OR IGNORE: a cams row with NULLs cannot be a key and is just not cached
+  const char *sql =
+      "INSERT OR IGNORE INTO replay_cache (" REPLAY_CACHE_KEY
+      ", hit, x, y, z, tri) SELECT ?1, ?2, ?3, ?4, k.posx, k.posy, k.posz, "
+      "k.tx, k.ty, k.tz, k.upx, k.upy, k.upz, k.fovy, k.proj, p.mx, p.my, "
+      "?6, ?7, ?8, ?9, ?10 FROM picks p JOIN cams k ON k.rowid = p.cam "
+      "WHERE p.rowid = ?5;";
+  if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    return false;
+  }
+  bool ok = sqlite3_exec(db, "BEGIN;", NULL, NULL, NULL) == SQLITE_OK;
+  sqlite3_bind_text(stmt, 1, hash.data(), (int)hash.size(), SQLITE_STATIC);
+  sqlite3_bind_int(stmt, 2, REPLAY_CACHE_VERSION);
+  sqlite3_bind_int(stmt, 3, SCREEN_WIDTH);
+  sqlite3_bind_int(stmt, 4, SCREEN_HEIGHT);
+  for (int i = 0; ok && i < n; i++) {
+    if (p[i].cached)
+      continue;
+    sqlite3_reset(stmt);
+    sqlite3_bind_int(stmt, 5, p[i].pick);
+    sqlite3_bind_int(stmt, 6, p[i].hit);
+    sqlite3_bind_double(stmt, 7, p[i].point.x);
+    sqlite3_bind_double(stmt, 8, p[i].point.y);
+    sqlite3_bind_double(stmt, 9, p[i].point.z);
+    sqlite3_bind_int(stmt, 10, p[i].tri);
+    ok = sqlite3_step(stmt) == SQLITE_DONE;
+  }
+  if (!ok)
+    printf("Failed to write replay cache: %s\n", sqlite3_errmsg(db));
+  sqlite3_exec(db, ok ? "COMMIT;" : "ROLLBACK;", NULL, NULL, NULL);
+  sqlite3_finalize(stmt);
+  return ok;
+}
+
+// ReplayPicks for the picks LookupReplayCache missed, written through to
+// replay_cache when the database lets us
+inline bool ReplayMisses(sqlite3 *db, const std::string &hash,
+                         const Mesh &mesh, const Bvh &bvh, ReplayPick *p,
+                         int n) {
+  std::vector<ReplayPick> miss;
+  for (int i = 0; i < n; i++)
+    if (!p[i].cached)
+      miss.push_back(p[i]);
+  if (miss.empty())
+    return true;
+  if (!ReplayPicks(db, mesh, bvh, miss.data(), (int)miss.size()))
+    return false;
+  for (int i = 0, j = 0; i < n; i++)
+    if (!p[i].cached)
+      p[i] = miss[j++];
+  StoreReplayCache(db, hash, p, n); // the results stand without it
+  return true;
+}
+
+// store replayed picks on to_stl: each source camera is copied once, and the
+// picks that hit are inserted under the copy, all in one transaction
+inline bool WriteReplay(sqlite3 *db, int to_stl, const ReplayPick *p, int n) {
+  sqlite3_stmt *cam_stmt, *pick_stmt;
+  const char *cam_sql =
+      "INSERT INTO cams (stl, posx, posy, posz, tx, ty, tz, upx, upy, upz, "
+      "fovy, proj, attachment) "
+      "SELECT ?, posx, posy, posz, tx, ty, tz, upx, upy, upz, fovy, proj, "
+      "attachment FROM cams WHERE rowid = ?;";
+  const char *pick_sql =
+      "INSERT INTO picks (cam, mx, my, x, y, z) VALUES (?, ?, ?, ?, ?, ?);";
+  if (sqlite3_prepare_v2(db, cam_sql, -1, &cam_stmt, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    return false;
+  }
+  if (sqlite3_prepare_v2(db, pick_sql, -1, &pick_stmt, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    sqlite3_finalize(cam_stmt);
+    return false;
+  }
+
+  bool ok = sqlite3_exec(db, "BEGIN;", NULL, NULL, NULL) == SQLITE_OK;
+  int src_cam = -1, new_cam = -1;
+  for (int i = 0; ok && i < n; i++) {
+    if (!p[i].hit)
+      continue;
+    if (p[i].cam != src_cam) {
+      src_cam = p[i].cam;
+      sqlite3_reset(cam_stmt);
+      sqlite3_bind_int(cam_stmt, 1, to_stl);
+      sqlite3_bind_int(cam_stmt, 2, src_cam);
+      ok = sqlite3_step(cam_stmt) == SQLITE_DONE;
+      new_cam = (int)sqlite3_last_insert_rowid(db);
+    }
+    sqlite3_reset(pick_stmt);
+    sqlite3_bind_int(pick_stmt, 1, new_cam);
+    sqlite3_bind_double(pick_stmt, 2, p[i].m.x);
+    sqlite3_bind_double(pick_stmt, 3, p[i].m.y);
+    sqlite3_bind_double(pick_stmt, 4, p[i].point.x);
+    sqlite3_bind_double(pick_stmt, 5, p[i].point.y);
+    sqlite3_bind_double(pick_stmt, 6, p[i].point.z);
+    ok = ok && sqlite3_step(pick_stmt) == SQLITE_DONE;
+  }
+  if (!ok)
+    printf("Failed to write replay: %s\n", sqlite3_errmsg(db));
+  sqlite3_exec(db, ok ? "COMMIT;" : "ROLLBACK;", NULL, NULL, NULL);
+
+  sqlite3_finalize(cam_stmt);
+  sqlite3_finalize(pick_stmt);
+  return ok;
+}
+#define REPLAY_ONCE
+#endif
@@ -0,0 +1,410 @@
+#ifndef REVIEW_ONCE
+#include "adjacency.h"
+#include "arena.h"
+#include "bvh.h"
+#include "initdb.h"
+#include "main.h"
+#include "replay.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <errno.h>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+// `waterfall-picker review db stl_id out_dir` renders every cams row of an STL
+// to out_dir/cam<rowid>.png without a window or GPU, and lists them in
+// out_dir/index.json. The output is for reviewing CAD changes in CI.
+//
+// Each view is what the viewer shows for that camera, on the CPU. The model
+// is shaded per pixel as fs.glsl does, back faces are culled and near
+// clipped like GL, and the picks are DrawPicks' spheres: red for the view's
+// own camera, blue for the others. A job is one band of REVIEW_BAND rows of
+// one view, and all threads take jobs from one queue, so a single camera
+// uses every core as well as hundreds do. A band only looks at the triangles
+// in clusters of REVIEW_CLUSTER Morton neighbours whose box projects onto it.
+
+#define REVIEW_BAND 32
+#define REVIEW_CLUSTER 64
+#define REVIEW_PICK_RADIUS 1.f // DrawPicks' spheres
+
+// a camera as BeginMode3D sets it up on a width x height screen: view space
+// (x, y, -d), then ndc = (x * sx, y * sy), divided by d unless ortho
+typedef struct ReviewView {
+  int cam_id;
+  Camera3D camera;
+  Matrix view;
+  float sx, sy;
+  bool ortho;
+  int width, height;
+} ReviewView;
+
+typedef struct ReviewScene {
+  Mesh mesh = {0};
+  std::vector<BoundingBox> clusters; // triangles [REVIEW_CLUSTER i, ...)
+  const ReplayPick *picks = NULL;    // every pick on the STL's cameras
+  int npicks = 0;
+} ReviewScene;
+
+// a vertex on its way to the screen, what vs.glsl hands fs.glsl
+typedef struct ReviewVertex {
+  Vector3 world, normal;
+  float d;    // distance in front of the camera
+  float x, y; // pixels, once projected
+} ReviewVertex;
+
+inline ReviewView MakeReviewView(int cam_id, Camera3D cam, int width,
+                                 int height) {
+  ReviewView v = {.cam_id = cam_id,
+                  .camera = cam,
+                  .view = MatrixLookAt(cam.position, cam.target, cam.up),
+                  .ortho = cam.projection == CAMERA_ORTHOGRAPHIC,
+                  .width = width,
+                  .height = height};
+  float aspect = (float)width / height;
+  // MatrixPerspective and MatrixOrtho as in MakeRayGen
+  v.sy = v.ortho ? 2.f / cam.fovy : 1.f / tanf(cam.fovy * DEG2RAD / 2);
+  v.sx = v.sy / aspect;
+  return v;
+}
+
+inline ReviewVertex ReviewTransform(const ReviewView &v, Vector3 world,
+                                    Vector3 normal) {
+  Vector3 e = Vector3Transform(world, v.view);
+  float w = v.ortho ? 1.f : -e.z;
+  return (ReviewVertex){
+      .world = world,
+      .normal = normal,
+      .d = -e.z,
+      .x = (e.x * v.sx / w + 1.f) * 0.5f * v.width,
+      .y = (1.f - e.y * v.sy / w) * 0.5f * v.height};
+}
+
+inline ReviewVertex ReviewLerp(const ReviewView &v, const ReviewVertex &a,
+                               const ReviewVertex &b, float t) {
+  return ReviewTransform(v, Vector3Lerp(a.world, b.world, t),
+                         Vector3Lerp(a.normal, b.normal, t));
+}
+
+// whether any of box can land in rows [y0, y1) between the clip planes
+inline bool ReviewBoxInBand(const ReviewView &v, BoundingBox box, int y0,
+                            int y1) {
+  float lo = INFINITY, hi = -INFINITY, left = INFINITY, right = -INFINITY;
+  int behind = 0, beyond = 0;
+  for (int i = 0; i < 8; i++) {
+    Vector3 p = {i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y,
+                 i & 4 ? box.max.z : box.min.z};
+    ReviewVertex r = ReviewTransform(v, p, Vector3Zero());
+    behind += r.d < RL_CULL_DISTANCE_NEAR;
+    beyond += r.d > RL_CULL_DISTANCE_FAR;
+    lo = std::min(lo, r.y), hi = std::max(hi, r.y);
+    left = std::min(left, r.x), right = std::max(right, r.x);
+  }
+  if (behind == 8 || beyond == 8)
+    return false;
+  if (behind) // straddles the near plane: its projection is unbounded
+    return true;
+  return hi >= y0 && lo < y1 && right >= 0 && left < v.width;
+}
+
+// fs.glsl with the white vertex colour compact meshes get
+inline Color ReviewShade(Vector3 world, Vector3 normal) {
+  Vector3 ambient = SHADER_AMBIENT_COLOR;
+  Vector3 light = Vector3Normalize(SHADER_LIGHT_POSITION - world);
+  float diff =
+      std::max(Vector3DotProduct(Vector3Normalize(normal), light), 0.f);
+  Vector3 c = ambient * (SHADER_AMBIENT_STRENGTH + diff);
+  return (Color){(unsigned char)(Clamp(c.x, 0, 1) * 255 + 0.5f),
+                 (unsigned char)(Clamp(c.y, 0, 1) * 255 + 0.5f),
+                 (unsigned char)(Clamp(c.z, 0, 1) * 255 + 0.5f), 255};
+}
+
+// fill the pixels of t in rows [y0, y1) that are nearer than depth, which
+// holds width x (y1 - y0) distances
+inline void ReviewRasterize(const ReviewView &v, const ReviewVertex t[3],
+                            int y0, int y1, float *depth, Color *pixels) {
+  const ReviewVertex &a = t[0], &b = t[1], &c = t[2];
+  float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+  // counter-clockwise in ndc is clockwise on screen; the rest is culled
+  if (!(area < 0))
+    return;
+  int xa = std::max(0, (int)floorf(std::min({a.x, b.x, c.x})));
+  int xb = std::min(v.width - 1, (int)ceilf(std::max({a.x, b.x, c.x})));
+  int ya = std::max(y0, (int)floorf(std::min({a.y, b.y, c.y})));
+  int yb = std::min(y1 - 1, (int)ceilf(std::max({a.y, b.y, c.y})));
+  // perspective correct: attributes over d and 1 / d are affine on screen
+  float inv[3];
+  for (int i = 0; i < 3; i++)
+    inv[i] = v.ortho ? 1.f : 1.f / t[i].d;
+  for (int y = ya; y <= yb; y++) {
+    float py = y + 0.5f;
+    for (int x = xa; x <= xb; x++) {
+      float px = x + 0.5f;
+      float w[3] = {((c.x - b.x) * (py - b.y) - (c.y - b.y) * (px - b.x)),
+                    ((a.x - c.x) * (py - c.y) - (a.y - c.y) * (px - c.x)),
+                    ((b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x))};
+      if (w[0] > 0 || w[1] > 0 || w[2] > 0)
+        continue;
+      float s = 0, d = 0;
+      for (int i = 0; i < 3; i++) {
+        w[i] *= inv[i];
+        s += w[i];
+        d += w[i] * t[i].d;
+      }
+      d /= s;
+      float *z = &depth[(y - y0) * v.width + x];
+      if (d >= *z || d < RL_CULL_DISTANCE_NEAR || d > RL_CULL_DISTANCE_FAR)
+        continue;
+      *z = d;
+      Vector3 world = Vector3Zero(), normal = Vector3Zero();
+      for (int i = 0; i < 3; i++) {
+        world += t[i].world * (w[i] / s);
+        normal += t[i].normal * (w[i] / s);
+      }
+      pixels[y * v.width + x] = ReviewShade(world, normal);
+    }
+  }
+}
+
+// triangle t of the mesh, cut at the near plane as GL clips it
+inline void ReviewTriangle(const ReviewView &v, const Mesh &mesh, int t,
+                           int y0, int y1, float *depth, Color *pixels) {
+  ReviewVertex in[3], out[4];
+  int behind = 0;
+  for (int i = 0; i < 3; i++) {
+    const float *p = mesh.vertices + 9 * t + 3 * i;
+    const float *n = mesh.normals + 9 * t + 3 * i;
+    in[i] = ReviewTransform(v, (Vector3){p[0], p[1], p[2]},
+                            (Vector3){n[0], n[1], n[2]});
+    behind += in[i].d < RL_CULL_DISTANCE_NEAR;
+  }
+  if (behind == 0) {
+    ReviewRasterize(v, in, y0, y1, depth, pixels);
+    return;
+  }
+  if (behind == 3)
+    return;
+  int n = 0;
+  for (int i = 0; i < 3; i++) {
+    const ReviewVertex &p = in[i], &q = in[(i + 1) % 3];
+    bool pin = p.d >= RL_CULL_DISTANCE_NEAR, qin = q.d >= RL_CULL_DISTANCE_NEAR;
+    if (pin)
+      out[n++] = p;
+    if (pin != qin)
+      out[n++] =
+          ReviewLerp(v, p, q, (RL_CULL_DISTANCE_NEAR - p.d) / (q.d - p.d));
+  }
+  for (int i = 1; i + 1 < n; i++) {
+    ReviewVertex fan[3] = {out[0], out[i], out[i + 1]};
+    ReviewRasterize(v, fan, y0, y1, depth, pixels);
+  }
+}
+
+// a pick's sphere, solid as DrawSphere draws it
+inline void ReviewSphere(const ReviewView &v, Vector3 center, Color col,
+                         int y0, int y1, float *depth, Color *pixels) {
+  ReviewVertex c = ReviewTransform(v, center, Vector3Zero());
+  float r = REVIEW_PICK_RADIUS;
+  if (c.d - r < RL_CULL_DISTANCE_NEAR || c.d - r > RL_CULL_DISTANCE_FAR)
+    return;
+  float rpx = r * v.sy * 0.5f * v.height / (v.ortho ? 1.f : c.d);
+  int xa = std::max(0, (int)floorf(c.x - rpx));
+  int xb = std::min(v.width - 1, (int)ceilf(c.x + rpx));
+  int ya = std::max(y0, (int)floorf(c.y - rpx));
+  int yb = std::min(y1 - 1, (int)ceilf(c.y + rpx));
+  for (int y = ya; y <= yb; y++)
+    for (int x = xa; x <= xb; x++) {
+      float dx = (x + 0.5f - c.x) / rpx, dy = (y + 0.5f - c.y) / rpx;
+      float q = dx * dx + dy * dy;
+      if (q > 1)
+        continue;
+      float d = c.d - r * sqrtf(1 - q);
+      float *z = &depth[(y - y0) * v.width + x];
+      if (d >= *z)
+        continue;
+      *z = d;
+      pixels[y * v.width + x] = col;
+    }
+}
+
+// rows [y0, y1) of the view, over what pixels held; depth is scratch for
+// width x REVIEW_BAND floats
+inline void RenderReviewBand(const ReviewScene &s, const ReviewView &v, int y0,
+                             int y1, float *depth, Color *pixels) {
+  std::fill(depth, depth + (y1 - y0) * v.width, INFINITY);
+  for (size_t k = 0; k < s.clusters.size(); k++) {
+    if (!ReviewBoxInBand(v, s.clusters[k], y0, y1))
+      continue;
+    int end = std::min((int)(k + 1) * REVIEW_CLUSTER, s.mesh.triangleCount);
+    for (int t = k * REVIEW_CLUSTER; t < end; t++)
+      ReviewTriangle(v, s.mesh, t, y0, y1, depth, pixels);
+  }
+  for (int i = 0; i < s.npicks; i++)
+    ReviewSphere(v, s.picks[i].old, s.picks[i].cam == v.cam_id ? RED : BLUE,
+                 y0, y1, depth, pixels);
+}
+
+// the whole view on one thread, into width x height pixels
+inline void RenderReviewView(const ReviewScene &s, const ReviewView &v,
+                             Color *pixels) {
+  std::vector<float> depth(v.width * REVIEW_BAND);
+  std::fill(pixels, pixels + v.width * v.height, RAYWHITE);
+  for (int y = 0; y < v.height; y += REVIEW_BAND)
+    RenderReviewBand(s, v, y, std::min(v.height, y + REVIEW_BAND),
+                     depth.data(), pixels);
+}
+
+inline void BuildReviewClusters(ReviewScene *s) {
+  Vector3 p[3];
+  s->clusters.clear();
+  for (int first = 0; first < s->mesh.triangleCount; first += REVIEW_CLUSTER) {
+    BoundingBox box = EmptyBox();
+    int end = std::min(first + REVIEW_CLUSTER, s->mesh.triangleCount);
+    for (int t = first; t < end; t++) {
+      MeshTriangle(s->mesh, t, p);
+      for (int j = 0; j < 3; j++)
+        GrowBox(&box, p[j]);
+    }
+    s->clusters.push_back(box);
+  }
+}
+
+// the cameras of stl_id in rowid order, as views of a width x height screen
+inline bool ReadReviewViews(sqlite3 *db, int stl_id, int width, int height,
+                            std::vector<ReviewView> *out) {
+  sqlite3_stmt *stmt;
+  const char *sql = "SELECT rowid FROM cams WHERE stl = ? ORDER BY rowid;";
+  if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    return false;
+  }
+  sqlite3_bind_int(stmt, 1, stl_id);
+  std::vector<int> ids;
+  while (sqlite3_step(stmt) == SQLITE_ROW)
+    ids.push_back(sqlite3_column_int(stmt, 0));
+  sqlite3_finalize(stmt);
+  for (int id : ids) {
+    Camera3D cam;
+    if (!ReadCamera(db, id, &cam, NULL, NULL))
+      return false;
+    out->push_back(MakeReviewView(id, cam, width, height));
+  }
+  return true;
+}
+
+// one view being rendered by several jobs; the last band exports it
+typedef struct ReviewFrame {
+  std::once_flag once;
+  Image image = {0};
+  std::atomic<int> bands{0};
+  bool ok = false;
+} ReviewFrame;
+
+inline bool WriteReviewIndex(const std::string &path, int stl_id,
+                             const std::string &hash,
+                             const std::vector<ReviewView> &views,
+                             const ReviewScene &s) {
+  FILE *f = fopen(path.c_str(), "w");
+  if (!f) {
+    printf("Cannot write %s\n", path.c_str());
+    return false;
+  }
+  fprintf(f, "{\"stl\":%d,\"hash\":\"%s\",\"width\":%d,\"height\":%d,"
+             "\"views\":[",
+          stl_id, hash.c_str(), views.empty() ? 0 : views[0].width,
+          views.empty() ? 0 : views[0].height);
+  for (size_t i = 0; i < views.size(); i++) {
+    const Camera3D &c = views[i].camera;
+    int picks = 0;
+    for (int k = 0; k < s.npicks; k++)
+      picks += s.picks[k].cam == views[i].cam_id;
+    fprintf(f,
+            "%s\n{\"cam\":%d,\"file\":\"cam%d.png\",\"picks\":%d,"
+            "\"position\":[%.9g,%.9g,%.9g],\"target\":[%.9g,%.9g,%.9g],"
+            "\"up\":[%.9g,%.9g,%.9g],\"fovy\":%.9g,\"projection\":%d}",
+            i ? "," : "", views[i].cam_id, views[i].cam_id, picks,
+            c.position.x, c.position.y, c.position.z, c.target.x, c.target.y,
+            c.target.z, c.up.x, c.up.y, c.up.z, c.fovy, c.projection);
+  }
+  fprintf(f, "]}\n");
+  return fclose(f) == 0;
+}
+
+// the `review` subcommand, into out_dir (created if missing)
+inline bool ReviewStl(sqlite3 *db, int stl_id, const char *out_dir,
+                      int width = SCREEN_WIDTH, int height = SCREEN_HEIGHT) {
+  auto t0 = std::chrono::steady_clock::now();
+  if (mkdir(out_dir, 0755) != 0 && errno != EEXIST) {
+    printf("Cannot create %s: %s\n", out_dir, strerror(errno));
+    return false;
+  }
+  ReviewScene s;
+  ModelArena arena = {0};
+  ReplayPick *picks = NULL;
+  std::string hash;
+  std::vector<ReviewView> views;
+  if (!ReadSTLFromDB(db, stl_id, &s.mesh, NULL, &arena) ||
+      !ReadSTLHash(db, stl_id, &hash) ||
+      (s.npicks = LoadReplayPicks(db, stl_id, &picks)) < 0 ||
+      !ReadReviewViews(db, stl_id, width, height, &views)) {
+    printf("Cannot load stl %d for review\n", stl_id);
+    free(picks);
+    ArenaRelease(&arena);
+    return false;
+  }
+  s.picks = picks;
+  BuildReviewClusters(&s);
+
+  int bands = (height + REVIEW_BAND - 1) / REVIEW_BAND;
+  int jobs = (int)views.size() * bands;
+  std::vector<ReviewFrame> frames(views.size());
+  for (auto &f : frames)
+    f.bands = bands;
+  std::atomic<int> next{0};
+  // jobs are taken view by view, so only about nthreads / bands images are
+  // in memory at a time
+  int nthreads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::thread> workers;
+  for (int w = 0; w < nthreads; w++)
+    workers.emplace_back([&] {
+      std::vector<float> depth(width * REVIEW_BAND);
+      for (int job; (job = next++) < jobs;) {
+        ReviewFrame &f = frames[job / bands];
+        const ReviewView &v = views[job / bands];
+        std::call_once(f.once, [&] {
+          f.image = GenImageColor(width, height, RAYWHITE);
+        });
+        int y0 = job % bands * REVIEW_BAND;
+        RenderReviewBand(s, v, y0, std::min(height, y0 + REVIEW_BAND),
+                         depth.data(), (Color *)f.image.data);
+        if (--f.bands == 0) {
+          std::string path = std::string(out_dir) + "/cam" +
+                             std::to_string(v.cam_id) + ".png";
+          f.ok = ExportImage(f.image, path.c_str());
+          UnloadImage(f.image);
+          if (!f.ok)
+            printf("Cannot write %s\n", path.c_str());
+        }
+      }
+    });
+  for (auto &t : workers)
+    t.join();
+
+  bool ok = WriteReviewIndex(std::string(out_dir) + "/index.json", stl_id,
+                             hash, views, s);
+  for (auto &f : frames)
+    ok = ok && f.ok;
+  double ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - t0)
+                  .count();
+  printf("Rendered %d views of stl %d to %s in %.0f ms\n", (int)views.size(),
+         stl_id, out_dir, ms);
+  free(picks);
+  ArenaRelease(&arena);
+  return ok;
+}
+#define REVIEW_ONCE
+#endif
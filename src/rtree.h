@@ -0,0 +1,230 @@
+#ifndef RTREE_ONCE
+#include "arena.h"
+#include "bvh.h"
+#include "initdb.h"
+#include "main.h"
+#include <string>
+#include <vector>
+
+// Optional SQLite R*Tree indexes, so spatial questions run in SQL without
+// reading stls.data:
+//
+//   stl_rtree(id, minx..maxz, +stl, +tris)  clusters of RTREE_CLUSTER
+//     triangles that are neighbours in Morton order. tris is a BLOB of int32
+//     triangle indices in stls.data order.
+//   stl_rtree_src(stl, hash)  the stls.hash each stl was indexed at
+//   pick_rtree(id = picks.rowid, minx..maxz, +cam)  one point per pick
+//
+// `waterfall-picker rtree db` creates them and indexes the stls rows that are
+// new or changed. From then on triggers keep pick_rtree in step with
+// every write to picks: InsertPick, DeletePick, imports and other
+// processes. They also drop the clusters of an stls row that is rewritten
+// or deleted, until the next `rtree` run indexes it again.
+
+#define RTREE_CLUSTER 16
+
+inline bool RtreeExec(sqlite3 *db, const char *sql) {
+  char *err = NULL;
+  if (sqlite3_exec(db, sql, NULL, NULL, &err) != SQLITE_OK) {
+    printf("SQL error: %s\n", err);
+    sqlite3_free(err);
+    return false;
+  }
+  return true;
+}
+
+inline bool CreateRtreeTables(sqlite3 *db) {
+  return RtreeExec(
+      db,
+      "CREATE VIRTUAL TABLE IF NOT EXISTS stl_rtree USING rtree("
+      "id, minx, maxx, miny, maxy, minz, maxz, +stl INT, +tris BLOB);"
+      "CREATE TABLE IF NOT EXISTS stl_rtree_src ("
+      "stl INTEGER PRIMARY KEY, hash TEXT NOT NULL);"
+      "CREATE VIRTUAL TABLE IF NOT EXISTS pick_rtree USING rtree("
+      "id, minx, maxx, miny, maxy, minz, maxz, +cam INT);"
+
+      "CREATE TRIGGER IF NOT EXISTS pick_rtree_insert AFTER INSERT ON picks "
+      "BEGIN INSERT OR REPLACE INTO pick_rtree VALUES (new.rowid, new.x, "
+      "new.x, new.y, new.y, new.z, new.z, new.cam); END;"
+      "CREATE TRIGGER IF NOT EXISTS pick_rtree_update AFTER UPDATE ON picks "
+      "BEGIN DELETE FROM pick_rtree WHERE id = old.rowid; "
+      "INSERT INTO pick_rtree VALUES (new.rowid, new.x, new.x, new.y, new.y, "
+      "new.z, new.z, new.cam); END;"
+      "CREATE TRIGGER IF NOT EXISTS pick_rtree_delete AFTER DELETE ON picks "
+      "BEGIN DELETE FROM pick_rtree WHERE id = old.rowid; END;"
+
+      "CREATE TRIGGER IF NOT EXISTS stl_rtree_update AFTER UPDATE OF data "
+      "ON stls BEGIN DELETE FROM stl_rtree WHERE stl = old.rowid; "
+      "DELETE FROM stl_rtree_src WHERE stl = old.rowid; END;"
+      "CREATE TRIGGER IF NOT EXISTS stl_rtree_delete AFTER DELETE ON stls "
+      "BEGIN DELETE FROM stl_rtree WHERE stl = old.rowid; "
+      "DELETE FROM stl_rtree_src WHERE stl = old.rowid; END;");
+}
+
+// replace the clusters of stl_id by those of mesh, triangles in Morton order
+// as ReadSTLFromDB leaves them, tri_order mapping back to stls.data
+inline bool IndexStlRtree(sqlite3 *db, int stl_id, const Mesh &mesh,
+                          const int *tri_order, const std::string &hash) {
+  sqlite3_stmt *del, *ins, *src;
+  sqlite3_prepare_v2(db, "DELETE FROM stl_rtree WHERE stl = ?;", -1, &del,
+                     NULL);
+  sqlite3_prepare_v2(db,
+                     "INSERT INTO stl_rtree (minx, maxx, miny, maxy, minz, "
+                     "maxz, stl, tris) VALUES (?, ?, ?, ?, ?, ?, ?, ?);",
+                     -1, &ins, NULL);
+  sqlite3_prepare_v2(db,
+                     "INSERT OR REPLACE INTO stl_rtree_src (stl, hash) "
+                     "VALUES (?, ?);",
+                     -1, &src, NULL);
+  bool ok = del && ins && src && RtreeExec(db, "BEGIN;");
+  if (ok) {
+    sqlite3_bind_int(del, 1, stl_id);
+    ok = sqlite3_step(del) == SQLITE_DONE;
+  }
+  int32_t tris[RTREE_CLUSTER];
+  Vector3 p[3];
+  for (int first = 0; ok && first < mesh.triangleCount;
+       first += RTREE_CLUSTER) {
+    int n = std::min(RTREE_CLUSTER, mesh.triangleCount - first);
+    BoundingBox box = EmptyBox();
+    for (int i = 0; i < n; i++) {
+      MeshTriangle(mesh, first + i, p);
+      for (int j = 0; j < 3; j++)
+        GrowBox(&box, p[j]);
+      tris[i] = tri_order ? tri_order[first + i] : first + i;
+    }
+    sqlite3_reset(ins);
+    const float *b = &box.min.x;
+    for (int a = 0; a < 3; a++) {
+      sqlite3_bind_double(ins, 1 + 2 * a, b[a]);
+      sqlite3_bind_double(ins, 2 + 2 * a, b[3 + a]);
+    }
+    sqlite3_bind_int(ins, 7, stl_id);
+    sqlite3_bind_blob(ins, 8, tris, n * sizeof(int32_t), SQLITE_TRANSIENT);
+    ok = sqlite3_step(ins) == SQLITE_DONE;
+  }
+  if (ok) {
+    sqlite3_bind_int(src, 1, stl_id);
+    sqlite3_bind_text(src, 2, hash.data(), (int)hash.size(), SQLITE_STATIC);
+    ok = sqlite3_step(src) == SQLITE_DONE;
+  }
+  if (!ok)
+    printf("Indexing stl %d failed: %s\n", stl_id, sqlite3_errmsg(db));
+  RtreeExec(db, ok ? "COMMIT;" : "ROLLBACK;");
+  sqlite3_finalize(del);
+  sqlite3_finalize(ins);
+  sqlite3_finalize(src);
+  return ok;
+}
+
+// the `rtree` subcommand: create the tables, index the picks and every stls
+// row that is not indexed at its current hash
+inline bool BuildRtree(sqlite3 *db) {
+  if (!CreateRtreeTables(db) ||
+      !RtreeExec(db, "INSERT OR REPLACE INTO pick_rtree SELECT rowid, x, x, "
+                     "y, y, z, z, cam FROM picks;"))
+    return false;
+
+  std::vector<int> stale;
+  std::vector<std::string> hashes;
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(db,
+                         "SELECT s.rowid, s.hash FROM stls s LEFT JOIN "
+                         "stl_rtree_src r ON r.stl = s.rowid "
+                         "WHERE r.hash IS NOT s.hash;",
+                         -1, &stmt, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    return false;
+  }
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    stale.push_back(sqlite3_column_int(stmt, 0));
+    hashes.emplace_back((const char *)sqlite3_column_blob(stmt, 1),
+                        sqlite3_column_bytes(stmt, 1));
+  }
+  sqlite3_finalize(stmt);
+
+  ModelArena arena = {0};
+  bool ok = true;
+  for (size_t i = 0; ok && i < stale.size(); i++) {
+    Mesh mesh = {0};
+    int *order = NULL;
+    ok = ReadSTLFromDB(db, stale[i], &mesh, &order, &arena) &&
+         IndexStlRtree(db, stale[i], mesh, order, hashes[i]);
+    if (ok)
+      printf("Indexed stl %d: %d triangles\n", stale[i], mesh.triangleCount);
+    ArenaReset(&arena);
+  }
+  ArenaRelease(&arena);
+  return ok;
+}
+
+// run sql with params bound to ?1, ?2, ..., appending column 0 of each row,
+// or every int32 of it when it is a BLOB
+inline bool RtreeQuery(sqlite3 *db, const char *sql, const double *params,
+                       int nparams, std::vector<int> *out) {
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    return false;
+  }
+  for (int i = 0; i < nparams; i++)
+    sqlite3_bind_double(stmt, 1 + i, params[i]);
+  int rc;
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    if (sqlite3_column_type(stmt, 0) == SQLITE_BLOB) {
+      const int32_t *v = (const int32_t *)sqlite3_column_blob(stmt, 0);
+      int n = sqlite3_column_bytes(stmt, 0) / (int)sizeof(int32_t);
+      out->insert(out->end(), v, v + n);
+    } else {
+      out->push_back(sqlite3_column_int(stmt, 0));
+    }
+  }
+  sqlite3_finalize(stmt);
+  return rc == SQLITE_DONE;
+}
+
+// the R*Tree stores float32 bounds rounded outwards, so it only narrows the
+// search; picks.x/y/z decide
+#define RTREE_OVERLAPS(t)                                                      \
+  t ".maxx >= ?1 AND " t ".minx <= ?2 AND " t ".maxy >= ?3 AND " t             \
+  ".miny <= ?4 AND " t ".maxz >= ?5 AND " t ".minz <= ?6"
+
+// picks.rowid of the picks inside box
+inline bool QueryPicksInBox(sqlite3 *db, BoundingBox box,
+                            std::vector<int> *ids) {
+  double q[6] = {box.min.x, box.max.x, box.min.y,
+                 box.max.y, box.min.z, box.max.z};
+  return RtreeQuery(db,
+                    "SELECT picks.rowid FROM pick_rtree r JOIN picks ON "
+                    "picks.rowid = r.id WHERE " RTREE_OVERLAPS("r")
+                    " AND picks.x BETWEEN ?1 AND ?2 AND picks.y BETWEEN ?3 "
+                    "AND ?4 AND picks.z BETWEEN ?5 AND ?6;",
+                    q, 6, ids);
+}
+
+// picks.rowid of the picks within r of p
+inline bool QueryPicksNear(sqlite3 *db, Vector3 p, float r,
+                           std::vector<int> *ids) {
+  double q[10] = {p.x - r, p.x + r, p.y - r, p.y + r, p.z - r,
+                  p.z + r, p.x,     p.y,     p.z,     (double)r * r};
+  return RtreeQuery(db,
+                    "SELECT picks.rowid FROM pick_rtree r JOIN picks ON "
+                    "picks.rowid = r.id WHERE " RTREE_OVERLAPS("r")
+                    " AND (picks.x - ?7) * (picks.x - ?7) + (picks.y - ?8) * "
+                    "(picks.y - ?8) + (picks.z - ?9) * (picks.z - ?9) <= ?10;",
+                    q, 10, ids);
+}
+
+// triangles of stl_id, in stls.data order, whose cluster overlaps box: every
+// triangle that meets box, and some of their neighbours
+inline bool QueryTrianglesInBox(sqlite3 *db, int stl_id, BoundingBox box,
+                                std::vector<int> *tris) {
+  double q[7] = {box.min.x, box.max.x, box.min.y, box.max.y,
+                 box.min.z, box.max.z, (double)stl_id};
+  return RtreeQuery(db,
+                    "SELECT r.tris FROM stl_rtree r WHERE " RTREE_OVERLAPS("r")
+                    " AND r.stl = ?7;",
+                    q, 7, tris);
+}
+#define RTREE_ONCE
+#endif
@@ -0,0 +1,380 @@
+#ifndef SERVE_ONCE
+#include "bvh.h"
+#include "initdb.h"
+#include "main.h"
+#include "raygen.h"
+#include "replay.h"
+#include <atomic>
+#include <chrono>
+#include <ctype.h>
+#include <errno.h>
+#include <memory>
+#include <mutex>
+#include <stdarg.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// `waterfall-picker serve <socket> [database_path]` keeps parsed meshes and
+// their BVHs resident and answers line-delimited JSON requests, one thread
+// per connection:
+//
+//   {"op":"ping"}
+//   {"op":"cast","cam":N,"points":[[mx,my],...]}   optional "stl":S
+//   {"op":"replay","from":A,"to":B}                optional "write":1
+//   {"op":"shutdown"}
+//
+// Every response is a single line with "ok" and "ms", failures carry "error".
+// On shutdown, connections still open stop being read, and whoever has not
+// hung up after SERVE_DRAIN_SECONDS is cut off.
+
+#define SERVE_DRAIN_SECONDS 5.0
+
+typedef struct ResidentModel {
+  std::string hash; // stls.hash the mesh was parsed from
+  Mesh mesh;
+  Bvh bvh;
+} ResidentModel;
+
+typedef struct Server {
+  const char *db_path;
+  int listen_fd;
+  std::atomic<bool> stop;
+  std::atomic<int> nclients;
+  std::mutex lock; // guards models and clients
+  // a request holds its own reference, so a replaced model is freed when the
+  // last request reading it finishes
+  std::unordered_map<int, std::shared_ptr<const ResidentModel>> models;
+  std::vector<int> clients; // open connections
+} Server;
+
+// value following "key": in a flat JSON object, NULL if absent
+inline const char *JsonField(const char *s, const char *key) {
+  char pat[64];
+  snprintf(pat, sizeof pat, "\"%s\"", key);
+  for (const char *p = strstr(s, pat); p; p = strstr(p + 1, pat)) {
+    const char *v = p + strlen(pat);
+    while (isspace((unsigned char)*v))
+      v++;
+    if (*v != ':')
+      continue;
+    v++;
+    while (isspace((unsigned char)*v))
+      v++;
+    return v;
+  }
+  return NULL;
+}
+
+inline bool JsonInt(const char *s, const char *key, int *out) {
+  const char *p = JsonField(s, key);
+  if (!p)
+    return false;
+  char *end;
+  long v = strtol(p, &end, 10);
+  if (end == p)
+    return false;
+  *out = (int)v;
+  return true;
+}
+
+inline bool JsonString(const char *s, const char *key, char *out, int n) {
+  const char *p = JsonField(s, key);
+  if (!p || *p != '"')
+    return false;
+  int i = 0;
+  for (p++; *p && *p != '"' && i < n - 1; p++)
+    out[i++] = *p;
+  out[i] = 0;
+  return *p == '"';
+}
+
+// [[x,y],...]
+inline bool JsonPoints(const char *s, const char *key,
+                       std::vector<Vector2> *out) {
+  const char *p = JsonField(s, key);
+  if (!p || *p != '[')
+    return false;
+  p++;
+  for (;;) {
+    while (isspace((unsigned char)*p) || *p == ',')
+      p++;
+    if (*p == ']')
+      return true;
+    if (*p != '[')
+      return false;
+    char *end;
+    Vector2 v;
+    v.x = strtof(p + 1, &end);
+    p = end;
+    while (isspace((unsigned char)*p) || *p == ',')
+      p++;
+    v.y = strtof(p, &end);
+    if (end == p)
+      return false;
+    p = end;
+    while (isspace((unsigned char)*p))
+      p++;
+    if (*p != ']')
+      return false;
+    p++;
+    out->push_back(v);
+  }
+}
+
+inline void Appendf(std::string *s, const char *fmt, ...) {
+  char buf[256];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(buf, sizeof buf, fmt, args);
+  va_end(args);
+  *s += buf;
+}
+
+inline void UnloadResidentModel(ResidentModel *m) {
+  free(m->mesh.vertices);
+  free(m->mesh.normals);
+  UnloadBvh(m->bvh);
+  delete m;
+}
+
+// the parsed mesh of stl_id, reparsed when stls.hash no longer matches
+inline std::shared_ptr<const ResidentModel>
+GetResidentModel(Server *server, sqlite3 *db, int stl_id) {
+  std::string hash;
+  if (!ReadSTLHash(db, stl_id, &hash))
+    return NULL;
+
+  {
+    std::lock_guard<std::mutex> guard(server->lock);
+    auto it = server->models.find(stl_id);
+    if (it != server->models.end() && it->second->hash == hash)
+      return it->second;
+  }
+
+  // parse outside the lock: two connections racing for the same new model
+  // only waste a parse
+  ResidentModel *m = new ResidentModel{hash, {0}, {0}};
+  if (!ReadSTLFromDB(db, stl_id, &m->mesh)) {
+    delete m;
+    return NULL;
+  }
+  m->bvh = BuildBvh(m->mesh);
+  std::shared_ptr<const ResidentModel> model(m, UnloadResidentModel);
+
+  std::lock_guard<std::mutex> guard(server->lock);
+  server->models[stl_id] = model;
+  return model;
+}
+
+inline std::string HandleRequest(Server *server, sqlite3 *db,
+                                 const char *line) {
+  auto t0 = std::chrono::steady_clock::now();
+  std::string out = "{\"ok\":true";
+  const char *error = NULL;
+  char op[32];
+
+  if (!JsonString(line, "op", op, sizeof op)) {
+    error = "missing op";
+  } else if (strcmp(op, "ping") == 0) {
+  } else if (strcmp(op, "cast") == 0) {
+    int cam_id, stl_id;
+    Camera3D cam;
+    std::vector<Vector2> points;
+    std::shared_ptr<const ResidentModel> model;
+    if (!JsonInt(line, "cam", &cam_id) || !JsonPoints(line, "points", &points))
+      error = "cast needs cam and points";
+    else if (!ReadCamera(db, cam_id, &cam, NULL, &stl_id))
+      error = "no such camera";
+    else {
+      JsonInt(line, "stl", &stl_id); // defaults to the camera's stl
+      model = GetResidentModel(server, db, stl_id);
+    }
+    if (!error && !model)
+      error = "cannot load stl";
+    if (!error) {
+      int n = (int)points.size();
+      RayGen g = MakeRayGen(cam, SCREEN_WIDTH, SCREEN_HEIGHT);
+      std::vector<Ray> rays(n);
+      std::vector<RayCollision> hits(n);
+      std::vector<int> tris(n);
+      for (int i = 0; i < n; i++)
+        rays[i] = RayGenRay(g, points[i]);
+      for (int i = 0; i < n; i += BVH_PACKET)
+        GetRayCollisionBvhPacket(&rays[i], std::min(BVH_PACKET, n - i),
+                                 model->mesh, model->bvh, &hits[i], &tris[i]);
+      out += ",\"hits\":[";
+      for (int i = 0; i < n; i++) {
+        const RayCollision &hit = hits[i];
+        if (i > 0)
+          out += ",";
+        if (hit.hit)
+          Appendf(&out, "[%.9g,%.9g,%.9g]", hit.point.x, hit.point.y,
+                  hit.point.z);
+        else
+          out += "null";
+      }
+      out += "]";
+    }
+  } else if (strcmp(op, "replay") == 0) {
+    int from, to, write = 0;
+    std::shared_ptr<const ResidentModel> model;
+    ReplayPick *p = NULL;
+    std::string hash;
+    int n = 0, misses = 0;
+    JsonInt(line, "write", &write);
+    // an unchanged re-run is answered from replay_cache without the model
+    if (!JsonInt(line, "from", &from) || !JsonInt(line, "to", &to))
+      error = "replay needs from and to";
+    else if (!ReadSTLHash(db, to, &hash))
+      error = "cannot load stl";
+    else if ((n = LoadReplayPicks(db, from, &p)) < 0 ||
+             (misses = LookupReplayCache(db, hash, p, n)) < 0)
+      error = "cannot replay picks";
+    else if (misses && !(model = GetResidentModel(server, db, to)))
+      error = "cannot load stl";
+    // the row may have been rewritten after hash was read, so the answer is
+    // looked up again under the revision the model was parsed from
+    else if (misses && model->hash != hash &&
+             (misses = LookupReplayCache(db, model->hash, p, n)) < 0)
+      error = "cannot replay picks";
+    else if (misses &&
+             !ReplayMisses(db, model->hash, model->mesh, model->bvh, p, n))
+      error = "cannot replay picks";
+    else if (write && !WriteReplay(db, to, p, n))
+      error = "cannot write replay";
+    else {
+      Appendf(&out, ",\"cached\":%d", n - misses);
+      out += ",\"picks\":[";
+      for (int i = 0; i < n; i++) {
+        Appendf(&out, "%s{\"pick\":%d,\"cam\":%d,\"hit\":%s", i ? "," : "",
+                p[i].pick, p[i].cam, p[i].hit ? "true" : "false");
+        if (p[i].hit)
+          Appendf(&out, ",\"x\":%.9g,\"y\":%.9g,\"z\":%.9g", p[i].point.x,
+                  p[i].point.y, p[i].point.z);
+        out += "}";
+      }
+      out += "]";
+    }
+    free(p);
+  } else if (strcmp(op, "shutdown") == 0) {
+    server->stop = true;
+    shutdown(server->listen_fd, SHUT_RDWR);
+  } else {
+    error = "unknown op";
+  }
+
+  if (error)
+    out = std::string("{\"ok\":false,\"error\":\"") + error + "\"";
+  double ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - t0)
+                  .count();
+  Appendf(&out, ",\"ms\":%.3f}", ms);
+  return out;
+}
+
+inline void ServeConnection(Server *server, int fd) {
+  sqlite3 *db;
+  if (sqlite3_open_v2(server->db_path, &db, SQLITE_OPEN_READWRITE, NULL) !=
+      SQLITE_OK) {
+    printf("Cannot open database: %s\n", sqlite3_errmsg(db));
+  } else {
+    sqlite3_busy_timeout(db, 5000);
+    std::string buf;
+    char chunk[4096];
+    ssize_t r;
+    while ((r = read(fd, chunk, sizeof chunk)) > 0) {
+      buf.append(chunk, r);
+      size_t nl;
+      while ((nl = buf.find('\n')) != std::string::npos) {
+        std::string line = buf.substr(0, nl);
+        buf.erase(0, nl + 1);
+        if (line.empty())
+          continue;
+        std::string reply = HandleRequest(server, db, line.c_str()) + "\n";
+        for (size_t off = 0; off < reply.size();) {
+          ssize_t w = send(fd, reply.data() + off, reply.size() - off,
+                           MSG_NOSIGNAL);
+          if (w <= 0)
+            break;
+          off += w;
+        }
+      }
+    }
+  }
+  sqlite3_close(db);
+  {
+    std::lock_guard<std::mutex> guard(server->lock);
+    std::erase(server->clients, fd);
+  }
+  close(fd);
+  server->nclients--;
+}
+
+// shutdown(2) every open connection, which wakes their threads' reads
+inline void ShutdownClients(Server *server, int how) {
+  std::lock_guard<std::mutex> guard(server->lock);
+  for (int fd : server->clients)
+    shutdown(fd, how);
+}
+
+inline bool ServeUnixSocket(const char *socket_path, const char *db_path) {
+  Server server;
+  server.db_path = db_path;
+  server.stop = false;
+  server.nclients = 0;
+
+  struct sockaddr_un addr = {0};
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof addr.sun_path) {
+    printf("Socket path too long: %s\n", socket_path);
+    return false;
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(socket_path);
+  if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof addr) != 0 ||
+      listen(fd, 16) != 0) {
+    printf("Cannot listen on %s: %s\n", socket_path, strerror(errno));
+    if (fd >= 0)
+      close(fd);
+    return false;
+  }
+  server.listen_fd = fd;
+  printf("Serving %s on %s\n", db_path, socket_path);
+
+  while (!server.stop) {
+    int client = accept(fd, NULL, NULL);
+    if (client < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    server.nclients++;
+    {
+      std::lock_guard<std::mutex> guard(server.lock);
+      server.clients.push_back(client);
+    }
+    std::thread(ServeConnection, &server, client).detach();
+  }
+  close(fd);
+  unlink(socket_path);
+
+  // requests in flight, shutdown's own among them, still get their reply
+  ShutdownClients(&server, SHUT_RD);
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::duration<double>(SERVE_DRAIN_SECONDS);
+  while (server.nclients > 0 && std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  ShutdownClients(&server, SHUT_RDWR);
+  while (server.nclients > 0)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  server.models.clear();
+  return true;
+}
+#define SERVE_ONCE
+#endif
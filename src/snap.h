@@ -0,0 +1,265 @@
+#ifndef SNAP_ONCE
+#include "adjacency.h"
+#include "arena.h"
+#include "geometry.h"
+#include "main.h"
+#include <algorithm>
+#include <vector>
+
+// Snap targets for CAD-style picks: the welded mesh vertices and the sharp
+// feature edges, where adjacent faces meet at more than SNAP_FEATURE_ANGLE
+// degrees or the surface ends. Both sit in a uniform grid over the model
+// bounds, so a query only looks at the few cells around the ray's hit.
+
+#define SNAP_FEATURE_ANGLE 30.f
+#define SNAP_RADIUS_PX 12.f
+
+typedef struct SnapIndex {
+  Vector3 *verts; // welded mesh vertices
+  int nverts;
+  // feature edge i runs from edges[2i] to edges[2i + 1], long edges split
+  // into pieces no longer than a cell
+  Vector3 *edges;
+  int nedges;
+  BoundingBox box;
+  int dim[3];
+  float cell;
+  // CSR: the vertices in cell c are vitems[vstart[c] .. vstart[c + 1]), the
+  // edges crossing its bounds likewise in eitems
+  int *vstart, *vitems;
+  int *estart, *eitems;
+} SnapIndex;
+
+enum { SNAP_NONE, SNAP_VERTEX, SNAP_EDGE };
+
+inline int SnapCell(const SnapIndex &s, int x, int y, int z) {
+  return (z * s.dim[1] + y) * s.dim[0] + x;
+}
+
+inline void SnapCellOf(const SnapIndex &s, Vector3 p, int c[3]) {
+  for (int i = 0; i < 3; i++)
+    c[i] = (int)Clamp(((&p.x)[i] - (&s.box.min.x)[i]) / s.cell, 0,
+                      s.dim[i] - 1);
+}
+
+// fill start/items so that every item lands in the cells between lo and hi
+// of its bounds
+template <typename Bounds>
+inline void BuildSnapCells(const SnapIndex &s, int n, Bounds bounds,
+                           int **start, int **items, ModelArena *arena) {
+  int ncells = s.dim[0] * s.dim[1] * s.dim[2];
+  *start = (int *)ModelCalloc(arena, (ncells + 1) * sizeof(int));
+  for (int pass = 0; pass < 2; pass++) {
+    if (pass == 1) {
+      for (int c = 0; c < ncells; c++)
+        (*start)[c + 1] += (*start)[c];
+      *items = (int *)ModelAlloc(arena,
+                                 std::max(1, (*start)[ncells]) * sizeof(int));
+    }
+    for (int i = 0; i < n; i++) {
+      Vector3 lo, hi;
+      bounds(i, &lo, &hi);
+      int a[3], b[3];
+      SnapCellOf(s, lo, a);
+      SnapCellOf(s, hi, b);
+      for (int z = a[2]; z <= b[2]; z++)
+        for (int y = a[1]; y <= b[1]; y++)
+          for (int x = a[0]; x <= b[0]; x++) {
+            int c = SnapCell(s, x, y, z);
+            if (pass == 0)
+              (*start)[c + 1]++;
+            else
+              (*items)[(*start)[c]++] = i;
+          }
+    }
+  }
+  // the fill pass advanced every start to the next cell's start
+  for (int c = ncells; c > 0; c--)
+    (*start)[c] = (*start)[c - 1];
+  (*start)[0] = 0;
+}
+
+// the arrays come from arena when given; UnloadSnapIndex is for the malloc'd
+// ones only
+inline SnapIndex BuildSnapIndex(const Mesh &mesh, const int *adj,
+                                float feature_angle,
+                                ModelArena *arena = NULL) {
+  SnapIndex s = {0};
+  int n = mesh.triangleCount;
+  const float *v = mesh.vertices;
+
+  // welded vertices: equal positions once
+  std::vector<Vector3> verts(3 * n);
+  for (int i = 0; i < 3 * n; i++)
+    verts[i] = (Vector3){v[3 * i], v[3 * i + 1], v[3 * i + 2]};
+  auto less = [](Vector3 a, Vector3 b) {
+    return a.x != b.x ? a.x < b.x : a.y != b.y ? a.y < b.y : a.z < b.z;
+  };
+  std::sort(verts.begin(), verts.end(), less);
+  verts.erase(std::unique(verts.begin(), verts.end(),
+                          [](Vector3 a, Vector3 b) {
+                            return a.x == b.x && a.y == b.y && a.z == b.z;
+                          }),
+              verts.end());
+
+  // feature edges, each shared edge once from its lower numbered triangle
+  float cos_max = cosf(DEG2RAD * feature_angle);
+  std::vector<Vector3> edges;
+  Vector3 p[3], q[3];
+  for (int t = 0; t < n; t++) {
+    MeshTriangle(mesh, t, p);
+    Vector3 nt =
+        Vector3Normalize(Vector3CrossProduct(p[1] - p[0], p[2] - p[0]));
+    for (int e = 0; e < 3; e++) {
+      int u = adj[3 * t + e];
+      if (u >= 0 && u < t)
+        continue;
+      if (u >= 0) {
+        MeshTriangle(mesh, u, q);
+        Vector3 nu =
+            Vector3Normalize(Vector3CrossProduct(q[1] - q[0], q[2] - q[0]));
+        if (Vector3DotProduct(nt, nu) >= cos_max)
+          continue;
+      }
+      edges.push_back(p[e]);
+      edges.push_back(p[(e + 1) % 3]);
+    }
+  }
+
+  s.nverts = (int)verts.size();
+  s.verts =
+      (Vector3 *)ModelAlloc(arena, std::max(1, s.nverts) * sizeof(Vector3));
+  std::copy(verts.begin(), verts.end(), s.verts);
+
+  // about four vertices per cell, with flat parts kept to a single layer
+  s.box = (BoundingBox){{INFINITY, INFINITY, INFINITY},
+                        {-INFINITY, -INFINITY, -INFINITY}};
+  for (int i = 0; i < s.nverts; i++) {
+    s.box.min = Vector3Min(s.box.min, s.verts[i]);
+    s.box.max = Vector3Max(s.box.max, s.verts[i]);
+  }
+  if (s.nverts == 0)
+    s.box = (BoundingBox){0};
+  Vector3 size = s.box.max - s.box.min;
+  float longest = fmaxf(size.x, fmaxf(size.y, size.z)), volume = 1;
+  for (int i = 0; i < 3; i++)
+    volume *= fmaxf((&size.x)[i], longest * 1e-3f);
+  s.cell = cbrtf(volume / std::max(1, s.nverts / 4));
+  s.cell = fmaxf(s.cell, longest / 255); // at most 256 cells along an axis
+  if (!(s.cell > 0))
+    s.cell = 1;
+  for (int i = 0; i < 3; i++)
+    s.dim[i] = std::min((int)((&size.x)[i] / s.cell) + 1, 256);
+
+  // a diagonal edge across the part would otherwise sit in every cell of its
+  // bounding box
+  std::vector<Vector3> pieces;
+  for (size_t i = 0; i < edges.size(); i += 2) {
+    Vector3 a = edges[i], d = edges[i + 1] - edges[i];
+    int k = std::min(1 + (int)(Vector3Length(d) / s.cell), 1024);
+    for (int j = 0; j < k; j++) {
+      pieces.push_back(a + d * ((float)j / k));
+      pieces.push_back(a + d * ((float)(j + 1) / k));
+    }
+  }
+  s.nedges = (int)pieces.size() / 2;
+  s.edges = (Vector3 *)ModelAlloc(arena,
+                                  std::max(2, 2 * s.nedges) * sizeof(Vector3));
+  std::copy(pieces.begin(), pieces.end(), s.edges);
+
+  BuildSnapCells(
+      s, s.nverts,
+      [&s](int i, Vector3 *lo, Vector3 *hi) { *lo = *hi = s.verts[i]; },
+      &s.vstart, &s.vitems, arena);
+  BuildSnapCells(
+      s, s.nedges,
+      [&s](int i, Vector3 *lo, Vector3 *hi) {
+        *lo = Vector3Min(s.edges[2 * i], s.edges[2 * i + 1]);
+        *hi = Vector3Max(s.edges[2 * i], s.edges[2 * i + 1]);
+      },
+      &s.estart, &s.eitems, arena);
+  return s;
+}
+
+inline void UnloadSnapIndex(SnapIndex s) {
+  free(s.verts);
+  free(s.edges);
+  free(s.vstart);
+  free(s.vitems);
+  free(s.estart);
+  free(s.eitems);
+}
+
+// point on segment ab closest to the ray's line
+inline Vector3 ClosestPointSegmentRay(Vector3 a, Vector3 b, Ray ray) {
+  Vector3 d = b - a, w = a - ray.position;
+  float dd = Vector3DotProduct(d, d), dr = Vector3DotProduct(d, ray.direction);
+  float rr = Vector3DotProduct(ray.direction, ray.direction);
+  float den = dd * rr - dr * dr;
+  float s = 0;
+  if (den > 1e-12f * dd * rr)
+    s = (dr * Vector3DotProduct(ray.direction, w) -
+         rr * Vector3DotProduct(d, w)) /
+        den;
+  return a + d * Clamp(s, 0, 1);
+}
+
+// world size of radius_px pixels at distance dist in front of the camera
+inline float SnapRadius(const Camera3D &cam, float dist, float radius_px) {
+  float pixel = cam.projection == CAMERA_ORTHOGRAPHIC
+                    ? cam.fovy / SCREEN_HEIGHT
+                    : 2 * dist * tanf(DEG2RAD * cam.fovy / 2) / SCREEN_HEIGHT;
+  return radius_px * pixel;
+}
+
+// snap the pick at hit (where ray meets the surface) to the vertex nearest
+// to the ray within radius, or failing that to the nearest point of a feature
+// edge. Distances are measured from the ray, i.e. across the screen.
+inline int SnapPick(const SnapIndex &s, Ray ray, Vector3 hit, float radius,
+                    Vector3 *out) {
+  if (s.nverts == 0)
+    return SNAP_NONE;
+  int a[3], b[3];
+  Vector3 r = {radius, radius, radius};
+  SnapCellOf(s, hit - r, a);
+  SnapCellOf(s, hit + r, b);
+
+  float best = radius;
+  int kind = SNAP_NONE;
+  for (int z = a[2]; z <= b[2]; z++)
+    for (int y = a[1]; y <= b[1]; y++)
+      for (int x = a[0]; x <= b[0]; x++) {
+        int c = SnapCell(s, x, y, z);
+        for (int i = s.vstart[c]; i < s.vstart[c + 1]; i++) {
+          Vector3 p = s.verts[s.vitems[i]];
+          float d = RayVector3Distance(ray, p);
+          if (d <= best && Vector3Distance(p, hit) <= radius) {
+            best = d;
+            *out = p;
+            kind = SNAP_VERTEX;
+          }
+        }
+      }
+  if (kind == SNAP_VERTEX)
+    return kind;
+
+  for (int z = a[2]; z <= b[2]; z++)
+    for (int y = a[1]; y <= b[1]; y++)
+      for (int x = a[0]; x <= b[0]; x++) {
+        int c = SnapCell(s, x, y, z);
+        for (int i = s.estart[c]; i < s.estart[c + 1]; i++) {
+          int e = s.eitems[i];
+          Vector3 p =
+              ClosestPointSegmentRay(s.edges[2 * e], s.edges[2 * e + 1], ray);
+          float d = RayVector3Distance(ray, p);
+          if (d <= best && Vector3Distance(p, hit) <= radius) {
+            best = d;
+            *out = p;
+            kind = SNAP_EDGE;
+          }
+        }
+      }
+  return kind;
+}
+#define SNAP_ONCE
+#endif
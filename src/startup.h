@@ -0,0 +1,47 @@
+#ifndef STARTUP_ONCE
+#include "main.h"
+#include <chrono>
+#include <mutex>
+
+// Wall clock breakdown of the startup phases, which run on two threads: the
+// "load" worker (database, STL parse, picking structures) and "main" (window,
+// GL context, upload). Printed once the first frame is on screen.
+#define MAX_STARTUP_PHASES 16
+
+typedef struct StartupPhaseTime {
+  const char *thread;
+  const char *name;
+  double start, end; // ms since launch
+} StartupPhaseTime;
+
+static StartupPhaseTime startup_phases[MAX_STARTUP_PHASES];
+static int nstartup_phases = 0;
+static std::mutex startup_lock;
+static const std::chrono::steady_clock::time_point startup_t0 =
+    std::chrono::steady_clock::now();
+
+inline double StartupClock() {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - startup_t0)
+      .count();
+}
+
+// record a phase that began at StartupClock() == start and ends now
+inline void StartupPhase(const char *thread, const char *name, double start) {
+  std::lock_guard<std::mutex> guard(startup_lock);
+  if (nstartup_phases < MAX_STARTUP_PHASES)
+    startup_phases[nstartup_phases++] =
+        (StartupPhaseTime){thread, name, start, StartupClock()};
+}
+
+inline void PrintStartupPhases() {
+  std::lock_guard<std::mutex> guard(startup_lock);
+  printf("startup (ms since launch):\n");
+  for (int i = 0; i < nstartup_phases; i++)
+    printf("  %-5s %-16s %8.1f - %8.1f (%.1f)\n", startup_phases[i].thread,
+           startup_phases[i].name, startup_phases[i].start,
+           startup_phases[i].end,
+           startup_phases[i].end - startup_phases[i].start);
+}
+#define STARTUP_ONCE
+#endif
@@ -0,0 +1,278 @@
+#ifndef THUMBS_ONCE
+#include "context.h"
+#include "initdb.h"
+#include "main.h"
+#include "rlgl.h"
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+// Camera browser: every cams row of the current STL as a thumbnail in a strip
+// along the right edge of the window. Clicking one jumps to that camera. Each
+// thumbnail is rendered into a tile of a shared atlas, and again only when
+// its camera row or the model changes. Tiles are keyed by cams rowid and
+// recycled least recently used first, so any number of cameras can be
+// scrolled through while the THUMB_TILES around the visible ones stay
+// cached. Missing tiles are rendered a few per frame, visible ones first,
+// within THUMB_BUDGET_SECONDS, so opening the strip on a part with hundreds
+// of cameras does not stall.
+
+#define THUMB_WIDTH 96 // the window's aspect, so a thumbnail frames like it
+#define THUMB_HEIGHT 64
+#define THUMB_GAP 4
+#define THUMB_COLS 16
+#define THUMB_ROWS 32
+#define THUMB_TILES (THUMB_COLS * THUMB_ROWS)
+#define THUMB_BUDGET_SECONDS 0.004
+#define THUMB_READ_SECONDS 1.0 // how often an open strip rereads cams
+
+typedef struct CamThumb {
+  int cam_id;
+  Camera3D camera;
+} CamThumb;
+
+// what one tile of the atlas holds
+typedef struct AtlasTile {
+  int cam_id = -1;
+  Camera3D camera = {0}; // as rendered, valid once drawn
+  bool drawn = false;
+  long long used = 0; // last frame the tile was in the strip's window
+} AtlasTile;
+
+typedef struct ThumbStrip {
+  bool open = false;
+  std::vector<CamThumb> thumbs; // every camera of the STL in rowid order
+  int first = 0;                // topmost thumbnail on screen
+  std::vector<AtlasTile> tiles = std::vector<AtlasTile>(THUMB_TILES);
+  std::unordered_map<int, int> tile_of; // cam_id to its tile
+  long long frame = 0;
+
+  // what the tiles were rendered for
+  int stl_id = 0;
+  std::string stl_hash;
+  unsigned int vao = 0;
+  double last_read = -1;
+  int writes = -1;
+
+  RenderTexture2D atlas = {0};
+  RenderTexture2D scratch = {0}; // one thumbnail, copied into its tile
+} ThumbStrip;
+
+// the cameras of stl_id in rowid order
+inline bool ReadCamThumbs(sqlite3 *db, int stl_id,
+                          std::vector<CamThumb> *out) {
+  sqlite3_stmt *stmt;
+  const char *sql = "SELECT rowid, posx, posy, posz, tx, ty, tz, upx, upy, "
+                    "upz, fovy, proj FROM cams WHERE stl = ? ORDER BY rowid;";
+  if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    return false;
+  }
+  sqlite3_bind_int(stmt, 1, stl_id);
+  out->clear();
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    float v[10];
+    for (int i = 0; i < 10; i++)
+      v[i] = (float)sqlite3_column_double(stmt, 1 + i);
+    CamThumb t = {.cam_id = sqlite3_column_int(stmt, 0),
+                  .camera = {.position = {v[0], v[1], v[2]},
+                             .target = {v[3], v[4], v[5]},
+                             .up = {v[6], v[7], v[8]},
+                             .fovy = v[9],
+                             .projection = sqlite3_column_int(stmt, 11)}};
+    out->push_back(t);
+  }
+  sqlite3_finalize(stmt);
+  return true;
+}
+
+inline void ClearThumbTiles(ThumbStrip *s) {
+  s->tiles.assign(THUMB_TILES, AtlasTile());
+  s->tile_of.clear();
+}
+
+// the tile showing t as it is now, -1 if it has none or its camera moved
+inline int FindThumbTile(const ThumbStrip *s, const CamThumb &t) {
+  auto it = s->tile_of.find(t.cam_id);
+  if (it == s->tile_of.end())
+    return -1;
+  const AtlasTile &tile = s->tiles[it->second];
+  return tile.drawn &&
+                 memcmp(&tile.camera, &t.camera, sizeof(Camera3D)) == 0
+             ? it->second
+             : -1;
+}
+
+// a tile to render cam_id into: its own, or the least recently used one.
+// Taken tiles count as used this frame.
+inline int AcquireThumbTile(ThumbStrip *s, int cam_id) {
+  auto it = s->tile_of.find(cam_id);
+  int i = 0;
+  if (it != s->tile_of.end()) {
+    i = it->second;
+  } else {
+    for (int j = 1; j < THUMB_TILES; j++)
+      if (s->tiles[j].used < s->tiles[i].used)
+        i = j;
+    if (s->tiles[i].cam_id >= 0)
+      s->tile_of.erase(s->tiles[i].cam_id);
+    s->tile_of[cam_id] = i;
+  }
+  s->tiles[i] = (AtlasTile){.cam_id = cam_id, .used = s->frame};
+  return i;
+}
+
+// tile now shows t
+inline void MarkThumbDrawn(ThumbStrip *s, int tile, const CamThumb &t) {
+  s->tiles[tile].camera = t.camera;
+  s->tiles[tile].drawn = true;
+}
+
+inline Rectangle ThumbTileRect(int i) {
+  return (Rectangle){(float)(i % THUMB_COLS * THUMB_WIDTH),
+                     (float)(i / THUMB_COLS * THUMB_HEIGHT), THUMB_WIDTH,
+                     THUMB_HEIGHT};
+}
+
+inline int ThumbsShown(const ThumbStrip *s) { return (int)s->thumbs.size(); }
+
+inline int ThumbsOnScreen() {
+  return SCREEN_HEIGHT / (THUMB_HEIGHT + THUMB_GAP);
+}
+
+inline Rectangle ThumbScreenRect(const ThumbStrip *s, int i) {
+  int k = i - s->first;
+  return (Rectangle){(float)(SCREEN_WIDTH - THUMB_WIDTH - THUMB_GAP),
+                     (float)(THUMB_GAP + k * (THUMB_HEIGHT + THUMB_GAP)),
+                     THUMB_WIDTH, THUMB_HEIGHT};
+}
+
+inline void RenderThumb(ThumbStrip *s, const PickerContext *ctx,
+                        const CamThumb &t) {
+  int i = AcquireThumbTile(s, t.cam_id);
+  BeginTextureMode(s->scratch);
+  ClearBackground(RAYWHITE);
+  BeginMode3D(t.camera);
+  BeginShaderMode(shader);
+  DrawModel(ctx->stl_model, Vector3Zero(), 1.0f, (Color){0, 255, 255, 128});
+  EndShaderMode();
+  EndMode3D();
+  EndTextureMode();
+
+  Rectangle tile = ThumbTileRect(i);
+  BeginTextureMode(s->atlas);
+  rlDisableColorBlend(); // replace the tile, alpha included
+  DrawTextureRec(s->scratch.texture,
+                 (Rectangle){0, 0, THUMB_WIDTH, -THUMB_HEIGHT},
+                 (Vector2){tile.x, tile.y}, WHITE);
+  rlEnableColorBlend();
+  EndTextureMode();
+  MarkThumbDrawn(s, i, t);
+}
+
+// once per frame before BeginDrawing, while the model is loaded: track the
+// cams rows and the model, and render missing tiles within the budget
+inline void UpdateThumbStrip(ThumbStrip *s, PickerContext *ctx, double now) {
+  if (IsKeyPressed(KEY_B)) {
+    s->open = !s->open;
+    s->last_read = -1;
+  }
+  if (!s->open)
+    return;
+  if (!s->atlas.id) {
+    s->atlas = LoadRenderTexture(THUMB_COLS * THUMB_WIDTH,
+                                 THUMB_ROWS * THUMB_HEIGHT);
+    s->scratch = LoadRenderTexture(THUMB_WIDTH, THUMB_HEIGHT);
+  }
+
+  // a new model or revision invalidates every tile
+  if (s->stl_id != ctx->selected_stl_id || s->stl_hash != ctx->stl_hash ||
+      s->vao != ctx->gpu.vao) {
+    s->stl_id = ctx->selected_stl_id;
+    s->stl_hash = ctx->stl_hash;
+    s->vao = ctx->gpu.vao;
+    s->thumbs.clear();
+    ClearThumbTiles(s);
+    s->first = 0;
+    s->last_read = -1;
+  }
+  // cameras written here show up at once, those of other processes within
+  // THUMB_READ_SECONDS
+  if (s->writes != ctx->writes || now - s->last_read >= THUMB_READ_SECONDS) {
+    std::vector<CamThumb> rows;
+    if (ReadCamThumbs(ctx->db, ctx->selected_stl_id, &rows))
+      s->thumbs = std::move(rows);
+    s->writes = ctx->writes;
+    s->last_read = now;
+  }
+
+  int n = ThumbsShown(s);
+  float wheel = GetMouseWheelMove();
+  if (wheel != 0 && GetMousePosition().x >= ThumbScreenRect(s, 0).x)
+    s->first -= (int)wheel;
+  s->first = std::max(0, std::min(s->first, n - ThumbsOnScreen()));
+
+  // the window of up to THUMB_TILES thumbnails from the visible ones on
+  // keeps its tiles; the visible ones are rendered first
+  s->frame++;
+  double start = GetTime();
+  for (int k = 0; k < std::min(n, THUMB_TILES); k++) {
+    const CamThumb &t = s->thumbs[(s->first + k) % n];
+    int tile = FindThumbTile(s, t);
+    if (tile >= 0)
+      s->tiles[tile].used = s->frame;
+    else if (GetTime() - start < THUMB_BUDGET_SECONDS)
+      RenderThumb(s, ctx, t);
+  }
+}
+
+// a click on a thumbnail jumps to its camera; true if it took the click
+inline bool ClickThumbStrip(ThumbStrip *s, PickerContext *ctx) {
+  if (!s->open || !IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
+    return false;
+  Vector2 mouse = GetMousePosition();
+  int n = ThumbsShown(s);
+  for (int i = s->first; i < n && i < s->first + ThumbsOnScreen(); i++) {
+    if (!CheckCollisionPointRec(mouse, ThumbScreenRect(s, i)))
+      continue;
+    if (LoadCameraID(ctx, s->thumbs[i].cam_id))
+      ctx->cameraid = s->thumbs[i].cam_id;
+    return true;
+  }
+  return false;
+}
+
+inline void DrawThumbStrip(const ThumbStrip *s, const PickerContext *ctx) {
+  if (!s->open)
+    return;
+  int n = ThumbsShown(s);
+  for (int i = s->first; i < n && i < s->first + ThumbsOnScreen(); i++) {
+    Rectangle r = ThumbScreenRect(s, i);
+    int t = FindThumbTile(s, s->thumbs[i]);
+    if (t >= 0) {
+      Rectangle tile = ThumbTileRect(t);
+      // render textures are upside down
+      DrawTextureRec(s->atlas.texture,
+                     (Rectangle){tile.x, s->atlas.texture.height - tile.y -
+                                             THUMB_HEIGHT,
+                                 THUMB_WIDTH, -THUMB_HEIGHT},
+                     (Vector2){r.x, r.y}, WHITE);
+    } else {
+      DrawRectangleRec(r, LIGHTGRAY);
+    }
+    bool current = !ctx->camdirty && s->thumbs[i].cam_id == ctx->cameraid;
+    DrawRectangleLinesEx(r, current ? 2 : 1, current ? RED : DARKGRAY);
+    DrawText(TextFormat("%d", s->thumbs[i].cam_id), (int)r.x + 3,
+             (int)r.y + 3, 10, DARKGRAY);
+  }
+}
+
+inline void UnloadThumbStrip(ThumbStrip *s) {
+  if (s->atlas.id) {
+    UnloadRenderTexture(s->atlas);
+    UnloadRenderTexture(s->scratch);
+  }
+  s->atlas = s->scratch = (RenderTexture2D){0};
+}
+#define THUMBS_ONCE
+#endif
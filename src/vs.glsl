@@ -1,9 +1,13 @@
 #version 330 core
 
 
+// compact.h layout: unorm16x3 position inside the model bounds, octahedral
+
+// snorm16x2 normal
+
 in vec3 vertexPosition;
 
-in vec3 vertexNormal;
+in vec2 vertexNormal;
 
 in vec4 vertexColor;
 
@@ -21,14 +25,37 @@ uniform mat4 matView;
 
 uniform mat4 matProjection;
 
+uniform vec3 boundsMin;
+
+uniform vec3 boundsSize;
+
+
+vec3 octDecode(vec2 e)
+
+{
+
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+
+    float t = max(-n.z, 0.0);
+
+    n.x += n.x >= 0.0 ? -t : t;
+
+    n.y += n.y >= 0.0 ? -t : t;
+
+    return normalize(n);
+
+}
+
 
 void main()
 
 {
 
-    fragPosition = vec3(matModel * vec4(vertexPosition, 1.0));
+    vec3 position = boundsMin + vertexPosition * boundsSize;
+
+    fragPosition = vec3(matModel * vec4(position, 1.0));
 
-    fragNormal = vertexNormal;  
+    fragNormal = octDecode(vertexNormal);
 
     fragColor = vertexColor;
 
@@ -0,0 +1,119 @@
+// End to end replay throughput on a database from waterfall-picker-gendb:
+// for every revision 0 model, replay its picks onto each later revision and
+// time database open, STL load (read + parse), BVH build, replay and
+// write-back. Prints a JSON report, also written to --out when given.
+//
+//   bench_replay bench.sqlite3 [--out report.json]
+#include "bvh.h"
+#include "initdb.h"
+#include "replay.h"
+#include <chrono>
+#include <string>
+
+static double Ms(std::chrono::steady_clock::time_point since) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - since)
+      .count();
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    printf("Usage: %s <database_path> [--out report.json]\n", argv[0]);
+    return 1;
+  }
+  const char *out_path = argc > 3 && strcmp(argv[2], "--out") == 0 ? argv[3]
+                                                                   : NULL;
+
+  sqlite3 *db;
+  auto t = std::chrono::steady_clock::now();
+  if (!InitDatabase(argv[1], &db))
+    return 1;
+  double open_ms = Ms(t);
+
+  sqlite3_stmt *pairs;
+  const char *sql = "SELECT a.stl, b.stl FROM stldescs a "
+                    "JOIN stldescs b ON a.module = b.module "
+                    "WHERE a.desc = 'rev 0' AND b.desc != 'rev 0' "
+                    "ORDER BY a.stl, b.stl;";
+  if (sqlite3_prepare_v2(db, sql, -1, &pairs, NULL) != SQLITE_OK) {
+    printf("SQL error: %s\n", sqlite3_errmsg(db));
+    return 1;
+  }
+
+  std::string report;
+  char buf[512];
+  snprintf(buf, sizeof buf, "{\"database\":\"%s\",\"open_ms\":%.3f,\"runs\":[",
+           argv[1], open_ms);
+  report += buf;
+
+  bool ok = true;
+  int runs = 0;
+  long total_picks = 0;
+  double total_replay_ms = 0, total_write_ms = 0;
+  while (ok && sqlite3_step(pairs) == SQLITE_ROW) {
+    int from = sqlite3_column_int(pairs, 0), to = sqlite3_column_int(pairs, 1);
+    Mesh mesh;
+    t = std::chrono::steady_clock::now();
+    ok = ReadSTLFromDB(db, to, &mesh);
+    double load_ms = Ms(t);
+    if (!ok)
+      break;
+
+    t = std::chrono::steady_clock::now();
+    Bvh bvh = BuildBvh(mesh);
+    double bvh_ms = Ms(t);
+
+    ReplayPick *p = NULL;
+    int n = LoadReplayPicks(db, from, &p);
+    int ncams = 0;
+    for (int i = 0; i < n; i++)
+      ncams += i == 0 || p[i].cam != p[i - 1].cam;
+
+    t = std::chrono::steady_clock::now();
+    ok = n >= 0 && ReplayPicks(db, mesh, bvh, p, n);
+    double replay_ms = Ms(t);
+
+    t = std::chrono::steady_clock::now();
+    ok = ok && WriteReplay(db, to, p, n);
+    double write_ms = Ms(t);
+
+    snprintf(buf, sizeof buf,
+             "%s{\"from\":%d,\"to\":%d,\"triangles\":%d,\"cams\":%d,"
+             "\"picks\":%d,\"load_ms\":%.3f,\"bvh_ms\":%.3f,"
+             "\"replay_ms\":%.3f,\"replay_ms_per_cam\":%.4f,"
+             "\"picks_per_s\":%.0f,\"write_ms\":%.3f,\"rows_per_s\":%.0f}",
+             runs ? "," : "", from, to, mesh.triangleCount, ncams, n, load_ms,
+             bvh_ms, replay_ms, ncams ? replay_ms / ncams : 0.0,
+             replay_ms > 0 ? n / (replay_ms / 1000) : 0.0, write_ms,
+             write_ms > 0 ? (n + ncams) / (write_ms / 1000) : 0.0);
+    report += buf;
+    runs++;
+    total_picks += n > 0 ? n : 0;
+    total_replay_ms += replay_ms;
+    total_write_ms += write_ms;
+
+    free(p);
+    UnloadBvh(bvh);
+    free(mesh.vertices);
+    free(mesh.normals);
+  }
+  sqlite3_finalize(pairs);
+  sqlite3_close(db);
+
+  snprintf(buf, sizeof buf,
+           "],\"total\":{\"runs\":%d,\"picks\":%ld,\"replay_ms\":%.3f,"
+           "\"write_ms\":%.3f}}\n",
+           runs, total_picks, total_replay_ms, total_write_ms);
+  report += buf;
+  fputs(report.c_str(), stdout);
+  if (out_path) {
+    FILE *f = fopen(out_path, "w");
+    if (!f) {
+      printf("Cannot write %s\n", out_path);
+      return 1;
+    }
+    fputs(report.c_str(), f);
+    fclose(f);
+  }
+  return ok && runs > 0 ? 0 : 1;
+}
@@ -1,5 +1,11 @@
+#include "bvh.h"
+#include "compact.h"
 #include "geometry.h"
+#include "raygen.h"
+#include "reorder.h"
+#include "snap.h"
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <gtest/gtest.h>
 #include <random>
@@ -150,3 +156,474 @@ TEST(GetRayCollisionPlaneTest, RandomizedTransform) {
   EXPECT_NEAR(collision.point.y, translation.y, 1e-5);
   EXPECT_NEAR(collision.point.z, translation.z, 1e-5);
 }
+
+// signed distance of x from the plane through p, positive away from eye
+float BeyondPlane(Vector3 p[3], Vector3 eye, Vector3 x) {
+  Vector3 n = Vector3Normalize(Vector3CrossProduct(p[2] - p[0], p[1] - p[0]));
+  if (Vector3DotProduct(n, eye - p[0]) > 0)
+    n *= -1;
+  return Vector3DotProduct(n, x - p[0]);
+}
+
+TEST(SupportPlaneTest, AgreesWithAdvancePlaneOnPlanarHits) {
+  std::mt19937 rng(36);
+  std::uniform_real_distribution<float> u(-1, 1);
+  Vector3 eye = {0, 0, 5};
+  for (int k = 0; k < 50; k++) {
+    // a plane facing the eye, sampled on a grid as AttachPolygon1 does
+    Vector3 n = Vector3Normalize((Vector3){u(rng) / 2, u(rng) / 2, 1});
+    Vector3 o = {u(rng), u(rng), u(rng)};
+    Vector3 e1 = Vector3Normalize(Vector3CrossProduct(n, (Vector3){1, 0, 0}));
+    Vector3 e2 = Vector3CrossProduct(n, e1);
+    std::vector<Vector3> x;
+    for (int i = 0; i < 10; i++)
+      for (int j = 0; j < 10; j++)
+        x.push_back(o + e1 * (i / 9.f - 0.5f) + e2 * (j / 9.f - 0.5f));
+
+    Vector3 lp[3], adv[3] = {x[0], x[9], x[99]};
+    for (size_t i = 0; i < x.size(); i++)
+      AdvancePlane(eye, adv, x[i]);
+    ASSERT_TRUE(SupportPlane(eye, x.data(), (int)x.size(), lp));
+    for (size_t i = 0; i < x.size(); i++) {
+      EXPECT_NEAR(BeyondPlane(adv, eye, x[i]), 0, 1e-4);
+      EXPECT_NEAR(BeyondPlane(lp, eye, x[i]), 0, 1e-4);
+    }
+  }
+}
+
+TEST(SupportPlaneTest, TouchesButDoesNotPenetrateSphere) {
+  std::mt19937 rng(36);
+  std::uniform_real_distribution<float> u(-1, 1);
+  Vector3 eye = {0, 0, 5};
+  for (int k = 0; k < 50; k++) {
+    // hits on the near cap of a sphere, as seen from eye
+    Vector3 center = {u(rng), u(rng), u(rng) - 1};
+    float r = 1 + u(rng) / 2;
+    std::vector<Vector3> x;
+    while (x.size() < 200) {
+      Vector3 d = Vector3Normalize((Vector3){u(rng), u(rng), u(rng)});
+      Vector3 q = center + d * r;
+      if (Vector3DotProduct(d, eye - center) > 0.5f * Vector3Distance(eye,
+                                                                      center))
+        x.push_back(q);
+    }
+    Vector3 lp[3];
+    ASSERT_TRUE(SupportPlane(eye, x.data(), (int)x.size(), lp));
+    float lo = INFINITY;
+    for (size_t i = 0; i < x.size(); i++)
+      lo = fminf(lo, BeyondPlane(lp, eye, x[i]));
+    EXPECT_NEAR(lo, 0, 1e-4); // touches, and nothing pokes through
+    // the plane faces the eye and separates it from the hits
+    EXPECT_LT(BeyondPlane(lp, eye, eye), 0);
+  }
+}
+
+TEST(SupportPlaneTest, RejectsTooFewHits) {
+  Vector3 eye = {0, 0, 5}, x[2] = {{0, 0, 0}, {1, 0, 0}}, p[3];
+  EXPECT_FALSE(SupportPlane(eye, x, 2, p));
+}
+
+TEST(ClosestPointTriangleTest, RegionsOfUnitTriangle) {
+  Vector3 a = {0, 0, 0}, b = {1, 0, 0}, c = {0, 1, 0};
+  struct {
+    Vector3 p, expected;
+  } cases[] = {
+      {{0.25f, 0.25f, 3}, {0.25f, 0.25f, 0}}, // face
+      {{-1, -1, 1}, a},                       // vertex regions
+      {{2, -0.5f, 0}, b},
+      {{-0.5f, 2, -1}, c},
+      {{0.5f, -1, 0}, {0.5f, 0, 0}},   // edge ab
+      {{-1, 0.5f, 2}, {0, 0.5f, 0}},   // edge ac
+      {{1, 1, 0}, {0.5f, 0.5f, 0}},    // edge bc
+  };
+  for (auto &k : cases) {
+    Vector3 q = ClosestPointTriangle(k.p, a, b, c);
+    EXPECT_NEAR(q.x, k.expected.x, 1e-5);
+    EXPECT_NEAR(q.y, k.expected.y, 1e-5);
+    EXPECT_NEAR(q.z, k.expected.z, 1e-5);
+  }
+}
+
+TEST(ClosestPointTriangleTest, RandomizedNotBeatenBySamples) {
+  std::srand(std::time(nullptr));
+  for (int k = 0; k < 100; k++) {
+    Vector3 t[3], p = ArbitraryVector3() * 2 - (Vector3){0.5f, 0.5f, 0.5f};
+    GenerateArbitraryVector3Array(t);
+    float d = Vector3Distance(p, ClosestPointTriangle(p, t[0], t[1], t[2]));
+    // no point of a barycentric grid on the triangle is closer
+    for (int i = 0; i <= 20; i++)
+      for (int j = 0; i + j <= 20; j++) {
+        Vector3 s = t[0] + (t[1] - t[0]) * (i / 20.f) + (t[2] - t[0]) * (j / 20.f);
+        EXPECT_LE(d, Vector3Distance(p, s) + 1e-5);
+      }
+  }
+}
+
+TEST(CompactVertexTest, OctahedralNormalRoundTrip) {
+  std::srand(std::time(nullptr));
+  Vector3 axes[] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0},
+                    {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+  for (Vector3 n : axes) {
+    int16_t e[2];
+    OctEncode(n, e);
+    EXPECT_LT(Vector3Distance(OctDecode(e), n), 1e-4);
+  }
+  for (int k = 0; k < 1000; k++) {
+    Vector3 n = Vector3Normalize(ArbitraryVector3() * 2 -
+                                 (Vector3){1, 1, 1});
+    int16_t e[2];
+    OctEncode(n, e);
+    // snorm16 keeps normals within a few thousandths of a degree
+    EXPECT_LT(Vector3Angle(OctDecode(e), n), 1e-3);
+  }
+}
+
+TEST(CompactVertexTest, PositionsWithinHalfAStep) {
+  float v[9] = {-10, 0, 5, 30, 2, 5, 7.3f, 1.1f, 25};
+  float n[9] = {0, 0, 1, 0, 0, 1, 0, 0, 1};
+  Mesh mesh = {0};
+  mesh.vertexCount = 3;
+  mesh.vertices = v;
+  mesh.normals = n;
+  BoundingBox b = {{-10, 0, 5}, {30, 2, 25}};
+  CompactVertex *c = EncodeCompactVertices(mesh, b);
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++) {
+      float size = (&b.max.x)[j] - (&b.min.x)[j];
+      float decoded = (&b.min.x)[j] + c[i].pos[j] / 65535.f * size;
+      EXPECT_NEAR(decoded, v[3 * i + j], 0.5f * size / 65535 + 1e-5);
+    }
+  free(c);
+}
+
+TEST(MortonOrderTest, CodeInterleavesAxes) {
+  BoundingBox b = {{0, 0, 0}, {1024, 1024, 1024}};
+  EXPECT_EQ(MortonCode({0, 0, 0}, b), 0u);
+  EXPECT_EQ(MortonCode({1, 0, 0}, b), 1u);
+  EXPECT_EQ(MortonCode({0, 1, 0}, b), 2u);
+  EXPECT_EQ(MortonCode({0, 0, 1}, b), 4u);
+  EXPECT_EQ(MortonCode({1024, 1024, 1024}, b), (1u << 30) - 1);
+}
+
+TEST(MortonOrderTest, SortKeepsTrianglesAndRecordsPermutation) {
+  std::srand(std::time(nullptr));
+  const int n = 500;
+  Mesh mesh = {0};
+  mesh.triangleCount = n;
+  mesh.vertexCount = 3 * n;
+  mesh.vertices = (float *)malloc(9 * n * sizeof(float));
+  mesh.normals = (float *)malloc(9 * n * sizeof(float));
+  for (int i = 0; i < 9 * n; i++) {
+    mesh.vertices[i] = 100.f * std::rand() / RAND_MAX;
+    mesh.normals[i] = (float)(i / 9); // tags the original triangle
+  }
+  std::vector<float> before(mesh.vertices, mesh.vertices + 9 * n);
+
+  int *order = SortTrianglesMorton(&mesh);
+  std::vector<bool> seen(n);
+  BoundingBox b = {{INFINITY, INFINITY, INFINITY},
+                   {-INFINITY, -INFINITY, -INFINITY}};
+  std::vector<Vector3> centroid(n);
+  for (int t = 0; t < n; t++) {
+    ASSERT_GE(order[t], 0);
+    ASSERT_LT(order[t], n);
+    EXPECT_FALSE(seen[order[t]]);
+    seen[order[t]] = true;
+    EXPECT_EQ(mesh.normals[9 * t], (float)order[t]);
+    for (int i = 0; i < 9; i++)
+      EXPECT_EQ(mesh.vertices[9 * t + i], before[9 * order[t] + i]);
+    const float *p = mesh.vertices + 9 * t;
+    centroid[t] = {(p[0] + p[3] + p[6]) / 3, (p[1] + p[4] + p[7]) / 3,
+                   (p[2] + p[5] + p[8]) / 3};
+    b.min = Vector3Min(b.min, centroid[t]);
+    b.max = Vector3Max(b.max, centroid[t]);
+  }
+  for (int t = 1; t < n; t++)
+    EXPECT_LE(MortonCode(centroid[t - 1], b), MortonCode(centroid[t], b));
+  free(order);
+  free(mesh.vertices);
+  free(mesh.normals);
+}
+
+// unit cube as STL-style triangle soup, two triangles per face
+static Mesh CubeMesh() {
+  int quads[6][4] = {{0, 2, 3, 1}, {4, 5, 7, 6}, {0, 1, 5, 4},
+                     {2, 6, 7, 3}, {0, 4, 6, 2}, {1, 3, 7, 5}};
+  Mesh mesh = {0};
+  mesh.triangleCount = 12;
+  mesh.vertexCount = 36;
+  mesh.vertices = (float *)malloc(108 * sizeof(float));
+  float *v = mesh.vertices;
+  for (auto &q : quads)
+    for (int k : {0, 1, 2, 0, 2, 3})
+      for (int j = 0; j < 3; j++)
+        *v++ = (q[k] >> j) & 1;
+  return mesh;
+}
+
+TEST(SnapTest, CubeEdgesAreFeatures) {
+  Mesh mesh = CubeMesh();
+  int *adj = BuildTriangleAdjacency(mesh);
+  SnapIndex s = BuildSnapIndex(mesh, adj, SNAP_FEATURE_ANGLE);
+  EXPECT_EQ(s.nverts, 8);
+  // 12 cube edges, possibly split into pieces; no face diagonals
+  float length = 0;
+  for (int e = 0; e < s.nedges; e++) {
+    Vector3 d = s.edges[2 * e + 1] - s.edges[2 * e];
+    length += Vector3Length(d);
+    int axes = (fabsf(d.x) > 1e-6f) + (fabsf(d.y) > 1e-6f) +
+               (fabsf(d.z) > 1e-6f);
+    EXPECT_EQ(axes, 1);
+  }
+  EXPECT_NEAR(length, 12, 1e-4);
+  UnloadSnapIndex(s);
+  free(adj);
+  free(mesh.vertices);
+}
+
+TEST(SnapTest, SnapsToVertexThenEdge) {
+  Mesh mesh = CubeMesh();
+  int *adj = BuildTriangleAdjacency(mesh);
+  SnapIndex s = BuildSnapIndex(mesh, adj, SNAP_FEATURE_ANGLE);
+  Vector3 out;
+
+  // looking down on the top face, near the (1, 1, 1) corner
+  Ray ray = {{0.95f, 0.97f, 5}, {0, 0, -1}};
+  Vector3 hit = {0.95f, 0.97f, 1};
+  EXPECT_EQ(SnapPick(s, ray, hit, 0.1f, &out), SNAP_VERTEX);
+  EXPECT_LT(Vector3Distance(out, (Vector3){1, 1, 1}), 1e-6);
+
+  // near the x = 1 edge of the top face, far from its corners
+  ray.position = {0.95f, 0.5f, 5};
+  hit = {0.95f, 0.5f, 1};
+  EXPECT_EQ(SnapPick(s, ray, hit, 0.1f, &out), SNAP_EDGE);
+  EXPECT_LT(Vector3Distance(out, (Vector3){1, 0.5f, 1}), 1e-5);
+
+  // the middle of a face has nothing within reach
+  ray.position = {0.5f, 0.5f, 5};
+  hit = {0.5f, 0.5f, 1};
+  EXPECT_EQ(SnapPick(s, ray, hit, 0.1f, &out), SNAP_NONE);
+
+  UnloadSnapIndex(s);
+  free(adj);
+  free(mesh.vertices);
+}
+
+TEST(ArenaTest, ResetMergesBlocksAndKeepsMemory) {
+  ModelArena a = {0};
+  ASSERT_TRUE(ArenaReserve(&a, 1024));
+  char *p = (char *)ArenaAlloc(&a, 100);
+  EXPECT_EQ((uintptr_t)p % ARENA_ALIGN, 0u);
+  char *q = (char *)ArenaAlloc(&a, 1);
+  EXPECT_EQ(q, p + 112); // rounded up to the alignment
+
+  // outgrow the first block, then rewind scratch taken after a mark
+  ArenaMark mark = ArenaGetMark(&a);
+  ArenaAlloc(&a, 4096);
+  EXPECT_NE(a.head->prev, nullptr);
+  EXPECT_EQ(a.head->prev->used, 128u);
+  ArenaRewind(&a, mark);
+  EXPECT_EQ(a.head->used, 0u);
+
+  size_t total = a.total;
+  ArenaReset(&a);
+  EXPECT_EQ(a.head->prev, nullptr);
+  EXPECT_EQ(a.head->cap, total);
+  ArenaBlock *block = a.head;
+  ArenaReset(&a);
+  EXPECT_EQ(a.head, block);
+  ArenaRelease(&a);
+  EXPECT_EQ(a.head, nullptr);
+  EXPECT_EQ(a.total, 0u);
+}
+
+TEST(ArenaTest, BuildersMatchMallocOnes) {
+  Mesh mesh = CubeMesh();
+  ModelArena a = {0};
+  int *adj = BuildTriangleAdjacency(mesh, &a);
+  int *adj0 = BuildTriangleAdjacency(mesh);
+  EXPECT_EQ(memcmp(adj, adj0, 3 * mesh.triangleCount * sizeof(int)), 0);
+  Bvh bvh = BuildBvh(mesh, &a), bvh0 = BuildBvh(mesh);
+  EXPECT_EQ(bvh.nnodes, bvh0.nnodes);
+  EXPECT_EQ(memcmp(bvh.tris, bvh0.tris, bvh.ntris * sizeof(int)), 0);
+  SnapIndex s = BuildSnapIndex(mesh, adj, SNAP_FEATURE_ANGLE, &a);
+  SnapIndex s0 = BuildSnapIndex(mesh, adj0, SNAP_FEATURE_ANGLE);
+  EXPECT_EQ(s.nverts, s0.nverts);
+  EXPECT_EQ(s.nedges, s0.nedges);
+  ArenaRelease(&a);
+  free(adj0);
+  UnloadBvh(bvh0);
+  UnloadSnapIndex(s0);
+  free(mesh.vertices);
+  free(mesh.normals);
+}
+
+TEST(RayGenTest, MatchesGetScreenToWorldRayEx) {
+  std::mt19937 rng(38);
+  std::uniform_real_distribution<float> u(-10, 10);
+  for (int k = 0; k < 200; k++) {
+    Camera3D cam = {.position = {u(rng), u(rng), u(rng)},
+                    .target = {u(rng) / 5, u(rng) / 5, u(rng) / 5},
+                    .up = {0, 1, 0},
+                    .fovy = 30 + fabsf(u(rng)) * 3,
+                    .projection = k % 2 ? CAMERA_ORTHOGRAPHIC
+                                        : CAMERA_PERSPECTIVE};
+    RayGen g = MakeRayGen(cam, SCREEN_WIDTH, SCREEN_HEIGHT);
+    EXPECT_TRUE(RayGenMatches(g, cam, SCREEN_WIDTH, SCREEN_HEIGHT));
+    Vector2 m = {(u(rng) + 10) * SCREEN_WIDTH / 20,
+                 (u(rng) + 10) * SCREEN_HEIGHT / 20};
+    Ray want = GetScreenToWorldRayEx(m, cam, SCREEN_WIDTH, SCREEN_HEIGHT);
+    Ray got = RayGenRay(g, m);
+    // raylib unprojects in float, the near plane 1e5 times closer than the far
+    EXPECT_LT(Vector3Distance(got.position, want.position), 1e-3f);
+    EXPECT_LT(Vector3Distance(got.direction, want.direction), 1e-4f);
+
+    // a grid walks the same affine map
+    Ray grid[12];
+    RayGenGrid(g, m, (Vector2){3, 0}, (Vector2){0, 5}, 4, 3, grid);
+    Ray last = RayGenRay(g, m + (Vector2){9, 10});
+    EXPECT_LT(Vector3Distance(grid[11].direction, last.direction), 1e-6f);
+  }
+}
+
+TEST(BvhPacketTest, MatchesSingleRayTraversal) {
+  // a shuffled triangle soup around the origin, seen from a camera
+  std::mt19937 rng(38);
+  std::uniform_real_distribution<float> u(-1, 1);
+  int n = 4000;
+  Mesh mesh = {0};
+  mesh.triangleCount = n;
+  mesh.vertexCount = 3 * n;
+  mesh.vertices = (float *)malloc(9 * n * sizeof(float));
+  for (int t = 0; t < n; t++) {
+    Vector3 c = {u(rng), u(rng), u(rng)};
+    for (int j = 0; j < 9; j++)
+      mesh.vertices[9 * t + j] = (&c.x)[j % 3] + u(rng) * 0.1f;
+  }
+  Bvh bvh = BuildBvh(mesh);
+
+  Camera3D cam = {{0, 0, 4}, {0, 0, 0}, {0, 1, 0}, 45, CAMERA_PERSPECTIVE};
+  RayGen g = MakeRayGen(cam, SCREEN_WIDTH, SCREEN_HEIGHT);
+  const int nx = 40, ny = 30;
+  Ray rays[nx * ny];
+  RayGenGrid(g, (Vector2){300, 200}, (Vector2){15, 0}, (Vector2){0, 15}, nx,
+             ny, rays);
+  RayCollision hits[nx * ny];
+  int tris[nx * ny], nhit = 0;
+  for (int k = 0; k < nx * ny; k += BVH_PACKET)
+    GetRayCollisionBvhPacket(rays + k, std::min(BVH_PACKET, nx * ny - k), mesh,
+                             bvh, hits + k, tris + k);
+  for (int k = 0; k < nx * ny; k++) {
+    int tri;
+    RayCollision want = GetRayCollisionBvh(rays[k], mesh, bvh, &tri);
+    ASSERT_EQ(hits[k].hit, want.hit) << k;
+    if (want.hit) {
+      EXPECT_EQ(tris[k], tri);
+      EXPECT_FLOAT_EQ(hits[k].distance, want.distance);
+      nhit++;
+    }
+  }
+  EXPECT_GT(nhit, nx * ny / 4);
+  UnloadBvh(bvh);
+  free(mesh.vertices);
+}
+
+TEST(WalkTest, OcclusionCatchesANearerDisconnectedPart) {
+  // a square at z = 0 behind a separate square at z = 1 that covers x > 0
+  float v[] = {-2, -2, 0, 2, -2, 0, 2, 2, 0, -2, -2, 0, 2, 2, 0, -2, 2, 0,
+               0,  -1, 1, 1, -1, 1, 1, 1, 1, 0,  -1, 1, 1, 1, 1, 0,  1, 1};
+  Mesh mesh = {0};
+  mesh.triangleCount = 4;
+  mesh.vertexCount = 12;
+  mesh.vertices = v;
+  int *adj = BuildTriangleAdjacency(mesh);
+  Bvh bvh = BuildBvh(mesh);
+
+  // last frame the cursor was on the back square at x < 0, now it is at x > 0
+  Ray ray = {{0.5f, 0.2f, 5}, {0, 0, -1}};
+  int tri = 0, steps;
+  RayCollision walk = WalkRayCollision(ray, mesh, adj, &tri, 64, &steps);
+  ASSERT_TRUE(walk.hit);
+  EXPECT_NEAR(walk.point.z, 0, 1e-6f);
+  EXPECT_TRUE(RayOccludedBvh(ray, mesh, bvh, walk.distance, tri));
+
+  int front;
+  RayCollision want = GetRayCollisionBvh(ray, mesh, bvh, &front);
+  EXPECT_NEAR(want.point.z, 1, 1e-6f);
+  EXPECT_FALSE(RayOccludedBvh(ray, mesh, bvh, want.distance, front));
+
+  // the hover checks a walk that left last frame's triangle, and any walk
+  // once the camera moved
+  tri = 1; // at (-0.5, 0.2) last frame
+  RayCollision hover =
+      HoverRayCollision(ray, mesh, adj, bvh, false, &tri, &steps);
+  EXPECT_NEAR(hover.point.z, 1, 1e-6f);
+  EXPECT_EQ(steps, -1);
+  tri = 0;
+  hover = HoverRayCollision(ray, mesh, adj, bvh, true, &tri, &steps);
+  EXPECT_NEAR(hover.point.z, 1, 1e-6f);
+
+  // beside the front square the walk is the nearest hit already
+  ray.position.x = -0.5f;
+  tri = 0;
+  walk = WalkRayCollision(ray, mesh, adj, &tri, 64, &steps);
+  ASSERT_TRUE(walk.hit);
+  EXPECT_FALSE(RayOccludedBvh(ray, mesh, bvh, walk.distance, tri));
+  UnloadBvh(bvh);
+  free(adj);
+}
+
+TEST(WalkTest, HoverBeatsTheBvhQuery) {
+  // a finely tessellated sphere under a cursor moving a pixel per frame
+  const int nu = 200, nv = 100;
+  std::vector<float> v;
+  auto add = [&](int i, int j) {
+    float th = 2 * PI * i / nu, ph = PI * j / nv;
+    v.insert(v.end(), {10 * sinf(ph) * cosf(th), 10 * sinf(ph) * sinf(th),
+                       10 * cosf(ph)});
+  };
+  for (int i = 0; i < nu; i++)
+    for (int j = 0; j < nv; j++)
+      for (int k : {0, 1, 2, 0, 2, 3})
+        add(i + (k == 1 || k == 2), j + (k == 2 || k == 3));
+  Mesh mesh = {0};
+  mesh.triangleCount = (int)v.size() / 9;
+  mesh.vertexCount = (int)v.size() / 3;
+  mesh.vertices = v.data();
+  int *adj = BuildTriangleAdjacency(mesh);
+  Bvh bvh = BuildBvh(mesh);
+
+  Camera3D cam = {{0, -40, 0}, {0, 0, 0}, {0, 0, 1}, 45, CAMERA_PERSPECTIVE};
+  RayGen g = MakeRayGen(cam, SCREEN_WIDTH, SCREEN_HEIGHT);
+  std::vector<Ray> rays;
+  // rows clear of the equator, where rays slip between two triangles
+  for (int f = 0; f < 2000; f++)
+    rays.push_back(RayGenRay(g, (Vector2){SCREEN_WIDTH / 2.f - 100 + f % 200,
+                                          SCREEN_HEIGHT / 2.f + 5.5f +
+                                              f / 200}));
+
+  // rays through an edge may report either triangle: compare distances
+  std::vector<RayCollision> want(rays.size()), got(rays.size());
+  int tri, steps, walked = 0, same = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (size_t f = 0; f < rays.size(); f++)
+    want[f] = GetRayCollisionBvh(rays[f], mesh, bvh, &tri);
+  auto t1 = std::chrono::steady_clock::now();
+  tri = -1;
+  for (size_t f = 0; f < rays.size(); f++) {
+    got[f] = HoverRayCollision(rays[f], mesh, adj, bvh, false, &tri, &steps);
+    walked += steps >= 0;
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  double bvh_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+  double hover_ms = std::chrono::duration<double, std::milli>(t2 - t1).count();
+  printf("%zu frames: BVH %.2f ms, hover %.2f ms (%d walked)\n", rays.size(),
+         bvh_ms, hover_ms, walked);
+  for (size_t f = 0; f < rays.size(); f++)
+    same += got[f].hit && fabsf(got[f].distance - want[f].distance) < 1e-4f;
+  EXPECT_EQ(same, (int)rays.size());
+  EXPECT_GT(walked, (int)rays.size() * 9 / 10);
+  EXPECT_LT(hover_ms, bvh_ms);
+  UnloadBvh(bvh);
+  free(adj);
+}
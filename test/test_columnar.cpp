@@ -0,0 +1,110 @@
+#include "columnar.h"
+#include "initdb.h"
+#include "testdb.h"
+#include <gtest/gtest.h>
+
+// `waterfall-picker export` and `import` on a copy of the checked in
+// stl.sqlite3
+class ColumnarTest : public ::testing::Test {
+protected:
+  TestDatabase scratch{"columnar"};
+  std::string file_path = TestTempPath("columnar", ".wfp");
+  sqlite3 *db = NULL;
+
+  void SetUp() override { ASSERT_TRUE(InitDatabase(scratch.c_str(), &db)); }
+
+  void TearDown() override {
+    sqlite3_close(db);
+    std::filesystem::remove(file_path);
+  }
+
+  int Count(const std::string &sql) {
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, NULL);
+    sqlite3_step(stmt);
+    int n = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    return n;
+  }
+
+  int FirstStl() { return Count("SELECT MIN(stl) FROM cams;"); }
+};
+
+TEST_F(ColumnarTest, FileMapsToTheExportedRows) {
+  int stl = FirstStl();
+  ASSERT_GT(stl, 0);
+  ASSERT_TRUE(ExportColumnar(db, stl, file_path.c_str()));
+
+  ColumnarFile cf;
+  ASSERT_TRUE(OpenColumnar(file_path.c_str(), &cf));
+  const ColumnarHeader &h = *cf.header;
+  EXPECT_EQ(h.stl, stl);
+  EXPECT_EQ((int)h.ncams,
+            Count("SELECT COUNT(*) FROM cams WHERE stl = " +
+                  std::to_string(stl)));
+  EXPECT_EQ((int)h.npicks,
+            Count("SELECT COUNT(*) FROM picks JOIN cams ON picks.cam = "
+                  "cams.rowid WHERE cams.stl = " +
+                  std::to_string(stl)));
+  ASSERT_GT(h.npicks, 0u);
+
+  // spot check one pick against its row
+  const int32_t *cam =
+      (const int32_t *)ColumnarArray(cf, "picks.cam", COLUMN_I32, h.npicks);
+  const double *x =
+      (const double *)ColumnarArray(cf, "picks.x", COLUMN_F64, h.npicks);
+  ASSERT_TRUE(cam && x);
+  sqlite3_stmt *stmt;
+  sqlite3_prepare_v2(db,
+                     "SELECT cam, x FROM picks JOIN cams ON picks.cam = "
+                     "cams.rowid WHERE cams.stl = ? "
+                     "ORDER BY picks.cam, picks.rowid LIMIT 1;",
+                     -1, &stmt, NULL);
+  sqlite3_bind_int(stmt, 1, stl);
+  ASSERT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+  EXPECT_EQ(cam[0], sqlite3_column_int(stmt, 0));
+  EXPECT_EQ(x[0], sqlite3_column_double(stmt, 1));
+  sqlite3_finalize(stmt);
+  EXPECT_EQ(ColumnarArray(cf, "picks.x", COLUMN_I32, h.npicks), nullptr);
+  CloseColumnar(&cf);
+}
+
+TEST_F(ColumnarTest, ImportAddsCopiesUnderNewCameras) {
+  int cams = Count("SELECT COUNT(*) FROM cams;");
+  int picks = Count("SELECT COUNT(*) FROM picks;");
+  ASSERT_TRUE(ExportColumnar(db, 0, file_path.c_str()));
+  ASSERT_TRUE(ImportColumnar(db, file_path.c_str(), 0));
+  EXPECT_EQ(Count("SELECT COUNT(*) FROM cams;"), 2 * cams);
+  EXPECT_EQ(Count("SELECT COUNT(*) FROM picks;"), 2 * picks);
+  // every copy matches an original pick on an equal camera, exactly
+  EXPECT_EQ(Count("SELECT COUNT(*) FROM picks p "
+                  "JOIN cams c ON p.cam = c.rowid WHERE p.rowid > " +
+                  std::to_string(Count("SELECT MAX(rowid) FROM picks;") -
+                                 picks) +
+                  " AND EXISTS (SELECT 1 FROM picks q JOIN cams d "
+                  "ON q.cam = d.rowid WHERE q.cam <> p.cam AND q.x = p.x "
+                  "AND q.y = p.y AND q.z = p.z AND q.mx = p.mx AND "
+                  "d.stl = c.stl AND d.posx = c.posx AND d.fovy = c.fovy "
+                  "AND d.proj = c.proj);"),
+            picks);
+}
+
+TEST_F(ColumnarTest, ImportOntoAnotherStl) {
+  int stl = FirstStl();
+  int target = Count("SELECT MAX(rowid) FROM stls;");
+  std::string on_stl = "SELECT COUNT(*) FROM cams WHERE stl = ";
+  int exported = Count(on_stl + std::to_string(stl));
+  int before = Count(on_stl + std::to_string(target));
+  ASSERT_TRUE(ExportColumnar(db, stl, file_path.c_str()));
+  ASSERT_TRUE(ImportColumnar(db, file_path.c_str(), target));
+  EXPECT_EQ(Count(on_stl + std::to_string(target)), before + exported);
+}
+
+TEST_F(ColumnarTest, TruncatedFileImportsNothing) {
+  int picks = Count("SELECT COUNT(*) FROM picks;");
+  ASSERT_TRUE(ExportColumnar(db, 0, file_path.c_str()));
+  std::filesystem::resize_file(file_path,
+                               std::filesystem::file_size(file_path) - 8);
+  EXPECT_FALSE(ImportColumnar(db, file_path.c_str(), 0));
+  EXPECT_EQ(Count("SELECT COUNT(*) FROM picks;"), picks);
+}
@@ -0,0 +1,312 @@
+#include "asyncload.h"
+#include "initdb.h"
+#include "reload.h"
+#include "testdb.h"
+#include "thumbs.h"
+#include <gtest/gtest.h>
+#include <thread>
+
+// PickerContext without a window: the load and write paths the viewer uses,
+// on several contexts at once
+
+// load the fixture into ctx and recast every stored pick from its camera
+static int CountReproducedPicks(PickerContext *ctx) {
+  Mesh mesh = {0};
+  if (!InitializeReadDB(ctx, &mesh))
+    return -1;
+  int n = 0;
+  for (int i = 0; i < ctx->npicks; i++) {
+    if (!LoadCameraID(ctx, ctx->picks2cam[i]))
+      continue;
+    Ray ray = GetScreenToWorldRayEx(ctx->picks2[i], ctx->camera, SCREEN_WIDTH,
+                                    SCREEN_HEIGHT);
+    int tri;
+    RayCollision hit = GetRayCollisionBvh(ray, mesh, ctx->bvh, &tri);
+    // the camera is rounded through REAL columns, so allow a little slack
+    n += hit.hit && Vector3Distance(hit.point, ctx->picks[i]) < 0.1f;
+  }
+  return n;
+}
+
+TEST(ContextTest, ConcurrentContextsReproduceStoredPicks) {
+  const int ncontexts = 4;
+  std::vector<PickerContext> ctx(ncontexts);
+  std::vector<int> reproduced(ncontexts);
+  std::vector<std::thread> threads;
+  for (int c = 0; c < ncontexts; c++) {
+    ctx[c].db_path = TEST_DATABASE;
+    threads.emplace_back(
+        [&, c] { reproduced[c] = CountReproducedPicks(&ctx[c]); });
+  }
+  for (auto &t : threads)
+    t.join();
+  for (int c = 0; c < ncontexts; c++) {
+    EXPECT_GT(ctx[c].npicks, 0);
+    EXPECT_EQ(reproduced[c], ctx[c].npicks);
+    UnloadPickerContext(&ctx[c]);
+  }
+}
+
+TEST(ContextTest, ReloadingThePartReusesItsArena) {
+  PickerContext ctx;
+  ctx.db_path = TEST_DATABASE;
+  Mesh mesh = {0};
+  ASSERT_TRUE(InitializeReadDB(&ctx, &mesh));
+  ArenaBlock *block = ctx.arena.head;
+  size_t total = ctx.arena.total, used = block->used;
+  EXPECT_EQ(block->prev, nullptr); // presized: one block holds the model
+  EXPECT_EQ(ctx.arena.total, block->cap);
+
+  for (int i = 0; i < 3; i++) {
+    ResetModel(&ctx);
+    ASSERT_TRUE(ReadSTLFromDB(ctx.db, ctx.selected_stl_id, &mesh,
+                              &ctx.tri_order, &ctx.arena));
+    BuildPickingStructures(&ctx, mesh);
+    EXPECT_EQ(ctx.arena.head, block);
+    EXPECT_EQ(ctx.arena.total, total);
+    EXPECT_EQ(block->used, used);
+    EXPECT_GT(ctx.bvh.nnodes, 0);
+  }
+  UnloadPickerContext(&ctx);
+  EXPECT_EQ(ctx.arena.head, nullptr);
+}
+
+TEST(ContextTest, ModelSwapHappensOnlyOnceTheNewModelIsRead) {
+  PickerContext ctx;
+  ctx.db_path = TEST_DATABASE;
+  Mesh mesh = {0};
+  ASSERT_TRUE(InitializeReadDB(&ctx, &mesh));
+  SetModelMesh(&ctx, mesh); // what UploadModel leaves behind, minus the GPU
+  Model model = ctx.stl_model;
+  BvhNode *nodes = ctx.bvh.nodes;
+  ArenaBlock *block = ctx.arena.head;
+
+  // a failed read touches neither the model nor the GPU
+  EXPECT_FALSE(LoadSTLFromDB(&ctx, -1));
+  EXPECT_EQ(ctx.stl_model.meshes, model.meshes);
+  EXPECT_EQ(ctx.stl_model.meshes[0].vertices, mesh.vertices);
+  EXPECT_EQ(ctx.bvh.nodes, nodes);
+  EXPECT_EQ(ctx.arena.head, block);
+
+  // the CPU half of a successful one: the old model leaves with staging
+  PickerContext staging;
+  Mesh next;
+  ASSERT_TRUE(StageModel(ctx.db, ctx.selected_stl_id, &staging, &next));
+  SwapModel(&ctx, &staging);
+  EXPECT_EQ(staging.arena.head, block);
+  EXPECT_NE(ctx.bvh.nodes, nodes);
+  ASSERT_TRUE(LoadCameraID(&ctx, ctx.picks2cam[0]));
+  Ray ray = GetScreenToWorldRayEx(ctx.picks2[0], ctx.camera, SCREEN_WIDTH,
+                                  SCREEN_HEIGHT);
+  int tri_old, tri_new;
+  RayCollision want = GetRayCollisionBvh(ray, mesh, staging.bvh, &tri_old);
+  RayCollision got = GetRayCollisionBvh(ray, next, ctx.bvh, &tri_new);
+  ASSERT_TRUE(want.hit);
+  EXPECT_TRUE(got.hit);
+  EXPECT_EQ(got.distance, want.distance);
+  UnloadPickerContext(&staging);
+  UnloadPickerContext(&ctx);
+}
+
+TEST(ContextTest, AsyncLoadBuildsPickingStructuresOnTheWorker) {
+  PickerContext ctx;
+  ctx.db_path = TEST_DATABASE;
+  ctx.hover_tri = 7; // the render thread's, drawn while the worker runs
+  AsyncLoad load;
+  StartAsyncLoad(&load, &ctx);
+  load.worker.join();
+  ASSERT_EQ(load.stage, LOAD_READY);
+  EXPECT_EQ(ctx.hover_tri, 7);
+  EXPECT_TRUE(LoadShowsModel(&load));
+  EXPECT_GT(load.mesh.vertexCount, 0);
+  EXPECT_LT(load.bounds.min.x, load.bounds.max.x);
+  EXPECT_GT(ctx.bvh.nnodes, 0);
+  EXPECT_GT(ctx.npicks, 0);
+  // the upload and the handover are the render thread's
+  EXPECT_FALSE(LoadFinished(&load));
+  EXPECT_EQ(ctx.stl_model.meshes, nullptr);
+  StopAsyncLoad(&load);
+  UnloadPickerContext(&ctx);
+}
+
+TEST(ContextTest, AsyncLoadReportsAMissingStl) {
+  PickerContext ctx;
+  ctx.db_path = TEST_DATABASE;
+  ctx.selected_stl_id = -1;
+  AsyncLoad load;
+  StartAsyncLoad(&load, &ctx);
+  while (load.stage != LOAD_FAILED && load.stage != LOAD_READY)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  EXPECT_FALSE(PollAsyncLoad(&load, &ctx));
+  EXPECT_FALSE(LoadShowsModel(&load));
+  StopAsyncLoad(&load);
+  UnloadPickerContext(&ctx);
+}
+
+TEST(ContextTest, ThumbnailTilesFollowTheirCamera) {
+  PickerContext ctx;
+  ctx.db_path = TEST_DATABASE;
+  ASSERT_TRUE(InitDatabase(ctx.db_path, &ctx.db));
+  std::vector<CamThumb> rows;
+  ASSERT_TRUE(ReadCamThumbs(ctx.db, ctx.selected_stl_id, &rows));
+  ASSERT_GT(rows.size(), 0u);
+  Camera3D cam;
+  ASSERT_TRUE(ReadCamera(ctx.db, rows[0].cam_id, &cam, NULL, NULL));
+  EXPECT_EQ(memcmp(&cam, &rows[0].camera, sizeof cam), 0);
+  for (int i = 0; i < 2; i++) {
+    rows.push_back(rows.back());
+    rows.back().cam_id++;
+  }
+
+  // what RenderThumb does without the GL half
+  ThumbStrip s;
+  s.frame = 1;
+  for (const CamThumb &t : rows)
+    MarkThumbDrawn(&s, AcquireThumbTile(&s, t.cam_id), t);
+  std::vector<int> tiles;
+  for (const CamThumb &t : rows)
+    tiles.push_back(FindThumbTile(&s, t));
+
+  // a deleted camera takes nobody's tile along, a moved one loses its own
+  rows.erase(rows.begin());
+  tiles.erase(tiles.begin());
+  rows[0].camera.fovy += 1;
+  EXPECT_EQ(FindThumbTile(&s, rows[0]), -1);
+  EXPECT_EQ(AcquireThumbTile(&s, rows[0].cam_id), tiles[0]);
+  for (size_t i = 1; i < rows.size(); i++)
+    EXPECT_EQ(FindThumbTile(&s, rows[i]), tiles[i]);
+  UnloadPickerContext(&ctx);
+}
+
+TEST(ContextTest, ThumbnailTilesAreRecycledLeastRecentlyUsedFirst) {
+  // more cameras than the atlas has tiles
+  ThumbStrip s;
+  std::vector<CamThumb> thumbs(THUMB_TILES + 10);
+  for (int i = 0; i < (int)thumbs.size(); i++)
+    thumbs[i] = (CamThumb){.cam_id = i + 1, .camera = {.fovy = 45}};
+  s.frame = 1;
+  for (int i = 0; i < THUMB_TILES; i++)
+    MarkThumbDrawn(&s, AcquireThumbTile(&s, thumbs[i].cam_id), thumbs[i]);
+
+  // scrolled down by 10: the first 10 fall out of the window
+  s.frame = 2;
+  for (int i = 10; i < THUMB_TILES; i++)
+    s.tiles[FindThumbTile(&s, thumbs[i])].used = s.frame;
+  for (int i = THUMB_TILES; i < THUMB_TILES + 10; i++)
+    MarkThumbDrawn(&s, AcquireThumbTile(&s, thumbs[i].cam_id), thumbs[i]);
+  for (int i = 0; i < (int)thumbs.size(); i++)
+    EXPECT_EQ(FindThumbTile(&s, thumbs[i]) >= 0, i >= 10) << i;
+}
+
+TEST(ContextTest, InsertAndDeletePickStayInSync) {
+  TestDatabase scratch("context");
+
+  PickerContext ctx;
+  ctx.db_path = scratch.c_str();
+  Mesh mesh = {0};
+  ASSERT_TRUE(InitializeReadDB(&ctx, &mesh));
+  int n = ctx.npicks;
+
+  ASSERT_TRUE(InsertPick(&ctx, {1, 2}, {3, 4, 5}, ctx.cameraid));
+  EXPECT_EQ(ctx.npicks, n + 1);
+  ASSERT_TRUE(DeletePick(&ctx, 0));
+  EXPECT_EQ(ctx.npicks, n);
+
+  // a second context on the same file sees the same picks
+  PickerContext other;
+  other.db_path = scratch.c_str();
+  ASSERT_TRUE(InitDatabase(other.db_path, &other.db));
+  ASSERT_TRUE(LoadPicksFromDB(&other, ctx.selected_stl_id));
+  EXPECT_EQ(other.npicks, n);
+
+  UnloadPickerContext(&other);
+  UnloadPickerContext(&ctx);
+}
+
+TEST(ContextTest, UpdatedPicksKeepTheirRows) {
+  TestDatabase scratch("context");
+
+  PickerContext ctx;
+  ctx.db_path = scratch.c_str();
+  Mesh mesh = {0};
+  ASSERT_TRUE(InitializeReadDB(&ctx, &mesh));
+  ASSERT_GE(ctx.npicks, 3);
+  int n = ctx.npicks;
+  std::vector<int> ids(ctx.picksid, ctx.picksid + n);
+  std::vector<int> cams(ctx.picks2cam, ctx.picks2cam + n);
+  std::vector<Vector2> screen(ctx.picks2, ctx.picks2 + n);
+  std::vector<Vector3> points(ctx.picks, ctx.picks + n);
+
+  // what the attachment modes do: move some picks onto a plane
+  int idx[] = {0, 2};
+  for (int i : idx)
+    ctx.picks[i] = ctx.picks[i] + (Vector3){1, 2, 3};
+  ASSERT_TRUE(UpdatePickPoints(&ctx, idx, 2));
+
+  PickerContext other;
+  other.db_path = scratch.c_str();
+  ASSERT_TRUE(InitDatabase(other.db_path, &other.db));
+  ASSERT_TRUE(LoadPicksFromDB(&other, ctx.selected_stl_id));
+  ASSERT_EQ(other.npicks, n);
+  for (int i = 0; i < n; i++) {
+    EXPECT_EQ(other.picksid[i], ids[i]);
+    EXPECT_EQ(other.picks2cam[i], cams[i]);
+    EXPECT_EQ(other.picks2[i].x, screen[i].x);
+    EXPECT_EQ(other.picks2[i].y, screen[i].y);
+    EXPECT_LT(Vector3Distance(other.picks[i], ctx.picks[i]), 1e-4f) << i;
+  }
+  EXPECT_GT(Vector3Distance(other.picks[0], points[0]), 1);
+  EXPECT_EQ(Vector3Distance(other.picks[1], points[1]), 0);
+
+  UnloadPickerContext(&other);
+  UnloadPickerContext(&ctx);
+}
+
+static void Exec(const std::string &db_path, const char *sql) {
+  sqlite3 *db;
+  ASSERT_EQ(sqlite3_open(db_path.c_str(), &db), SQLITE_OK);
+  EXPECT_EQ(sqlite3_exec(db, sql, NULL, NULL, NULL), SQLITE_OK);
+  sqlite3_close(db);
+}
+
+TEST(ContextTest, HotReloadPicksUpExternalWrites) {
+  TestDatabase scratch("reload");
+  PickerContext ctx;
+  ctx.db_path = scratch.c_str();
+  Mesh mesh = {0};
+  ASSERT_TRUE(InitializeReadDB(&ctx, &mesh));
+  int n = ctx.npicks;
+
+  // settle the startup poll
+  HotReload r;
+  double now = 0;
+  for (int i = 0; i < 1000 && (now == 0 || r.busy); i++) {
+    PollReload(&r, &ctx, now += RELOAD_POLL_SECONDS);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_FALSE(r.busy);
+  long long version = r.data_version;
+
+  // another process adds a pick: data_version moves and the picks reload
+  Exec(scratch.path, "INSERT INTO picks (cam, mx, my, x, y, z) "
+                "SELECT cam, mx + 1, my, x, y, z FROM picks LIMIT 1;");
+  for (int i = 0; i < 1000 && ctx.npicks == n; i++) {
+    PollReload(&r, &ctx, now += RELOAD_POLL_SECONDS);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_NE(r.data_version, version);
+  EXPECT_EQ(ctx.npicks, n + 1);
+
+  // rewriting the STL changes its hash: the worker re-parses it
+  Exec(scratch.path, "UPDATE stls SET hash = 'changed';");
+  StartReload(&r, &ctx);
+  while (!r.done)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  EXPECT_TRUE(r.ok);
+  EXPECT_TRUE(r.mesh_changed);
+  EXPECT_EQ(r.mesh.triangleCount, mesh.triangleCount);
+  EXPECT_GT(r.staging->bvh.nnodes, 0);
+  StopReload(&r);
+
+  UnloadPickerContext(&ctx);
+}
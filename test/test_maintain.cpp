@@ -0,0 +1,197 @@
+#include "maintain.h"
+#include "rtree.h"
+#include "testdb.h"
+#include <gtest/gtest.h>
+
+// idle-time maintenance on a copy of the checked in stl.sqlite3, whose stl 1
+// has cam 1 without picks and cam 2 with five
+class MaintainTest : public ::testing::Test {
+protected:
+  TestDatabase scratch{"maintain"};
+  sqlite3 *db = NULL;
+
+  void SetUp() override { ASSERT_TRUE(InitDatabase(scratch.c_str(), &db)); }
+
+  void TearDown() override { sqlite3_close(db); }
+
+  int Count(const char *sql) { return (int)MaintainPragma(db, sql); }
+
+  // what `compact` leaves behind for the idle steps
+  void IndexPicks() {
+    ASSERT_TRUE(MaintainExec(db, "CREATE INDEX picks_cam ON picks(cam);"));
+  }
+
+  // a copy of cam 2 moved by d along x, returning its rowid
+  int CopyCam2(double d) {
+    std::string sql = "INSERT INTO cams SELECT stl, posx + " +
+                      std::to_string(d) +
+                      ", posy, posz, tx, ty, tz, upx, upy, upz, fovy, proj, "
+                      "attachment FROM cams WHERE rowid = 2;";
+    EXPECT_TRUE(MaintainExec(db, sql.c_str()));
+    return (int)sqlite3_last_insert_rowid(db);
+  }
+
+  void AddPick(int cam) {
+    std::string sql = "INSERT INTO picks SELECT " + std::to_string(cam) +
+                      ", mx, my, x, y, z FROM picks WHERE rowid = 1;";
+    EXPECT_TRUE(MaintainExec(db, sql.c_str()));
+  }
+};
+
+TEST_F(MaintainTest, MergesDuplicatesAndRemovesEmptyCameras) {
+  int dup = CopyCam2(MAINTAIN_CAM_EPS / 2), apart = CopyCam2(1.0);
+  CopyCam2(2.0); // no picks
+  int current = CopyCam2(3.0);
+  AddPick(dup);
+  AddPick(dup);
+  AddPick(apart);
+  int picks = Count("SELECT COUNT(*) FROM picks;");
+
+  MaintainStats st;
+  ASSERT_TRUE(CompactDatabase(&db, scratch.c_str(), current, &st));
+  EXPECT_EQ(st.cams_merged, 1);
+  EXPECT_EQ(st.picks_moved, 2);
+  EXPECT_EQ(st.cams_removed, 1);
+  EXPECT_TRUE(HasPicksCamIndex(db));
+  EXPECT_EQ(Count("SELECT COUNT(*) FROM picks;"), picks);
+  EXPECT_EQ(Count("SELECT COUNT(*) FROM picks WHERE cam = 2;"), 7);
+  // cam 1 is stl 1's first camera, current the viewer's
+  std::string left = "SELECT group_concat(rowid) FROM (SELECT rowid FROM cams "
+                     "ORDER BY rowid);";
+  sqlite3_stmt *stmt;
+  sqlite3_prepare_v2(db, left.c_str(), -1, &stmt, NULL);
+  ASSERT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+  EXPECT_EQ(std::string((const char *)sqlite3_column_text(stmt, 0)),
+            "1,2," + std::to_string(apart) + "," + std::to_string(current));
+  sqlite3_finalize(stmt);
+
+  // a second pass finds nothing
+  MaintainStats again;
+  ASSERT_TRUE(CompactDatabase(&db, scratch.c_str(), current, &again));
+  EXPECT_EQ(again.cams_merged + again.cams_removed, 0);
+}
+
+TEST_F(MaintainTest, CurrentCameraSurvivesItsDuplicates) {
+  IndexPicks();
+  int dup = CopyCam2(0);
+  MaintainScope scope = {.keep_cam = dup};
+  MaintainWork w;
+  MaintainStats st;
+  bool done;
+  ASSERT_TRUE(MergeDuplicateCams(db, scope, &w, INT_MAX, &st, &done));
+  EXPECT_TRUE(done);
+  EXPECT_EQ(st.picks_moved, 5);
+  EXPECT_EQ(Count("SELECT COUNT(*) FROM cams WHERE rowid = 2;"), 0);
+  EXPECT_EQ(Count(("SELECT COUNT(*) FROM picks WHERE cam = " +
+                   std::to_string(dup) + ";")
+                      .c_str()),
+            5);
+}
+
+TEST_F(MaintainTest, IdlePassKeepsToItsStlAndSession) {
+  // two identical cameras of another STL, one without picks
+  int other = CopyCam2(5.0), other_dup = CopyCam2(5.0);
+  std::string sql = "UPDATE cams SET stl = 2 WHERE rowid >= " +
+                    std::to_string(other) + ";";
+  ASSERT_TRUE(MaintainExec(db, sql.c_str()));
+  AddPick(other);
+  int old = CopyCam2(2.0);
+  int last = Count("SELECT MAX(rowid) FROM cams;");
+  // inserted after the viewer started, by the viewer and by someone else
+  int mine = CopyCam2(3.0), theirs = CopyCam2(4.0);
+
+  IndexPicks();
+  std::vector<int> own = {mine};
+  MaintainScope scope = {
+      .stl = 1, .last_cam = last, .own = &own, .keep_cam = 2};
+  MaintainWork w;
+  MaintainStats st;
+  for (int step = MAINTAIN_DEDUPE; step < MAINTAIN_CACHE; step++)
+    for (bool done = false; !done;)
+      ASSERT_TRUE(MaintainStep(db, step, scope, &w, MAINTAIN_CAM_ROWS, &st,
+                               &done));
+  EXPECT_EQ(st.cams_merged, 0);
+  EXPECT_EQ(st.cams_removed, 2);
+  for (int id : {old, mine})
+    EXPECT_EQ(Count(("SELECT COUNT(*) FROM cams WHERE rowid = " +
+                     std::to_string(id) + ";")
+                        .c_str()),
+              0);
+  EXPECT_EQ(Count("SELECT COUNT(*) FROM cams;"), 5);
+
+  // compact takes every STL and every camera
+  MaintainStats all;
+  ASSERT_TRUE(CompactDatabase(&db, scratch.c_str(), 2, &all));
+  EXPECT_EQ(all.cams_merged, 1);
+  EXPECT_EQ(all.cams_removed, 1);
+  EXPECT_EQ(Count(("SELECT COUNT(*) FROM cams WHERE rowid IN (" +
+                   std::to_string(other_dup) + ", " + std::to_string(theirs) +
+                   ");")
+                      .c_str()),
+            0);
+}
+
+TEST_F(MaintainTest, StepsStayWithinTheirRowBudget) {
+  std::vector<int> cams;
+  for (int i = 0; i < 10; i++)
+    cams.push_back(CopyCam2(1.0 + i));
+  MaintainScope scope = {.keep_cam = 2};
+  MaintainWork w;
+  MaintainStats st;
+  bool done = false;
+  // without picks_cam every camera would scan picks: nothing to do yet
+  ASSERT_TRUE(RemoveEmptyCams(db, scope, &w, 3, &st, &done));
+  EXPECT_TRUE(done);
+  EXPECT_EQ(st.cams_removed, 0);
+  w = MaintainWork{};
+
+  IndexPicks();
+  ASSERT_TRUE(RemoveEmptyCams(db, scope, &w, 3, &st, &done));
+  EXPECT_FALSE(done);
+  EXPECT_EQ(st.cams_removed, 3);
+
+  // picked through after the plan was made
+  AddPick(cams.back());
+  int frames = 1;
+  for (; !done; frames++)
+    ASSERT_TRUE(RemoveEmptyCams(db, scope, &w, 3, &st, &done));
+  EXPECT_EQ(frames, 4);
+  EXPECT_EQ(st.cams_removed, 9);
+  EXPECT_EQ(Count("SELECT COUNT(*) FROM cams;"), 3);
+}
+
+TEST_F(MaintainTest, IncrementalVacuumShrinksTheFile) {
+  // the rewrite keeps virtual tables and triggers working
+  ASSERT_TRUE(BuildRtree(db));
+  MaintainStats st;
+  ASSERT_TRUE(CompactDatabase(&db, scratch.c_str(), 0, &st));
+  EXPECT_EQ(MaintainPragma(db, "PRAGMA auto_vacuum;"), 2);
+  EXPECT_EQ(Count("SELECT COUNT(*) FROM picks JOIN pick_rtree r ON "
+                  "r.id = picks.rowid AND r.minx = picks.x;"),
+            Count("SELECT COUNT(*) FROM picks;"));
+  AddPick(2);
+  EXPECT_EQ(Count("SELECT COUNT(*) FROM pick_rtree;"),
+            Count("SELECT COUNT(*) FROM picks;"));
+  std::vector<int> tris;
+  BoundingBox all = {{-1e9f, -1e9f, -1e9f}, {1e9f, 1e9f, 1e9f}};
+  ASSERT_TRUE(QueryTrianglesInBox(db, 1, all, &tris));
+  EXPECT_EQ((int)tris.size(), 32650);
+
+  ASSERT_TRUE(MaintainExec(db, "CREATE TABLE junk (b BLOB);"
+                               "INSERT INTO junk VALUES (zeroblob(2000000));"
+                               "DROP TABLE junk;"));
+  long long pages = MaintainPragma(db, "PRAGMA page_count;");
+  ASSERT_GT(MaintainPragma(db, "PRAGMA freelist_count;"), 400);
+
+  // a frame's worth at a time, as the viewer does
+  MaintainStats idle;
+  int frames = 0;
+  for (bool done = false; !done; frames++)
+    ASSERT_TRUE(VacuumStep(db, MAINTAIN_VACUUM_PAGES, &idle, &done));
+  EXPECT_GT(frames, 1);
+  EXPECT_EQ(MaintainPragma(db, "PRAGMA freelist_count;"), 0);
+  EXPECT_EQ(idle.bytes_reclaimed,
+            (pages - MaintainPragma(db, "PRAGMA page_count;")) *
+                MaintainPragma(db, "PRAGMA page_size;"));
+  EXPECT_GT(idle.bytes_reclaimed, 1000000);
+}
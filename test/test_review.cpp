@@ -0,0 +1,86 @@
+#include "raygen.h"
+#include "review.h"
+#include "testdb.h"
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+
+// the review renderer on the checked in stl.sqlite3, which it only reads
+class ReviewTest : public ::testing::Test {
+protected:
+  sqlite3 *db = NULL;
+  ReviewScene scene;
+  ModelArena arena = {0};
+  ReplayPick *picks = NULL;
+  std::vector<ReviewView> views;
+
+  void SetUp() override {
+    ASSERT_TRUE(InitDatabase(TEST_DATABASE, &db));
+    ASSERT_TRUE(ReadSTLFromDB(db, 1, &scene.mesh, NULL, &arena));
+    scene.npicks = LoadReplayPicks(db, 1, &picks);
+    ASSERT_GT(scene.npicks, 0);
+    scene.picks = picks;
+    BuildReviewClusters(&scene);
+    ASSERT_TRUE(ReadReviewViews(db, 1, SCREEN_WIDTH, SCREEN_HEIGHT, &views));
+    ASSERT_EQ(views.size(), 2u);
+  }
+
+  void TearDown() override {
+    free(picks);
+    ArenaRelease(&arena);
+    sqlite3_close(db);
+  }
+
+  static bool Background(Color c) { return ColorIsEqual(c, RAYWHITE); }
+};
+
+TEST_F(ReviewTest, PicksAreRedWhereTheyWereMade) {
+  for (const ReviewView &v : views) {
+    std::vector<Color> px(v.width * v.height);
+    RenderReviewView(scene, v, px.data());
+    for (int i = 0; i < scene.npicks; i++) {
+      if (picks[i].cam != v.cam_id)
+        continue;
+      Color c = px[(int)picks[i].m.y * v.width + (int)picks[i].m.x];
+      EXPECT_TRUE(ColorIsEqual(c, RED)) << "pick " << picks[i].pick;
+    }
+  }
+}
+
+TEST_F(ReviewTest, CoverageMatchesRayCasts) {
+  // without picks, a pixel is background exactly when its ray misses
+  scene.npicks = 0;
+  Bvh bvh = BuildBvh(scene.mesh);
+  for (const ReviewView &v : views) {
+    std::vector<Color> px(v.width * v.height);
+    RenderReviewView(scene, v, px.data());
+    RayGen g = MakeRayGen(v.camera, v.width, v.height);
+    int n = 0, differ = 0;
+    for (int y = 2; y < v.height; y += 7)
+      for (int x = 3; x < v.width; x += 7, n++) {
+        Ray ray = RayGenRay(g, (Vector2){x + 0.5f, y + 0.5f});
+        int tri;
+        bool hit = GetRayCollisionBvh(ray, scene.mesh, bvh, &tri).hit;
+        differ += hit == Background(px[y * v.width + x]);
+      }
+    // silhouette pixels may go either way
+    EXPECT_LT(differ, n / 200) << "cam " << v.cam_id;
+  }
+  UnloadBvh(bvh);
+}
+
+TEST_F(ReviewTest, WritesAnIndexOfEveryView) {
+  std::string dir = TestTempPath("review", "");
+  ASSERT_TRUE(ReviewStl(db, 1, dir.c_str()));
+  std::ifstream in(dir + "/index.json");
+  std::string index((std::istreambuf_iterator<char>(in)),
+                    std::istreambuf_iterator<char>());
+  EXPECT_EQ(index.rfind("{\"stl\":1,", 0), 0u) << index;
+  EXPECT_NE(index.find("{\"cam\":1,\"file\":\"cam1.png\",\"picks\":0,"),
+            std::string::npos)
+      << index;
+  EXPECT_NE(index.find("{\"cam\":2,\"file\":\"cam2.png\",\"picks\":5,"),
+            std::string::npos)
+      << index;
+  std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,103 @@
+#include "rtree.h"
+#include "testdb.h"
+#include <algorithm>
+#include <gtest/gtest.h>
+
+// `waterfall-picker rtree` on a copy of the checked in stl.sqlite3
+class RtreeTest : public ::testing::Test {
+protected:
+  TestDatabase scratch{"rtree"};
+  PickerContext ctx;
+
+  void SetUp() override {
+    ctx.db_path = scratch.c_str();
+    ASSERT_TRUE(InitDatabase(ctx.db_path, &ctx.db));
+    ASSERT_TRUE(BuildRtree(ctx.db));
+  }
+
+  void TearDown() override { UnloadPickerContext(&ctx); }
+
+  int Count(const char *sql) {
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(ctx.db, sql, -1, &stmt, NULL);
+    sqlite3_step(stmt);
+    int n = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    return n;
+  }
+};
+
+TEST_F(RtreeTest, TrianglesInBoxCoverABruteForceScan) {
+  Mesh mesh = {0};
+  int *order = NULL;
+  ASSERT_TRUE(ReadSTLFromDB(ctx.db, ctx.selected_stl_id, &mesh, &order,
+                            &ctx.arena));
+  // the lower corner octant of the part
+  BoundingBox b = GetMeshBoundingBox(mesh);
+  BoundingBox q = {b.min, (b.min + b.max) * 0.5f};
+
+  std::vector<int> found;
+  ASSERT_TRUE(QueryTrianglesInBox(ctx.db, ctx.selected_stl_id, q, &found));
+  std::sort(found.begin(), found.end());
+  int inside = 0;
+  for (int t = 0; t < mesh.triangleCount; t++) {
+    Vector3 p[3];
+    MeshTriangle(mesh, t, p);
+    BoundingBox tb = {Vector3Min(Vector3Min(p[0], p[1]), p[2]),
+                      Vector3Max(Vector3Max(p[0], p[1]), p[2])};
+    if (tb.max.x < q.min.x || tb.min.x > q.max.x || tb.max.y < q.min.y ||
+        tb.min.y > q.max.y || tb.max.z < q.min.z || tb.min.z > q.max.z)
+      continue;
+    inside++;
+    EXPECT_TRUE(std::binary_search(found.begin(), found.end(), order[t]))
+        << "triangle " << order[t];
+  }
+  EXPECT_GT(inside, 0);
+  EXPECT_LT((int)found.size(), mesh.triangleCount);
+}
+
+TEST_F(RtreeTest, PickIndexFollowsInsertAndDelete) {
+  ASSERT_TRUE(LoadPicksFromDB(&ctx, ctx.selected_stl_id));
+  ASSERT_TRUE(LoadCameraFromDB(&ctx, ctx.selected_stl_id));
+  std::vector<int> ids;
+  BoundingBox all = {{-1e9f, -1e9f, -1e9f}, {1e9f, 1e9f, 1e9f}};
+  ASSERT_TRUE(QueryPicksInBox(ctx.db, all, &ids));
+  EXPECT_EQ((int)ids.size(), Count("SELECT COUNT(*) FROM picks;"));
+
+  Vector3 p = {1234.5f, -678.25f, 91.125f};
+  ASSERT_TRUE(InsertPick(&ctx, {1, 2}, p, ctx.cameraid));
+  int id = ctx.picksid[ctx.npicks - 1];
+  ids.clear();
+  ASSERT_TRUE(QueryPicksNear(ctx.db, p + (Vector3){0.5f, 0, 0}, 1.f, &ids));
+  EXPECT_EQ(ids, std::vector<int>{id});
+  ids.clear();
+  ASSERT_TRUE(QueryPicksNear(ctx.db, p + (Vector3){0.5f, 0.5f, 0.5f}, 0.8f,
+                             &ids));
+  EXPECT_TRUE(ids.empty()); // inside the cube, outside the ball
+
+  ASSERT_TRUE(DeletePick(&ctx, ctx.npicks - 1));
+  ids.clear();
+  ASSERT_TRUE(QueryPicksNear(ctx.db, p, 1.f, &ids));
+  EXPECT_TRUE(ids.empty());
+}
+
+TEST_F(RtreeTest, RewrittenStlIsIndexedAgain) {
+  BoundingBox all = {{-1e9f, -1e9f, -1e9f}, {1e9f, 1e9f, 1e9f}};
+  std::vector<int> tris;
+  ASSERT_TRUE(QueryTrianglesInBox(ctx.db, ctx.selected_stl_id, all, &tris));
+  size_t n = tris.size();
+  ASSERT_GT(n, 0u);
+
+  std::string sql = "UPDATE stls SET data = data, hash = hash || 'x' "
+                    "WHERE rowid = " +
+                    std::to_string(ctx.selected_stl_id) + ";";
+  ASSERT_TRUE(RtreeExec(ctx.db, sql.c_str()));
+  tris.clear();
+  ASSERT_TRUE(QueryTrianglesInBox(ctx.db, ctx.selected_stl_id, all, &tris));
+  EXPECT_TRUE(tris.empty());
+
+  ASSERT_TRUE(BuildRtree(ctx.db));
+  tris.clear();
+  ASSERT_TRUE(QueryTrianglesInBox(ctx.db, ctx.selected_stl_id, all, &tris));
+  EXPECT_EQ(tris.size(), n);
+}
@@ -0,0 +1,157 @@
+#include "serve.h"
+#include "testdb.h"
+#include <gtest/gtest.h>
+
+// exercise `waterfall-picker serve` over a real unix socket, on a copy of the
+// checked in stl.sqlite3
+class ServeTest : public ::testing::Test {
+protected:
+  TestDatabase scratch{"serve"};
+  std::string socket_path = TestTempPath("serve", ".sock");
+  std::thread server;
+
+  void SetUp() override {
+    unlink(socket_path.c_str());
+    server = std::thread(ServeUnixSocket, socket_path.c_str(), scratch.c_str());
+  }
+
+  void TearDown() override {
+    if (server.joinable()) {
+      Request("{\"op\":\"shutdown\"}");
+      server.join();
+    }
+  }
+
+  int Connect() {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path.c_str());
+    // the server thread may not be listening yet
+    for (int i = 0; i < 500; i++) {
+      if (connect(fd, (struct sockaddr *)&addr, sizeof addr) == 0)
+        break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return fd;
+  }
+
+  std::string Request(const std::string &line) {
+    int fd = Connect();
+    std::string msg = line + "\n", reply;
+    send(fd, msg.data(), msg.size(), MSG_NOSIGNAL);
+    char c;
+    while (read(fd, &c, 1) == 1 && c != '\n')
+      reply += c;
+    close(fd);
+    return reply;
+  }
+
+  void Exec(const char *sql) {
+    sqlite3 *db;
+    sqlite3_open(scratch.c_str(), &db);
+    ASSERT_EQ(sqlite3_exec(db, sql, NULL, NULL, NULL), SQLITE_OK) << sql;
+    sqlite3_close(db);
+  }
+
+  int CountPicks() {
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    sqlite3_open(scratch.c_str(), &db);
+    sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM picks;", -1, &stmt, NULL);
+    sqlite3_step(stmt);
+    int n = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    return n;
+  }
+};
+
+TEST_F(ServeTest, Ping) {
+  std::string reply = Request("{\"op\":\"ping\"}");
+  EXPECT_EQ(reply.rfind("{\"ok\":true", 0), 0u) << reply;
+}
+
+TEST_F(ServeTest, UnknownOp) {
+  std::string reply = Request("{\"op\":\"nope\"}");
+  EXPECT_NE(reply.find("\"ok\":false"), std::string::npos) << reply;
+}
+
+TEST_F(ServeTest, CastReproducesStoredPick) {
+  // picks.rowid 1 was made at (475, 548) from cam 2, whose row stores the
+  // camera rounded through REAL columns
+  std::string reply =
+      Request("{\"op\":\"cast\",\"cam\":2,\"points\":[[475,548],[0,0]]}");
+  ASSERT_EQ(reply.rfind("{\"ok\":true", 0), 0u) << reply;
+  float x, y, z;
+  const char *hits = strstr(reply.c_str(), "\"hits\":[[");
+  ASSERT_NE(hits, nullptr) << reply;
+  ASSERT_EQ(sscanf(hits, "\"hits\":[[%f,%f,%f]", &x, &y, &z), 3);
+  EXPECT_NEAR(x, 39.2094f, 0.1);
+  EXPECT_NEAR(y, 32.9729f, 0.1);
+  EXPECT_NEAR(z, 4.8564f, 0.1);
+  EXPECT_NE(reply.find(",null]"), std::string::npos) << reply;
+}
+
+TEST_F(ServeTest, ReplayOntoSameModelWritesBack) {
+  int before = CountPicks();
+  std::string reply = Request("{\"op\":\"replay\",\"from\":1,\"to\":1}");
+  ASSERT_EQ(reply.rfind("{\"ok\":true", 0), 0u) << reply;
+  EXPECT_EQ(reply.find("\"hit\":false"), std::string::npos) << reply;
+  EXPECT_EQ(CountPicks(), before);
+
+  reply = Request("{\"op\":\"replay\",\"from\":1,\"to\":1,\"write\":1}");
+  ASSERT_EQ(reply.rfind("{\"ok\":true", 0), 0u) << reply;
+  EXPECT_EQ(CountPicks(), 2 * before);
+}
+
+TEST_F(ServeTest, RepeatedReplayIsServedFromTheCache) {
+  auto picks = [](const std::string &reply) {
+    size_t at = reply.find("\"picks\"");
+    return reply.substr(at, reply.find("],\"ms\"") - at);
+  };
+  const char *replay = "{\"op\":\"replay\",\"from\":1,\"to\":1}";
+  std::string all = "\"cached\":" + std::to_string(CountPicks()) + ",";
+  std::string first = Request(replay);
+  ASSERT_EQ(first.rfind("{\"ok\":true", 0), 0u) << first;
+  EXPECT_NE(first.find("\"cached\":0,"), std::string::npos) << first;
+
+  std::string again = Request(replay);
+  EXPECT_NE(again.find(all), std::string::npos) << again;
+  EXPECT_EQ(picks(again), picks(first));
+
+  // every pick of the checked in database is on cam 2
+  Exec("UPDATE cams SET fovy = fovy + 1 WHERE rowid = 2;");
+  again = Request(replay);
+  EXPECT_NE(again.find("\"cached\":0,"), std::string::npos) << again;
+  again = Request(replay);
+  EXPECT_NE(again.find(all), std::string::npos) << again;
+
+  Exec("UPDATE stls SET hash = hash || 'x';");
+  again = Request(replay);
+  EXPECT_NE(again.find("\"cached\":0,"), std::string::npos) << again;
+}
+
+TEST_F(ServeTest, ShutdownDoesNotWaitForOpenConnections) {
+  // one client idles without a request, the other sends shutdown and stays
+  // connected after its reply
+  int idle = Connect(), client = Connect();
+  auto t0 = std::chrono::steady_clock::now();
+  const char *msg = "{\"op\":\"shutdown\"}\n";
+  send(client, msg, strlen(msg), MSG_NOSIGNAL);
+  std::string reply;
+  char c;
+  while (read(client, &c, 1) == 1 && c != '\n')
+    reply += c;
+  EXPECT_EQ(reply.rfind("{\"ok\":true", 0), 0u) << reply;
+  server.join();
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - t0)
+                       .count();
+  EXPECT_LT(seconds, SERVE_DRAIN_SECONDS);
+  // both see the server hang up
+  EXPECT_EQ(read(idle, &c, 1), 0);
+  EXPECT_EQ(read(client, &c, 1), 0);
+  close(idle);
+  close(client);
+}
@@ -0,0 +1,31 @@
+#ifndef TESTDB_ONCE
+#include <filesystem>
+#include <string>
+#include <unistd.h>
+
+// Scratch files for the tests that write: names in the temp directory that
+// are unique to the test process, and copies of the checked in stl.sqlite3
+// (TEST_DATABASE) that go away with the object owning them.
+
+inline std::string TestTempPath(const std::string &name, const char *ext) {
+  return std::filesystem::temp_directory_path().string() +
+         "/waterfall-picker-" + name + "-" + std::to_string(getpid()) + ext;
+}
+
+struct TestDatabase {
+  std::string path;
+
+  explicit TestDatabase(const std::string &name)
+      : path(TestTempPath(name, ".sqlite3")) {
+    std::filesystem::copy_file(
+        TEST_DATABASE, path,
+        std::filesystem::copy_options::overwrite_existing);
+  }
+  ~TestDatabase() { std::filesystem::remove(path); }
+  TestDatabase(const TestDatabase &) = delete;
+  TestDatabase &operator=(const TestDatabase &) = delete;
+
+  const char *c_str() const { return path.c_str(); }
+};
+#define TESTDB_ONCE
+#endif